@@ -0,0 +1,236 @@
+#include "AudioController.h"
+#include "source/AudioSourceFactory.h"
+#include "utils/Logger.h"
+
+AudioController::~AudioController() {
+    // 播放器先停，下载器再还回去
+    player.stop();
+    clearQueued();
+    if (currentDownloader_) {
+        NetworkDownloadMgr::getInstance().releaseDownloader(currentDownloader_);
+    }
+    for (auto& downloader : fadingDownloaders_) {
+        NetworkDownloadMgr::getInstance().releaseDownloader(downloader);
+    }
+}
+
+void AudioController::setPlaylist(std::shared_ptr<AudioList> playlist) {
+    currentPlaylist = std::move(playlist);
+    currentIndex = -1;
+    prefetchedIndex_ = -1;
+    // 已经排进播放器的源还在用下载器，不能还；换过去之后索引跟着是 -1
+    queuedSource_.reset();
+    queuedIndex_ = -1;
+}
+
+bool AudioController::playAtIndex(int index) {
+    if (!currentPlaylist || index < 0 || index >= static_cast<int>(currentPlaylist->tracks().size())) {
+        LOG_WARN("playAtIndex: index %d out of range", index);
+        return false;
+    }
+    const AudioTrack& track = currentPlaylist->tracks()[index];
+
+    // 旧的还在放，新的先准备好（网络歌要等到能认出格式），切的时候才不会空等
+    std::shared_ptr<NetworkDownloader> downloader;
+    auto src = openTrack(track, downloader);
+    if (!src || !src->decoderInit_) {
+        LOG_ERROR("Open track failed: %s", track.sourceURL.c_str());
+        if (downloader) {
+            NetworkDownloadMgr::getInstance().releaseDownloader(downloader);
+        }
+        return false;
+    }
+
+    // setSource 里旧源和排着的源析构，旧下载器之后才能还
+    const bool ok = player.setSource(std::move(src));
+    clearQueued();
+    if (currentDownloader_) {
+        NetworkDownloadMgr::getInstance().releaseDownloader(currentDownloader_);
+    }
+    currentDownloader_ = std::move(downloader);
+    currentIndex = index;
+    if (prefetchedIndex_ == index) {
+        prefetchedIndex_ = -1;
+    }
+    // 格式一样的换源设备一直在跑，不用再 start
+    if (ok && !player.isPlaying()) {
+        player.play();
+    }
+    return ok;
+}
+
+void AudioController::playNext() {
+    const int next = nextIndex();
+    if (next >= 0) {
+        playAtIndex(next);
+    }
+}
+
+void AudioController::playPrev() {
+    if (currentIndex > 0) {
+        playAtIndex(currentIndex - 1);
+    }
+}
+
+void AudioController::toggleLike() {
+    const AudioTrack* track = getCurrentTrack();
+    if (track) {
+        currentPlaylist->setLiked(track->trackId, !track->liked);
+    }
+}
+
+const AudioTrack* AudioController::getCurrentTrack() const {
+    if (!currentPlaylist || currentIndex < 0 || currentIndex >= static_cast<int>(currentPlaylist->tracks().size())) {
+        return nullptr;
+    }
+    return &currentPlaylist->tracks()[currentIndex];
+}
+
+void AudioController::poll() {
+    // 回调已经放到排队的那首了：播放器那边换好了，这边跟着换
+    if (player.advance()) {
+        if (currentDownloader_) {
+            NetworkDownloadMgr::getInstance().releaseDownloader(currentDownloader_);
+        }
+        currentDownloader_ = std::move(queuedDownloader_);
+        currentIndex = queuedIndex_;
+        queuedIndex_ = -1;
+    }
+    // 淡出的都回收了，它们的下载器可以还了
+    if (!fadingDownloaders_.empty() && !player.fading()) {
+        for (auto& downloader : fadingDownloaders_) {
+            NetworkDownloadMgr::getInstance().releaseDownloader(downloader);
+        }
+        fadingDownloaders_.clear();
+    }
+
+    // 放完了还没接上：格式不一样排不进去，或者下一首没来得及开，只能按老办法切
+    if (player.finished() && player.isPlaying()) {
+        if (queuedSource_) {
+            const int index = queuedIndex_;
+            auto src = std::move(queuedSource_);
+            auto downloader = std::move(queuedDownloader_);
+            queuedIndex_ = -1;
+            player.setSource(std::move(src));
+            if (currentDownloader_) {
+                NetworkDownloadMgr::getInstance().releaseDownloader(currentDownloader_);
+            }
+            currentDownloader_ = std::move(downloader);
+            currentIndex = index;
+            player.play();
+        }
+        else if (nextIndex() >= 0) {
+            playNext();
+        }
+        return;
+    }
+
+    const int next = nextIndex();
+    if (next < 0) return;
+
+    // 当前这首下完了连接就闲着，正好拿来拉下一首；没下完的话等快放完了再拉，别和当前这首抢带宽
+    const bool downloaded = currentDownloader_ && currentDownloader_->isEndOfStream();
+    if (next != prefetchedIndex_ && (downloaded || nearEnd(prefetchLeadSeconds_))) {
+        prefetchTrack(next);
+    }
+    if (crossfadeSeconds_ > 0) {
+        if (next != queuedIndex_ && nearEnd(crossfadeSeconds_)) {
+            crossfadeTrack(next);
+        }
+    }
+    else if (gapless_ && next != queuedIndex_ && nearEnd(GaplessLeadSeconds)) {
+        queueTrack(next);
+    }
+}
+
+bool AudioController::nearEnd(double seconds) const {
+    const AudioTrack* track = getCurrentTrack();
+    return track && track->meta.duration > 0 && player.playedSeconds() >= track->meta.duration - seconds;
+}
+
+int AudioController::nextIndex() const {
+    if (!currentPlaylist || currentIndex < 0) return -1;
+    const int next = currentIndex + 1;
+    return next < static_cast<int>(currentPlaylist->tracks().size()) ? next : -1;
+}
+
+void AudioController::prefetchTrack(int index) {
+    prefetchedIndex_ = index;
+    const AudioTrack& track = currentPlaylist->tracks()[index];
+    if (track.sourceType != AudioSourceType::NetworkStream) return;   // 本地文件不用预取
+
+    // 有大小和时长就按平均码率算，没有就按默认码率
+    const double bytesPerSecond = track.meta.duration > 0 && track.meta.size > 0
+        ? track.meta.size / track.meta.duration : ReadAheadController::DefaultBitrate;
+    const auto bytes = static_cast<size_t>(bytesPerSecond * prefetchSeconds_);
+    NetworkDownloadMgr::getInstance().prefetch(track.sourceURL, bytes);
+}
+
+void AudioController::queueTrack(int index) {
+    clearQueued();
+    queuedIndex_ = index;   // 开失败了也记着，别每次 poll 都重试，放完了 playNext 再试一次
+
+    // 网络歌前面预取过的话这里不用等连接；打开要认格式，会在这里卡一小会
+    const AudioTrack& track = currentPlaylist->tracks()[index];
+    auto src = openTrack(track, queuedDownloader_);
+    if (!src || !src->decoderInit_) {
+        LOG_WARN("Queue next track failed: %s", track.sourceURL.c_str());
+        return;
+    }
+    if (!player.queueNext(src)) {
+        // 格式不一样，接不上，只能放完了重开设备
+        LOG_INFO("Next track format differs, no gapless transition: %s", track.sourceURL.c_str());
+        queuedSource_ = std::move(src);
+    }
+}
+
+void AudioController::crossfadeTrack(int index) {
+    const AudioTrack& track = currentPlaylist->tracks()[index];
+    std::shared_ptr<NetworkDownloader> downloader;
+    auto src = openTrack(track, downloader);
+    if (!src || !src->decoderInit_ || !player.crossfadeTo(std::move(src), static_cast<ma_uint32>(crossfadeSeconds_ * 1000))) {
+        LOG_WARN("Crossfade to next track failed: %s", track.sourceURL.c_str());
+        if (downloader) {
+            NetworkDownloadMgr::getInstance().releaseDownloader(downloader);
+        }
+        queuedIndex_ = index;   // 别每次 poll 都重试，放完了 playNext 再试一次
+        return;
+    }
+
+    // 旧的还在淡出，下载器先留着
+    if (currentDownloader_) {
+        fadingDownloaders_.push_back(std::move(currentDownloader_));
+    }
+    currentDownloader_ = std::move(downloader);
+    currentIndex = index;
+}
+
+void AudioController::clearQueued() {
+    queuedSource_.reset();
+    if (queuedDownloader_) {
+        NetworkDownloadMgr::getInstance().releaseDownloader(queuedDownloader_);
+        queuedDownloader_.reset();
+    }
+    queuedIndex_ = -1;
+}
+
+std::unique_ptr<ImplAudioSource> AudioController::openTrack(const AudioTrack& track,
+    std::shared_ptr<NetworkDownloader>& downloader) {
+    switch (track.sourceType) {
+    case AudioSourceType::LocalFile:
+        return AudioSourceFactory::fromFile(track.sourceURL);
+    case AudioSourceType::NetworkStream: {
+        // 预取过的已经在下了，缓冲区里有数据，构造源不用再等连接
+        auto& mgr = NetworkDownloadMgr::getInstance();
+        downloader = mgr.takePrefetched(track.sourceURL);
+        if (!downloader) {
+            downloader = mgr.getDownloader(track.sourceURL);
+            downloader->start();
+        }
+        return AudioSourceFactory::fromMemory(downloader);
+    }
+    default:
+        LOG_ERROR("Unsupported source type for %s", track.sourceURL.c_str());
+        return nullptr;
+    }
+}
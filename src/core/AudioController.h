@@ -1,6 +1,9 @@
 #pragma once
-#include "PlayList.h"
-#include "AudioPlayer.h"
+#include <memory>
+#include <vector>
+#include "dataModel/AudioList.h"
+#include "player/AudioPlayer.h"
+#include "network/Network.h"
 //控制当前播放索引、播放模式、切歌等
 //不管理收藏 / 数据存储，只引用歌单 处理播放状态 + 当前歌单）
 //控制器可以暴露给 UI 做所有播放逻辑管理，比如
@@ -15,10 +18,50 @@ class AudioController {
     int currentIndex = -1;
 
 public:
+    static constexpr double DefaultPrefetchLeadSeconds = 20.0;  // 离结尾还剩这么多秒就开始拉下一首
+    static constexpr double DefaultPrefetchSeconds = 10.0;      // 下一首先拉这么多秒
+    static constexpr double GaplessLeadSeconds = 5.0;           // 离结尾还剩这么多秒就把下一首的源开好排上
+
+    ~AudioController();
+
     void setPlaylist(std::shared_ptr<AudioList> playlist);
-    void playAtIndex(int index);
+    bool playAtIndex(int index);
     void playNext();
     void playPrev();
     void toggleLike();
     const AudioTrack* getCurrentTrack() const;
-};
\ No newline at end of file
+    AudioPlayer& getPlayer() { return player; }
+
+    // 当前这首下载完了，或者离结尾不到 leadSeconds 秒，就先把下一首的前 prefetchSeconds 秒拉下来
+    void setPrefetch(double leadSeconds, double prefetchSeconds) {
+        prefetchLeadSeconds_ = leadSeconds;
+        prefetchSeconds_ = prefetchSeconds;
+    }
+    // 无缝播放：当前这首快放完时先把下一首开好交给播放器，放完直接接上（默认开）
+    void setGapless(bool enabled) { gapless_ = enabled; }
+    // 交叉淡入淡出：离结尾还剩 seconds 秒就开始放下一首，两首重叠着过渡；0 关掉（默认），开了就不走无缝
+    void setCrossfade(double seconds) { crossfadeSeconds_ = seconds; }
+    // UI 的定时器里调（几百毫秒一次就够）：看要不要开始预取、排下一首，播放器换过去了就跟着更新当前索引
+    void poll();
+
+private:
+    int nextIndex() const;
+    void prefetchTrack(int index);
+    void queueTrack(int index);
+    void crossfadeTrack(int index);
+    void clearQueued();
+    bool nearEnd(double seconds) const;
+    // 网络歌优先用预取好的下载器，拿到的下载器存到 downloader 里，切歌时要还给 Mgr
+    std::unique_ptr<ImplAudioSource> openTrack(const AudioTrack& track, std::shared_ptr<NetworkDownloader>& downloader);
+
+    std::shared_ptr<NetworkDownloader> currentDownloader_;  // 本地歌为空
+    int prefetchedIndex_ = -1;      // 已经预取过的下一首，一首只预取一次
+    bool gapless_ = true;
+    int queuedIndex_ = -1;          // 已经开好源的下一首，一首只开一次
+    std::shared_ptr<NetworkDownloader> queuedDownloader_;
+    std::unique_ptr<ImplAudioSource> queuedSource_;     // 格式和设备不一样排不进播放器的，放完了再 setSource
+    double crossfadeSeconds_ = 0;
+    std::vector<std::shared_ptr<NetworkDownloader>> fadingDownloaders_;    // 正在淡出的歌还在读，淡完才能还
+    double prefetchLeadSeconds_ = DefaultPrefetchLeadSeconds;
+    double prefetchSeconds_ = DefaultPrefetchSeconds;
+};
@@ -0,0 +1,121 @@
+#include "AudioLibrary.h"
+#include <algorithm>
+
+const AudioLibrary::Playlist* AudioLibrary::findList(const std::string& listName) const {
+    auto it = listIndex_.find(listName);
+    return it == listIndex_.end() ? nullptr : &lists_[it->second];
+}
+
+AudioLibrary::Playlist* AudioLibrary::findList(const std::string& listName) {
+    auto it = listIndex_.find(listName);
+    return it == listIndex_.end() ? nullptr : &lists_[it->second];
+}
+
+AudioLibrary::Playlist& AudioLibrary::listFor(const std::string& listName) {
+    auto [it, inserted] = listIndex_.try_emplace(listName, lists_.size());
+    if (inserted) {
+        lists_.push_back({ listName, {}, {} });
+    }
+    return lists_[it->second];
+}
+
+bool AudioLibrary::addTrackToList(const AudioTrack& track, const std::string& listName) {
+    return addTrackToList(table_.add(track), listName);
+}
+
+bool AudioLibrary::addTrackToList(TrackHandle h, const std::string& listName) {
+    if (h >= table_.size()) return false;
+    Playlist& list = listFor(listName);
+    if (!list.mark(h)) return false;
+    list.tracks.push_back(h);
+    return true;
+}
+
+bool AudioLibrary::createList(const std::string& listName) {
+    if (listIndex_.count(listName)) return false;
+    listFor(listName);
+    return true;
+}
+
+void AudioLibrary::setList(const std::string& listName, const std::vector<TrackHandle>& tracks) {
+    Playlist& list = listFor(listName);
+    list.tracks.clear();
+    list.members.assign(table_.size(), false);
+    list.tracks.reserve(tracks.size());
+    for (TrackHandle h : tracks) {
+        if (h < table_.size() && list.mark(h)) list.tracks.push_back(h);
+    }
+}
+
+bool AudioLibrary::removeTrackFromList(const std::string& trackId, const std::string& listName) {
+    Playlist* list = findList(listName);
+    const TrackHandle h = table_.find(trackId);
+    if (!list || !list->contains(h)) return false;
+    list->members[h] = false;
+    // 不在歌单里的位图先挡掉了；剩下的删除本来就要挪后面的，找位置顺手扫一遍整数比搬的还便宜
+    list->tracks.erase(std::find(list->tracks.begin(), list->tracks.end(), h));
+    return true;
+}
+
+bool AudioLibrary::renameList(const std::string& oldName, const std::string& newName) {
+    auto it = listIndex_.find(oldName);
+    if (it == listIndex_.end() || listIndex_.count(newName)) return false;
+    const size_t pos = it->second;
+    listIndex_.erase(it);
+    listIndex_.emplace(newName, pos);
+    lists_[pos].name = newName;
+    return true;
+}
+
+bool AudioLibrary::deleteList(const std::string& listName) {
+    auto it = listIndex_.find(listName);
+    if (it == listIndex_.end()) return false;
+    const size_t pos = it->second;
+    listIndex_.erase(it);
+    lists_.erase(lists_.begin() + pos);
+    // 后面的往前挪了一格
+    for (auto& entry : listIndex_) {
+        if (entry.second > pos) --entry.second;
+    }
+    return true;
+}
+
+bool AudioLibrary::likeTrack(const std::string& trackId, bool liked) {
+    const TrackHandle h = table_.find(trackId);
+    if (h == InvalidTrack) return false;
+    table_.setLiked(h, liked);
+    return true;
+}
+
+void AudioLibrary::importList(const AudioList& list) {
+    const auto& tracks = list.tracks();
+    // 不够了才扩，而且至少翻倍；每次只留刚好的量，连着导几个歌单就是每次都整表搬一遍
+    const size_t want = table_.size() + tracks.size();
+    if (want > table_.capacity()) {
+        table_.reserve(std::max(want, table_.capacity() * 2));
+    }
+    Playlist& target = listFor(list.name());
+    target.tracks.clear();
+    target.members.assign(table_.size() + tracks.size(), false);
+    target.tracks.reserve(tracks.size());
+    // AudioList 里 trackId 已经是唯一的，不用再查重
+    for (const auto& t : tracks) {
+        const TrackHandle h = table_.add(t);
+        if (h == InvalidTrack) continue;
+        target.mark(h);
+        target.tracks.push_back(h);
+    }
+}
+
+std::shared_ptr<AudioList> AudioLibrary::toAudioList(const std::string& listName) const {
+    const Playlist* list = findList(listName);
+    if (!list) return nullptr;
+    auto out = std::make_shared<AudioList>(list->name);
+    std::vector<AudioTrack> tracks;
+    tracks.reserve(list->tracks.size());
+    for (TrackHandle h : list->tracks) {
+        tracks.push_back(table_.get(h));
+    }
+    out->addTracks(std::move(tracks));
+    return out;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "AudioList.h"
+#include "TrackTable.h"
+
+// 整个曲库：所有歌只在 TrackTable 里存一份，歌单里只放编号
+// 同一首歌在几个歌单里也只占一行，收藏状态改一处就都变了
+// 播放器那边要的还是 AudioList，用 toAudioList 现拼一个
+class AudioLibrary {
+public:
+    // 库里一个歌单：编号的顺序就是播放顺序
+    struct Playlist {
+        std::string name;
+        std::vector<TrackHandle> tracks;
+        std::vector<bool> members;      // 按编号的位图，查重用，和 tracks 同步；一首歌一位，只长到用到的最大编号
+
+        bool contains(TrackHandle h) const { return h < members.size() && members[h]; }
+        // 记进位图，已经有了返回 false；tracks 由调用方自己放
+        bool mark(TrackHandle h) {
+            if (h >= members.size()) members.resize(static_cast<size_t>(h) + 1, false);
+            if (members[h]) return false;
+            members[h] = true;
+            return true;
+        }
+    };
+
+    TrackTable& table() { return table_; }
+    const TrackTable& table() const { return table_; }
+    const std::vector<Playlist>& playlists() const { return lists_; }
+    const Playlist* findList(const std::string& listName) const;
+
+    // 歌进库（已有的更新），不放进任何歌单；表满了返回 InvalidTrack
+    TrackHandle addTrack(const AudioTrack& track) { return table_.add(track); }
+    TrackHandle findTrackById(const std::string& id) const { return table_.find(id); }
+
+    // 歌单不存在就建一个；已经在这个歌单里了返回 false
+    bool addTrackToList(const AudioTrack& track, const std::string& listName);
+    bool addTrackToList(TrackHandle h, const std::string& listName);
+    // 建一个空歌单，已经有了返回 false
+    bool createList(const std::string& listName);
+    // 整个换掉歌单的内容，重复的只留第一次出现的；歌单不存在就建
+    void setList(const std::string& listName, const std::vector<TrackHandle>& tracks);
+    bool removeTrackFromList(const std::string& trackId, const std::string& listName);
+    bool renameList(const std::string& oldName, const std::string& newName);
+    bool deleteList(const std::string& listName);
+    // 找不到返回 false
+    bool likeTrack(const std::string& trackId, bool liked = true);
+
+    // 整个 AudioList 导进来（同名的覆盖），导入大歌单先把表的空间留够
+    void importList(const AudioList& list);
+    // 拼成播放器用的 AudioList，没有这个歌单返回空
+    std::shared_ptr<AudioList> toAudioList(const std::string& listName) const;
+
+private:
+    Playlist* findList(const std::string& listName);
+    Playlist& listFor(const std::string& listName);     // 没有就建
+
+    TrackTable table_;
+    std::vector<Playlist> lists_;
+    std::unordered_map<std::string, size_t> listIndex_;     // 歌单名 -> lists_ 下标
+};
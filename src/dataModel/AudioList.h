@@ -1,7 +1,13 @@
 #pragma once
 #include <string>
 #include <vector>
-#include "AudioSourceType.h"
+#include <memory>
+#include <optional>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <unordered_map>
+#include "source/AudioSourceType.h"
 
 //一首歌的元信息
 struct AudioMeta {
@@ -9,8 +15,8 @@ struct AudioMeta {
     std::string artist;     // 艺术家
     std::string album;      // 专辑
     std::string coverURL; // 图片的哈希文件名
-    double duration;        // 时长
-    size_t size;
+    double duration = 0;    // 时长
+    size_t size = 0;
 };
 // 一首歌的元信息 + 播放源
 struct AudioTrack {
@@ -21,48 +27,185 @@ struct AudioTrack {
     bool liked = false;
 };
 
-// 歌单组织
-struct AudioList {
-    std::string name;
-    std::vector<AudioTrack> tracks;
-};
-
+// 有序的歌单，trackId 唯一
+// 顺序存在 tracks_ 里，另外挂一个 trackId -> 下标的哈希索引，查重、查找、删除都不用扫一遍
+// 删除只打个墓碑（记下槽位），墓碑攒到总数的 1/4 才在 removeTrackById 里一次性压实，摊下来每次删除是常数
+// 读的一侧（tracks()、indexOf()）不动内部表示，拿到的视图自己跳过墓碑；按位置取、查下标都是在墓碑里二分
 class AudioList {
 public:
+    // tracks() 返回的只读视图，按顺序只看活着的歌；下次增删之前有效
+    class TrackView {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = AudioTrack;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const AudioTrack*;
+            using reference = const AudioTrack&;
+
+            reference operator*() const { return list_->tracks_[slot_]; }
+            pointer operator->() const { return &list_->tracks_[slot_]; }
+            iterator& operator++() {
+                ++slot_;
+                skip();
+                return *this;
+            }
+            iterator operator++(int) {
+                iterator old = *this;
+                ++*this;
+                return old;
+            }
+            bool operator==(const iterator& other) const { return slot_ == other.slot_; }
+            bool operator!=(const iterator& other) const { return slot_ != other.slot_; }
+
+        private:
+            friend class TrackView;
+            iterator(const AudioList* list, size_t slot) : list_(list), slot_(slot) { skip(); }
+            // dead_ 是排好序的，跟着往后走就行
+            void skip() {
+                const auto& dead = list_->dead_;
+                while (nextDead_ < dead.size() && dead[nextDead_] < slot_) ++nextDead_;
+                while (nextDead_ < dead.size() && dead[nextDead_] == slot_) {
+                    ++slot_;
+                    ++nextDead_;
+                }
+            }
+            const AudioList* list_;
+            size_t slot_;
+            size_t nextDead_ = 0;
+        };
+
+        iterator begin() const { return iterator(list_, 0); }
+        iterator end() const { return iterator(list_, list_->tracks_.size()); }
+        size_t size() const { return list_->index_.size(); }
+        bool empty() const { return size() == 0; }
+        // 第 i 首活着的
+        const AudioTrack& operator[](size_t i) const { return list_->tracks_[list_->slotOf(i)]; }
+        const AudioTrack& front() const { return (*this)[0]; }
+        const AudioTrack& back() const { return (*this)[size() - 1]; }
+
+    private:
+        friend class AudioList;
+        explicit TrackView(const AudioList* list) : list_(list) {}
+        const AudioList* list_;
+    };
+
     AudioList(const std::string& name) : name_(name) {}
     const std::string& name() const { return name_; }
     void rename(const std::string& newName) { name_ = newName; }
 
-    // 添加一个 AudioTrack
-    void addTrack(const AudioTrack& track) {
-        if (!hasTrack(track.trackId)) {
-            tracks_.push_back(track);
+    // 添加一个 AudioTrack，已经有了返回 false
+    bool addTrack(const AudioTrack& track) {
+        if (!index_.try_emplace(track.trackId, tracks_.size()).second) return false;
+        tracks_.push_back(track);
+        return true;
+    }
+    bool addTrack(AudioTrack&& track) {
+        if (!index_.try_emplace(track.trackId, tracks_.size()).second) return false;
+        tracks_.push_back(std::move(track));
+        return true;
+    }
+
+    // 批量添加，已经有的（包括这一批里重复的）跳过，返回实际加了几首；导入大歌单用这个，先一次把空间留够
+    template <typename It>
+    size_t addTracks(It first, It last) {
+        const size_t hint = static_cast<size_t>(std::distance(first, last));
+        tracks_.reserve(tracks_.size() + hint);
+        index_.reserve(index_.size() + hint);
+        size_t added = 0;
+        for (; first != last; ++first) {
+            added += addTrack(*first) ? 1 : 0;
         }
+        return added;
+    }
+    size_t addTracks(std::vector<AudioTrack> tracks) {
+        return addTracks(std::make_move_iterator(tracks.begin()), std::make_move_iterator(tracks.end()));
     }
 
     // 移除一个 AudioTrack
     bool removeTrackById(const std::string& trackId) {
-        auto it = std::remove_if(tracks_.begin(), tracks_.end(),
-            [&](const AudioTrack& t) { return t.trackId == trackId; });
-        if (it != tracks_.end()) {
-            tracks_.erase(it, tracks_.end());
-            return true;
+        auto it = index_.find(trackId);
+        if (it == index_.end()) return false;
+        const size_t slot = it->second;
+        index_.erase(it);
+        dead_.insert(std::upper_bound(dead_.begin(), dead_.end(), slot), slot);
+        // 墓碑按比例攒够了再压，压一次 O(n) 摊到这 n/4 次删除上
+        if (dead_.size() >= std::max(CompactMinDead, tracks_.size() / 4)) {
+            compact();
         }
-        return false;
+        return true;
     }
 
-    // 获取只读访问
-    const std::vector<AudioTrack>& tracks() const { return tracks_; }
+    // 获取只读访问，跳过墓碑
+    TrackView tracks() const { return TrackView(this); }
+    size_t size() const { return index_.size(); }
+
+    // 在 tracks() 里的下标，没有返回 -1
+    int indexOf(const std::string& trackId) const {
+        auto it = index_.find(trackId);
+        if (it == index_.end()) return -1;
+        const size_t before = static_cast<size_t>(std::lower_bound(dead_.begin(), dead_.end(), it->second) - dead_.begin());
+        return static_cast<int>(it->second - before);
+    }
+
+    // 找不到返回 nullptr；指针在下次增删之前有效
+    const AudioTrack* findTrack(const std::string& trackId) const {
+        auto it = index_.find(trackId);
+        return it == index_.end() ? nullptr : &tracks_[it->second];
+    }
+
+    // 改收藏状态，找不到返回 false
+    bool setLiked(const std::string& trackId, bool liked) {
+        auto it = index_.find(trackId);
+        if (it == index_.end()) return false;
+        tracks_[it->second].liked = liked;
+        return true;
+    }
 
     // 判断是否包含某 trackId
     bool hasTrack(const std::string& trackId) const {
-        return std::any_of(tracks_.begin(), tracks_.end(),
-            [&](const AudioTrack& t) { return t.trackId == trackId; });
+        return index_.count(trackId) != 0;
     }
 
 private:
+    static constexpr size_t CompactMinDead = 64;
+
+    // 第 i 首活着的在 tracks_ 里的槽位：i 加上它前面的墓碑数
+    // 第 k 个墓碑前面活着的有 dead_[k] - k 首，这个数不减；不大于 i 的墓碑都在第 i 首前面，二分数出来
+    size_t slotOf(size_t i) const {
+        size_t lo = 0;
+        size_t hi = dead_.size();
+        while (lo < hi) {
+            const size_t mid = lo + (hi - lo) / 2;
+            if (dead_[mid] - mid <= i) lo = mid + 1;
+            else hi = mid;
+        }
+        return i + lo;
+    }
+
+    // 把墓碑挤掉，挪过位置的顺便改索引
+    void compact() {
+        if (dead_.empty()) return;
+        size_t out = dead_.front();
+        size_t next = 0;
+        for (size_t i = out; i < tracks_.size(); ++i) {
+            if (next < dead_.size() && dead_[next] == i) {
+                ++next;
+                continue;
+            }
+            tracks_[out] = std::move(tracks_[i]);
+            index_[tracks_[out].trackId] = out;
+            ++out;
+        }
+        tracks_.resize(out);
+        dead_.clear();
+    }
+
     std::string name_;
     std::vector<AudioTrack> tracks_;
+    std::vector<size_t> dead_;      // 墓碑的槽位，升序
+    std::unordered_map<std::string, size_t> index_;    // 只有活着的
 };
 
 
@@ -74,8 +217,6 @@ public:
     virtual bool saveAudioList(const AudioList&) = 0;
     virtual std::optional<AudioList> loadAudioList(const std::string& name) const = 0;
     virtual bool deleteAudioList(const std::string& name) = 0;
-private:
-    AudioList list;
 };
 
 class AudioListSyncService {
@@ -122,18 +263,3 @@ private:
     std::shared_ptr<ImplAudioListService> local_;
     std::shared_ptr<ImplAudioListService> cloud_; // 可选启用
 };
-
-
-
-class AudioLibrary {
-public:
-    const std::vector<AudioList>& getAllLists() const;
-    const AudioTrack* findTrackById(const std::string& id) const;
-
-    void addTrackToList(const AudioTrack& track, const std::string& listName);
-    void likeTrack(const std::string& trackId, bool liked = true);
-
-private:
-    std::vector<AudioList> lists_;
-    std::unordered_map<std::string, AudioTrack*> trackMap_;
-};
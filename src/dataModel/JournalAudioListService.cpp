@@ -0,0 +1,295 @@
+#include "JournalAudioListService.h"
+#include <unordered_set>
+#include "utils/Logger.h"
+
+namespace {
+
+using Record = LibraryJournal::Record;
+using Op = LibraryJournal::Op;
+
+// 除了收藏以外都一样
+bool sameMeta(const TrackTable& table, TrackHandle h, const AudioTrack& t) {
+    return table.title(h) == t.meta.title && table.artist(h) == t.meta.artist && table.album(h) == t.meta.album
+        && table.coverURL(h) == t.meta.coverURL && table.sourceURL(h) == t.sourceURL && table.sourceType(h) == t.sourceType
+        && static_cast<float>(table.duration(h)) == static_cast<float>(t.meta.duration) && table.fileSize(h) == t.meta.size;
+}
+
+Record makeRecord(Op op, const std::string& list, const std::string& arg = {}) {
+    Record r;
+    r.op = op;
+    r.list = list;
+    r.arg = arg;
+    return r;
+}
+
+} // namespace
+
+JournalAudioListService::JournalAudioListService(std::filesystem::path path)
+    : path_(std::move(path)) {
+    snapshot_ = LibrarySnapshot::open(path_);
+    std::filesystem::path journalPath = path_;
+    journalPath += ".journal";
+    // 快照之后的改动重放一遍；有的话库会被倒进内存
+    journalOk_ = journal_.open(journalPath, snapshot_ ? snapshot_->journalSequence() : 0, [this](const Record& r) { apply(r); });
+    if (!journalOk_) {
+        // 写不进日志的改动一律不收，内存里也不改，免得和磁盘上的对不上
+        LOG_ERROR("Library journal unavailable, edits will not be persisted: %s", journalPath.string().c_str());
+    }
+    compactWanted_ = journal_.pending() >= CompactRecords || journal_.bytes() >= CompactBytes;
+    compactor_ = std::thread(&JournalAudioListService::run, this);
+}
+
+JournalAudioListService::~JournalAudioListService() {
+    {
+        std::lock_guard lock(mutex_);
+        running_ = false;
+    }
+    wakeup_.notify_all();
+    if (compactor_.joinable()) {
+        compactor_.join();
+    }
+}
+
+std::vector<std::string> JournalAudioListService::listAudioLists() const {
+    std::lock_guard lock(mutex_);
+    std::vector<std::string> names;
+    if (library_) {
+        for (const auto& list : library_->playlists()) names.push_back(list.name);
+    }
+    else if (snapshot_) {
+        for (size_t i = 0; i < snapshot_->listCount(); ++i) names.emplace_back(snapshot_->listName(i));
+    }
+    return names;
+}
+
+std::optional<AudioList> JournalAudioListService::loadAudioList(const std::string& name) const {
+    std::lock_guard lock(mutex_);
+    std::shared_ptr<AudioList> list;
+    if (library_) {
+        list = library_->toAudioList(name);
+    }
+    else if (snapshot_) {
+        list = snapshot_->toAudioList(snapshot_->findList(name));
+    }
+    if (!list) return std::nullopt;
+    return std::move(*list);
+}
+
+bool JournalAudioListService::saveAudioList(const AudioList& list) {
+    std::lock_guard lock(mutex_);
+    if (!journalOk_) {
+        LOG_WARN("Library journal unavailable, save of \"%s\" dropped", list.name().c_str());
+        return false;
+    }
+    // findList 要用 const 的那个
+    const AudioLibrary& lib = library();
+    const TrackTable& table = lib.table();
+    const std::string& name = list.name();
+    const auto& tracks = list.tracks();
+    bool ok = true;
+
+    if (!lib.findList(name)) {
+        Record r = makeRecord(Op::CreateList, name);
+        ok &= commit(r);
+    }
+    // 建歌单那条没写进去，后面也没得比
+    const AudioLibrary::Playlist* target = lib.findList(name);
+    if (!target) return false;
+
+    // 不在新歌单里的删掉
+    std::unordered_set<std::string_view> wanted;
+    wanted.reserve(tracks.size());
+    for (const auto& t : tracks) wanted.insert(t.trackId);
+    std::vector<std::string> gone;
+    for (TrackHandle h : target->tracks) {
+        if (!wanted.count(table.trackId(h))) gone.emplace_back(table.trackId(h));
+    }
+    for (const auto& id : gone) {
+        Record r = makeRecord(Op::RemoveTrack, name, id);
+        ok &= commit(r);
+    }
+
+    // 新加的、信息变了的；只是收藏变了的记一条 LikeTrack 就够
+    // 这期间不增删歌单，target 一直有效
+    for (const auto& t : tracks) {
+        const TrackHandle h = table.find(t.trackId);
+        const bool member = h != InvalidTrack && target->contains(h);
+        if (member && sameMeta(table, h, t)) {
+            if (table.liked(h) == t.liked) continue;
+            Record r = makeRecord(Op::LikeTrack, name, t.trackId);
+            r.liked = t.liked;
+            ok &= commit(r);
+            continue;
+        }
+        Record r = makeRecord(Op::AddTrack, name);
+        r.track = t;
+        ok &= commit(r);
+    }
+
+    // 加歌都是接在后面的，和传进来的顺序不一样（中间插了歌、挪了位置）才整个记一次顺序
+    const auto& now = target->tracks;
+    bool sameOrder = now.size() == tracks.size();
+    for (size_t i = 0; sameOrder && i < now.size(); ++i) {
+        sameOrder = table.trackId(now[i]) == tracks[i].trackId;
+    }
+    if (!sameOrder) {
+        Record r = makeRecord(Op::SetOrder, name);
+        r.trackIds.reserve(tracks.size());
+        for (const auto& t : tracks) r.trackIds.push_back(t.trackId);
+        ok &= commit(r);
+    }
+    return ok;
+}
+
+bool JournalAudioListService::deleteAudioList(const std::string& name) {
+    std::lock_guard lock(mutex_);
+    Record r = makeRecord(Op::DeleteList, name);
+    return commit(r);
+}
+
+bool JournalAudioListService::addTrack(const std::string& listName, const AudioTrack& track) {
+    std::lock_guard lock(mutex_);
+    const AudioLibrary& lib = library();
+    const TrackHandle h = lib.findTrackById(track.trackId);
+    const auto* list = lib.findList(listName);
+    const bool member = h != InvalidTrack && list && list->contains(h);
+    if (member && sameMeta(lib.table(), h, track) && lib.table().liked(h) == track.liked) return false;
+    Record r = makeRecord(Op::AddTrack, listName);
+    r.track = track;
+    // 已经在歌单里的只是更新了信息
+    return commit(r) && !member;
+}
+
+bool JournalAudioListService::removeTrack(const std::string& listName, const std::string& trackId) {
+    std::lock_guard lock(mutex_);
+    Record r = makeRecord(Op::RemoveTrack, listName, trackId);
+    return commit(r);
+}
+
+bool JournalAudioListService::renameAudioList(const std::string& oldName, const std::string& newName) {
+    std::lock_guard lock(mutex_);
+    Record r = makeRecord(Op::RenameList, oldName, newName);
+    return commit(r);
+}
+
+bool JournalAudioListService::likeTrack(const std::string& trackId, bool liked) {
+    std::lock_guard lock(mutex_);
+    const TrackHandle h = library().findTrackById(trackId);
+    if (h == InvalidTrack || library_->table().liked(h) == liked) return false;
+    Record r = makeRecord(Op::LikeTrack, {}, trackId);
+    r.liked = liked;
+    return commit(r);
+}
+
+size_t JournalAudioListService::journalRecords() const {
+    std::lock_guard lock(mutex_);
+    return journal_.pending();
+}
+
+AudioLibrary& JournalAudioListService::library() {
+    if (!library_) {
+        library_ = std::make_unique<AudioLibrary>();
+        if (snapshot_) {
+            snapshot_->toLibrary(*library_);
+            // 之后都读内存里的；Windows 上映射着的文件也换不掉，压实要用
+            snapshot_.reset();
+        }
+    }
+    return *library_;
+}
+
+bool JournalAudioListService::apply(const Record& record) {
+    AudioLibrary& lib = library();
+    switch (record.op) {
+    case Op::CreateList:
+        return lib.createList(record.list);
+    case Op::AddTrack: {
+        const TrackHandle h = lib.addTrack(record.track);
+        // 表满了进不去，这条就不记了
+        if (h == InvalidTrack) return false;
+        // 已经在歌单里的也算改了，歌的信息更新了
+        lib.addTrackToList(h, record.list);
+        return true;
+    }
+    case Op::RemoveTrack:
+        return lib.removeTrackFromList(record.arg, record.list);
+    case Op::RenameList:
+        return lib.renameList(record.list, record.arg);
+    case Op::LikeTrack:
+        return lib.likeTrack(record.arg, record.liked);
+    case Op::DeleteList:
+        return lib.deleteList(record.list);
+    case Op::SetOrder: {
+        std::vector<TrackHandle> handles;
+        handles.reserve(record.trackIds.size());
+        for (const auto& id : record.trackIds) {
+            const TrackHandle h = lib.findTrackById(id);
+            if (h != InvalidTrack) handles.push_back(h);
+        }
+        lib.setList(record.list, handles);
+        return true;
+    }
+    }
+    return false;
+}
+
+bool JournalAudioListService::commit(Record& record) {
+    if (!journalOk_) {
+        LOG_WARN("Library journal unavailable, edit to \"%s\" dropped", record.list.c_str());
+        return false;
+    }
+    if (!apply(record)) return false;
+    if (!journal_.append(record)) {
+        // 内存里已经改了，下次压实成功的话还是会落盘
+        return false;
+    }
+    if (!compactWanted_ && (journal_.pending() >= CompactRecords || journal_.bytes() >= CompactBytes)) {
+        compactWanted_ = true;
+        wakeup_.notify_one();
+    }
+    return true;
+}
+
+bool JournalAudioListService::compact() {
+    std::lock_guard compactLock(compactMutex_);
+    if (!journalOk_) return false;
+    std::unique_ptr<AudioLibrary> copy;
+    uint64_t seq = 0;
+    uint64_t mark = 0;
+    {
+        std::lock_guard lock(mutex_);
+        compactWanted_ = false;
+        if (journal_.pending() == 0) return true;
+        if (!library_) {
+            // 一条都没回放：日志里全是快照里已经有的
+            return journal_.rewriteFrom(journal_.bytes());
+        }
+        // 拷一份再写，写快照的时候不挡着改动
+        copy = std::make_unique<AudioLibrary>(*library_);
+        seq = journal_.lastSeq();
+        mark = journal_.bytes();
+    }
+
+    // 快照里记着 seq：换上去之后、日志截短之前崩了，重放也会跳过这些
+    // write 成功时快照和目录都已经落盘了，之后才能截日志
+    if (!LibrarySnapshot::write(*copy, path_, seq)) {
+        LOG_ERROR("Library compaction failed: %s", path_.string().c_str());
+        return false;
+    }
+    std::lock_guard lock(mutex_);
+    const bool ok = journal_.rewriteFrom(mark);
+    // 压实期间的改动也会去喊；截完了按剩下的重新算，别白压一次
+    compactWanted_ = journal_.pending() >= CompactRecords || journal_.bytes() >= CompactBytes;
+    return ok;
+}
+
+void JournalAudioListService::run() {
+    std::unique_lock lock(mutex_);
+    while (running_) {
+        wakeup_.wait(lock, [this] { return !running_ || compactWanted_; });
+        if (!running_) break;
+        lock.unlock();
+        compact();
+        lock.lock();
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include <filesystem>
+#include "AudioList.h"
+#include "AudioLibrary.h"
+#include "LibraryJournal.h"
+#include "LibrarySnapshot.h"
+
+// 本地歌单：快照 + 追加日志
+// - 每次改动（加歌、删歌、改名、收藏）只往 <path>.journal 尾上追加一条，磁盘开销和歌单多大无关
+// - saveAudioList 拿到的是整个歌单，和库里现在的比一下，只把差的那几条写进日志；顺序变了才写一整条 SetOrder
+// - 日志攒多了，后台线程把当前的库写成新快照（LibrarySnapshot），再把日志里已经压进去的截掉
+// - 没有改动之前读歌单直接走 mmap 的快照，启动不用把整个库倒进内存
+class JournalAudioListService : public ImplAudioListService {
+public:
+    static constexpr size_t CompactRecords = 4096;
+    static constexpr uint64_t CompactBytes = 8ull * 1024 * 1024;
+
+    // path 是快照文件，日志放在旁边
+    explicit JournalAudioListService(std::filesystem::path path);
+    ~JournalAudioListService() override;
+
+    std::vector<std::string> listAudioLists() const override;
+    bool saveAudioList(const AudioList& list) override;
+    std::optional<AudioList> loadAudioList(const std::string& name) const override;
+    bool deleteAudioList(const std::string& name) override;
+
+    // 单条改动，每个都只追加一条记录；没变化的不写，返回 false
+    bool addTrack(const std::string& listName, const AudioTrack& track);
+    bool removeTrack(const std::string& listName, const std::string& trackId);
+    bool renameAudioList(const std::string& oldName, const std::string& newName);
+    bool likeTrack(const std::string& trackId, bool liked);
+
+    // 日志打不开的话改动都不会落盘，saveAudioList 等一律返回 false
+    bool ok() const { return journalOk_; }
+    // 在调用线程上马上压实一次（测试、退出前想把日志清掉的时候用）
+    bool compact();
+    size_t journalRecords() const;
+
+private:
+    AudioLibrary& library();
+    // 改内存里的库，回放日志也走这里，两边一定一致；返回有没有改到东西
+    bool apply(const LibraryJournal::Record& record);
+    // 先改内存再追加；没改到东西就不写
+    bool commit(LibraryJournal::Record& record);
+    void run();
+
+    mutable std::mutex mutex_;
+    const std::filesystem::path path_;
+    std::unique_ptr<LibrarySnapshot> snapshot_;     // 还没改过的时候读它
+    std::unique_ptr<AudioLibrary> library_;         // 第一次改的时候从快照倒出来
+    LibraryJournal journal_;
+    bool journalOk_ = false;                        // 构造完就不变了，不用锁
+
+    std::mutex compactMutex_;                       // 后台和 compact() 不要同时写快照
+    std::condition_variable wakeup_;
+    bool compactWanted_ = false;
+    bool running_ = true;
+    std::thread compactor_;
+};
@@ -0,0 +1,289 @@
+#include "LibraryJournal.h"
+#include <cstring>
+#include <iterator>
+#include "utils/FileSync.h"
+#include "utils/Logger.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char JournalMagic[8] = { 'M', 'T', 'P', 'J', 'N', 'L', '0', '1' };
+constexpr uint32_t MaxRecordBytes = 256 * 1024 * 1024;     // 再大就当是坏的
+
+uint64_t fnv1a(const uint8_t* data, size_t len) {
+    uint64_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+template <typename T>
+void put(std::vector<uint8_t>& out, T value) {
+    const auto* p = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+void putString(std::vector<uint8_t>& out, const std::string& s) {
+    put<uint32_t>(out, static_cast<uint32_t>(s.size()));
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+// 读到哪算到哪，越界就失败
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t len) : data_(data), len_(len) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (len_ - pos_ < sizeof(T)) return false;
+        std::memcpy(&value, data_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return true;
+    }
+    bool getString(std::string& s) {
+        uint32_t n = 0;
+        if (!get(n) || len_ - pos_ < n) return false;
+        s.assign(reinterpret_cast<const char*>(data_ + pos_), n);
+        pos_ += n;
+        return true;
+    }
+    bool done() const { return pos_ == len_; }
+
+private:
+    const uint8_t* data_;
+    size_t len_;
+    size_t pos_ = 0;
+};
+
+} // namespace
+
+std::vector<uint8_t> LibraryJournal::encode(const Record& record) {
+    std::vector<uint8_t> body;
+    put<uint8_t>(body, static_cast<uint8_t>(record.op));
+    put<uint64_t>(body, record.seq);
+    switch (record.op) {
+    case Op::CreateList:
+    case Op::DeleteList:
+        putString(body, record.list);
+        break;
+    case Op::AddTrack: {
+        const AudioTrack& t = record.track;
+        putString(body, record.list);
+        putString(body, t.trackId);
+        putString(body, t.sourceURL);
+        put<uint8_t>(body, static_cast<uint8_t>(t.sourceType));
+        put<uint8_t>(body, t.liked ? 1 : 0);
+        putString(body, t.meta.title);
+        putString(body, t.meta.artist);
+        putString(body, t.meta.album);
+        putString(body, t.meta.coverURL);
+        put<double>(body, t.meta.duration);
+        put<uint64_t>(body, t.meta.size);
+        break;
+    }
+    case Op::RemoveTrack:
+    case Op::RenameList:
+        putString(body, record.list);
+        putString(body, record.arg);
+        break;
+    case Op::LikeTrack:
+        putString(body, record.arg);
+        put<uint8_t>(body, record.liked ? 1 : 0);
+        break;
+    case Op::SetOrder:
+        putString(body, record.list);
+        put<uint32_t>(body, static_cast<uint32_t>(record.trackIds.size()));
+        for (const auto& id : record.trackIds) putString(body, id);
+        break;
+    }
+
+    std::vector<uint8_t> bytes;
+    bytes.reserve(body.size() + sizeof(uint32_t) + sizeof(uint64_t));
+    put<uint32_t>(bytes, static_cast<uint32_t>(body.size()));
+    bytes.insert(bytes.end(), body.begin(), body.end());
+    put<uint64_t>(bytes, fnv1a(body.data(), body.size()));
+    return bytes;
+}
+
+bool LibraryJournal::decode(const uint8_t* data, size_t len, Record& record) {
+    Reader in(data, len);
+    uint8_t op = 0;
+    if (!in.get(op) || !in.get(record.seq)) return false;
+    record.op = static_cast<Op>(op);
+    bool ok = false;
+    switch (record.op) {
+    case Op::CreateList:
+    case Op::DeleteList:
+        ok = in.getString(record.list);
+        break;
+    case Op::AddTrack: {
+        AudioTrack& t = record.track;
+        uint8_t type = 0, liked = 0;
+        uint64_t size = 0;
+        ok = in.getString(record.list) && in.getString(t.trackId) && in.getString(t.sourceURL)
+            && in.get(type) && in.get(liked) && in.getString(t.meta.title) && in.getString(t.meta.artist)
+            && in.getString(t.meta.album) && in.getString(t.meta.coverURL) && in.get(t.meta.duration) && in.get(size);
+        t.sourceType = static_cast<AudioSourceType>(type);
+        t.liked = liked != 0;
+        t.meta.size = static_cast<size_t>(size);
+        break;
+    }
+    case Op::RemoveTrack:
+    case Op::RenameList:
+        ok = in.getString(record.list) && in.getString(record.arg);
+        break;
+    case Op::LikeTrack: {
+        uint8_t liked = 0;
+        ok = in.getString(record.arg) && in.get(liked);
+        record.liked = liked != 0;
+        break;
+    }
+    case Op::SetOrder: {
+        uint32_t count = 0;
+        ok = in.getString(record.list) && in.get(count);
+        for (uint32_t i = 0; ok && i < count; ++i) {
+            record.trackIds.emplace_back();
+            ok = in.getString(record.trackIds.back());
+        }
+        break;
+    }
+    }
+    return ok && in.done();
+}
+
+bool LibraryJournal::open(const fs::path& path, uint64_t after, const std::function<void(const Record&)>& replay) {
+    path_ = path;
+    lastSeq_ = after;
+    pending_ = 0;
+    out_.close();
+
+    std::vector<uint8_t> bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (in) bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    if (bytes.size() < sizeof(JournalMagic) || std::memcmp(bytes.data(), JournalMagic, sizeof(JournalMagic)) != 0) {
+        bool ok = false;
+        if (!bytes.empty()) {
+            LOG_WARN("Library journal is not recognized, starting a new one: %s", path.string().c_str());
+        }
+        {
+            std::ofstream fresh(path, std::ios::binary | std::ios::trunc);
+            fresh.write(JournalMagic, sizeof(JournalMagic));
+            ok = static_cast<bool>(fresh);
+        }
+        if (!ok || !FileSync::syncFile(path) || !FileSync::syncDirectory(path.parent_path())) {
+            LOG_ERROR("Create library journal failed: %s", path.string().c_str());
+            return false;
+        }
+        bytes.assign(JournalMagic, JournalMagic + sizeof(JournalMagic));
+    }
+
+    size_t pos = sizeof(JournalMagic);
+    size_t replayed = 0;
+    while (pos < bytes.size()) {
+        uint32_t len = 0;
+        if (bytes.size() - pos < sizeof(len)) break;
+        std::memcpy(&len, bytes.data() + pos, sizeof(len));
+        if (len > MaxRecordBytes || bytes.size() - pos - sizeof(len) < static_cast<size_t>(len) + sizeof(uint64_t)) break;
+        const uint8_t* body = bytes.data() + pos + sizeof(len);
+        uint64_t checksum = 0;
+        std::memcpy(&checksum, body + len, sizeof(checksum));
+        Record record;
+        if (checksum != fnv1a(body, len) || !decode(body, len, record)) break;
+
+        pos += sizeof(len) + len + sizeof(checksum);
+        ++pending_;
+        if (record.seq <= after) continue;      // 已经压进快照了
+        lastSeq_ = record.seq;
+        replay(record);
+        ++replayed;
+    }
+    if (pos < bytes.size()) {
+        // 写到一半的尾巴，截掉，不然后面追加的都读不到
+        LOG_WARN("Library journal has a broken tail, dropping %zu bytes", bytes.size() - pos);
+        std::error_code ec;
+        fs::resize_file(path, pos, ec);
+    }
+    bytes_ = pos;
+    if (replayed) {
+        LOG_INFO("Library journal replayed %zu records", replayed);
+    }
+
+    out_.open(path, std::ios::binary | std::ios::app);
+    return static_cast<bool>(out_);
+}
+
+bool LibraryJournal::append(Record& record) {
+    if (!out_.is_open()) return false;
+    record.seq = lastSeq_ + 1;
+    const std::vector<uint8_t> bytes = encode(record);
+    out_.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    out_.flush();
+    if (!out_) {
+        LOG_ERROR("Library journal append failed: %s", path_.string().c_str());
+        out_.clear();
+        return false;
+    }
+    lastSeq_ = record.seq;
+    bytes_ += bytes.size();
+    ++pending_;
+    return true;
+}
+
+bool LibraryJournal::rewriteFrom(uint64_t offset) {
+    if (offset < sizeof(JournalMagic) || offset > bytes_) return false;
+    out_.close();
+
+    std::vector<char> tail(static_cast<size_t>(bytes_ - offset));
+    size_t records = 0;
+    {
+        std::ifstream in(path_, std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(offset));
+        in.read(tail.data(), static_cast<std::streamsize>(tail.size()));
+        if (!in && !tail.empty()) {
+            LOG_WARN("Library journal read failed: %s", path_.string().c_str());
+            out_.open(path_, std::ios::binary | std::ios::app);
+            return false;
+        }
+    }
+    // 数一下留下了几条，pending 要对得上
+    for (size_t pos = 0; pos + sizeof(uint32_t) <= tail.size(); ++records) {
+        uint32_t len = 0;
+        std::memcpy(&len, tail.data() + pos, sizeof(len));
+        pos += sizeof(len) + len + sizeof(uint64_t);
+    }
+
+    fs::path tmpPath = path_;
+    tmpPath += ".tmp";
+    bool ok = false;
+    {
+        std::ofstream tmp(tmpPath, std::ios::binary | std::ios::trunc);
+        tmp.write(JournalMagic, sizeof(JournalMagic));
+        tmp.write(tail.data(), static_cast<std::streamsize>(tail.size()));
+        ok = static_cast<bool>(tmp);
+    }
+    // 留下来的记录先落盘再换，换完把目录也同步了，不然断电后旧日志、新日志可能都不完整
+    ok = ok && FileSync::syncFile(tmpPath);
+    std::error_code ec;
+    if (ok) {
+        fs::rename(tmpPath, path_, ec);
+        ok = !ec;
+    }
+    if (ok && !FileSync::syncDirectory(path_.parent_path())) {
+        LOG_WARN("Library journal directory sync failed: %s", path_.string().c_str());
+    }
+    if (ok) {
+        bytes_ = sizeof(JournalMagic) + tail.size();
+        pending_ = records;
+    }
+    else {
+        LOG_WARN("Library journal rewrite failed: %s", path_.string().c_str());
+        fs::remove(tmpPath, ec);
+    }
+    out_.open(path_, std::ios::binary | std::ios::app);
+    return ok && static_cast<bool>(out_);
+}
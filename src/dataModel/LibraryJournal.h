@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <filesystem>
+#include <cstdint>
+#include "AudioList.h"
+
+// 歌单改动的追加日志：每次改一下只往文件尾追加一条记录，和歌单多大没关系
+// 文件：8 字节魔数 + 一条条记录；记录是 [uint32 长度][类型 + 序号 + 内容][uint64 fnv1a]
+// 序号一直往上涨，快照里记着压实到了哪个序号，重放时不大于它的跳过，所以快照换上去之后、日志还没截短就崩了也不会重复
+// 写坏的尾巴（写到一半断电）重放时会被截掉
+class LibraryJournal {
+public:
+    enum class Op : uint8_t {
+        CreateList = 1,     // list
+        AddTrack,           // list, track（歌进库或者更新，再放进歌单）
+        RemoveTrack,        // list, arg = trackId
+        RenameList,         // list, arg = 新名字
+        LikeTrack,          // arg = trackId, liked
+        DeleteList,         // list
+        SetOrder,           // list, trackIds：整个歌单换成这个顺序
+    };
+
+    struct Record {
+        Op op = Op::CreateList;
+        uint64_t seq = 0;
+        std::string list;
+        std::string arg;
+        AudioTrack track{};
+        bool liked = false;
+        std::vector<std::string> trackIds;
+    };
+
+    // 打开日志（没有就建一个），序号大于 after 的记录按顺序交给 replay
+    bool open(const std::filesystem::path& path, uint64_t after, const std::function<void(const Record&)>& replay);
+    // 发序号、追加、flush 给系统（不 fsync），失败返回 false
+    bool append(Record& record);
+
+    uint64_t lastSeq() const { return lastSeq_; }
+    // 文件现在的长度，压实开始时记一下，完了用 rewriteFrom 只留这之后的
+    uint64_t bytes() const { return bytes_; }
+    // 文件里现在有几条记录（包括已经压进快照、还没截掉的）
+    size_t pending() const { return pending_; }
+    // 只留 [offset, 文件尾) 的记录，写临时文件再换过去
+    bool rewriteFrom(uint64_t offset);
+
+private:
+    static std::vector<uint8_t> encode(const Record& record);
+    static bool decode(const uint8_t* data, size_t len, Record& record);
+
+    std::filesystem::path path_;
+    std::ofstream out_;
+    uint64_t lastSeq_ = 0;
+    uint64_t bytes_ = 0;
+    size_t pending_ = 0;
+};
@@ -0,0 +1,432 @@
+#include "LibrarySnapshot.h"
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include "AudioLibrary.h"
+#include "utils/StringInterner.h"
+#include "utils/FileSync.h"
+#include "utils/Logger.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char SnapshotMagic[8] = { 'M', 'T', 'P', 'L', 'I', 'B', '0', '1' };
+constexpr uint32_t ByteOrderMark = 0x01020304;
+constexpr uint32_t EmptySlot = UINT32_MAX;
+
+enum Section : uint32_t {
+    Text,           // 所有文本首尾相接
+    Strings,        // 字符串池：Ref[stringCount]，0 号是空串
+    Ids,            // 下面是按列存的歌，每列 trackCount 个
+    Titles,
+    Sources,
+    Artists,
+    Albums,
+    Covers,
+    Durations,
+    Sizes,
+    Types,
+    Liked,
+    IdIndex,        // uint32[indexSlots]，trackId 的 fnv1a 线性探测，空位是 UINT32_MAX
+    Lists,          // ListRecord[listCount]
+    ListTracks,     // 所有歌单的行号接在一起
+    Journal,        // uint64：已经压进来的日志序号；可选，老文件没有
+    SectionCount
+};
+constexpr uint32_t RequiredSections = Journal;
+
+struct SectionEntry {
+    uint64_t offset;    // 相对文件头
+    uint64_t size;
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileSize;
+    uint32_t trackCount;
+    uint32_t stringCount;
+    uint32_t listCount;
+    uint32_t indexSlots;
+    uint32_t sectionCount;
+    uint32_t reserved;
+    uint64_t bodyChecksum;  // 节目录后面到文件尾
+};
+static_assert(sizeof(Header) % 8 == 0, "sections must stay 8-byte aligned");
+
+constexpr uint64_t FnvOffset = 1469598103934665603ull;
+
+uint64_t fnv1a(const uint8_t* data, size_t len, uint64_t hash = FnvOffset) {
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t hashId(std::string_view id) {
+    return fnv1a(reinterpret_cast<const uint8_t*>(id.data()), id.size());
+}
+
+// 边写边算校验和，记着写到哪了
+class SnapshotWriter {
+public:
+    SnapshotWriter(std::ofstream& out, uint64_t start) : out_(out), pos_(start) {}
+
+    void write(const void* data, size_t len) {
+        out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(len));
+        hash_ = fnv1a(static_cast<const uint8_t*>(data), len, hash_);
+        pos_ += len;
+    }
+    template <typename T>
+    void write(const std::vector<T>& values) { write(values.data(), values.size() * sizeof(T)); }
+
+    void begin(SectionEntry& entry) {
+        static const char zeros[8] = {};
+        write(zeros, (8 - pos_ % 8) % 8);
+        entry.offset = pos_;
+    }
+    void end(SectionEntry& entry) { entry.size = pos_ - entry.offset; }
+
+    uint64_t pos() const { return pos_; }
+    uint64_t hash() const { return hash_; }
+
+private:
+    std::ofstream& out_;
+    uint64_t pos_;
+    uint64_t hash_ = FnvOffset;
+};
+
+} // namespace
+
+bool LibrarySnapshot::write(const AudioLibrary& library, const fs::path& path, uint64_t journalSeq) {
+    const TrackTable& table = library.table();
+    const auto& playlists = library.playlists();
+    const auto& interner = StringInterner::global();
+    const auto trackCount = static_cast<uint32_t>(table.size());
+
+    // 表里用到的驻留编号换成快照自己的池编号，按字典序发，名次就是编号
+    std::vector<uint32_t> local(interner.size(), EmptySlot);
+    std::vector<StringInterner::Id> used{ StringInterner::Empty };
+    local[StringInterner::Empty] = 0;
+    auto mark = [&](StringInterner::Id id) {
+        if (local[id] == EmptySlot) {
+            local[id] = 0;
+            used.push_back(id);
+        }
+    };
+    for (TrackHandle h = 0; h < trackCount; ++h) {
+        mark(table.artistId(h));
+        mark(table.albumId(h));
+        mark(table.coverId(h));
+    }
+    std::sort(used.begin(), used.end(), [&](StringInterner::Id a, StringInterner::Id b) {
+        return interner.view(a) < interner.view(b);
+        });
+    for (uint32_t i = 0; i < used.size(); ++i) {
+        local[used[i]] = i;
+    }
+
+    fs::path tmpPath = path;
+    tmpPath += ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        LOG_WARN("Library snapshot open failed: %s", tmpPath.string().c_str());
+        return false;
+    }
+
+    Header header{};
+    std::memcpy(header.magic, SnapshotMagic, sizeof(SnapshotMagic));
+    header.version = Version;
+    header.byteOrder = ByteOrderMark;
+    header.trackCount = trackCount;
+    header.stringCount = static_cast<uint32_t>(used.size());
+    header.listCount = static_cast<uint32_t>(playlists.size());
+    header.sectionCount = SectionCount;
+    SectionEntry sections[SectionCount] = {};
+    // 先占位，最后知道各节在哪了再回来写
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(sections), sizeof(sections));
+    SnapshotWriter writer(out, sizeof(header) + sizeof(sections));
+
+    // 文本：池、歌单名、每首歌的三段；旧版本留在 TrackTable 里的文本不带过来
+    bool overflow = false;
+    writer.begin(sections[Text]);
+    auto putText = [&](std::string_view s) {
+        const uint64_t offset = writer.pos() - sections[Text].offset;
+        if (offset + s.size() > UINT32_MAX) {
+            overflow = true;
+            return Ref{};
+        }
+        writer.write(s.data(), s.size());
+        return Ref{ static_cast<uint32_t>(offset), static_cast<uint32_t>(s.size()) };
+    };
+    std::vector<Ref> strings;
+    strings.reserve(used.size());
+    for (StringInterner::Id id : used) strings.push_back(putText(interner.view(id)));
+    std::vector<ListRecord> lists;
+    std::vector<uint32_t> listTracks;
+    for (const auto& list : playlists) {
+        lists.push_back({ putText(list.name), static_cast<uint32_t>(listTracks.size()), static_cast<uint32_t>(list.tracks.size()) });
+        listTracks.insert(listTracks.end(), list.tracks.begin(), list.tracks.end());
+    }
+    std::vector<Ref> ids(trackCount), titles(trackCount), sources(trackCount);
+    for (TrackHandle h = 0; h < trackCount; ++h) {
+        ids[h] = putText(table.trackId(h));
+        titles[h] = putText(table.title(h));
+        sources[h] = putText(table.sourceURL(h));
+    }
+    writer.end(sections[Text]);
+    if (overflow) {
+        LOG_ERROR("Library snapshot text exceeds 4GB");
+        out.close();
+        std::error_code ec;
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+
+    auto putSection = [&](Section section, const auto& values) {
+        writer.begin(sections[section]);
+        writer.write(values);
+        writer.end(sections[section]);
+    };
+    putSection(Strings, strings);
+    putSection(Ids, ids);
+    putSection(Titles, titles);
+    putSection(Sources, sources);
+    {
+        std::vector<uint32_t> column(trackCount);
+        for (TrackHandle h = 0; h < trackCount; ++h) column[h] = local[table.artistId(h)];
+        putSection(Artists, column);
+        for (TrackHandle h = 0; h < trackCount; ++h) column[h] = local[table.albumId(h)];
+        putSection(Albums, column);
+        for (TrackHandle h = 0; h < trackCount; ++h) column[h] = local[table.coverId(h)];
+        putSection(Covers, column);
+    }
+    {
+        std::vector<float> durations(trackCount);
+        std::vector<uint64_t> sizes(trackCount);
+        std::vector<uint8_t> types(trackCount), liked(trackCount);
+        for (TrackHandle h = 0; h < trackCount; ++h) {
+            durations[h] = static_cast<float>(table.duration(h));
+            sizes[h] = table.fileSize(h);
+            types[h] = static_cast<uint8_t>(table.sourceType(h));
+            liked[h] = table.liked(h) ? 1 : 0;
+        }
+        putSection(Durations, durations);
+        putSection(Sizes, sizes);
+        putSection(Types, types);
+        putSection(Liked, liked);
+    }
+    {
+        // 负载不超过 1/2
+        uint32_t slots = 16;
+        while (slots < trackCount * 2ull) slots *= 2;
+        std::vector<uint32_t> index(slots, EmptySlot);
+        for (TrackHandle h = 0; h < trackCount; ++h) {
+            size_t i = hashId(table.trackId(h)) & (slots - 1);
+            while (index[i] != EmptySlot) i = (i + 1) & (slots - 1);
+            index[i] = h;
+        }
+        header.indexSlots = slots;
+        putSection(IdIndex, index);
+    }
+    putSection(Lists, lists);
+    putSection(ListTracks, listTracks);
+    putSection(Journal, std::vector<uint64_t>{ journalSeq });
+
+    header.fileSize = writer.pos();
+    header.bodyChecksum = writer.hash();
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(sections), sizeof(sections));
+    out.close();
+    // 换上去之前先落盘，不然断电后可能是个改了名的空文件；压实完日志还要截短，这里必须是真写进去了
+    if (!out || !FileSync::syncFile(tmpPath)) {
+        LOG_WARN("Library snapshot write failed: %s", tmpPath.string().c_str());
+        std::error_code ec;
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    if (ec) {
+        LOG_WARN("Library snapshot rename failed: %s, %s", path.string().c_str(), ec.message().c_str());
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+    // rename 记在目录里，目录没落盘的话重启后看到的可能还是旧快照
+    if (!FileSync::syncDirectory(path.parent_path())) {
+        LOG_WARN("Library snapshot directory sync failed: %s", path.string().c_str());
+        return false;
+    }
+    LOG_INFO("Library snapshot written: %u tracks, %zu lists, %llu bytes", trackCount, playlists.size(),
+        static_cast<unsigned long long>(header.fileSize));
+    return true;
+}
+
+std::unique_ptr<LibrarySnapshot> LibrarySnapshot::open(const fs::path& path) {
+    std::unique_ptr<LibrarySnapshot> snap(new LibrarySnapshot());
+    if (!snap->file_.open(path)) return nullptr;
+    const uint8_t* base = snap->file_.data();
+    const size_t fileSize = snap->file_.size();
+
+    Header header{};
+    if (fileSize < sizeof(header)) return nullptr;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0) {
+        LOG_WARN("Not a library snapshot: %s", path.string().c_str());
+        return nullptr;
+    }
+    if (header.version != Version || header.byteOrder != ByteOrderMark) {
+        LOG_WARN("Library snapshot version/byte order not supported: %s, version %u", path.string().c_str(), header.version);
+        return nullptr;
+    }
+    const uint64_t bodyOffset = sizeof(header) + static_cast<uint64_t>(header.sectionCount) * sizeof(SectionEntry);
+    if (header.fileSize != fileSize || header.sectionCount < RequiredSections || bodyOffset > fileSize
+        || header.indexSlots == 0 || (header.indexSlots & (header.indexSlots - 1)) != 0 || header.indexSlots <= header.trackCount) {
+        LOG_WARN("Library snapshot header is broken: %s", path.string().c_str());
+        return nullptr;
+    }
+    const auto* sections = reinterpret_cast<const SectionEntry*>(base + sizeof(header));
+
+    // 节要在文件里、8 字节对齐、大小正好是 count 个元素
+    bool ok = true;
+    auto section = [&](Section id, size_t elemSize, uint64_t count) -> const uint8_t* {
+        const SectionEntry& s = sections[id];
+        if (s.offset < bodyOffset || s.offset % 8 != 0 || s.size > fileSize || s.offset > fileSize - s.size
+            || (count != UINT64_MAX && s.size != count * elemSize) || s.size % elemSize != 0) {
+            ok = false;
+            return nullptr;
+        }
+        return base + s.offset;
+    };
+    const uint64_t n = header.trackCount;
+    LibrarySnapshot& s = *snap;
+    s.text_ = reinterpret_cast<const char*>(section(Text, 1, UINT64_MAX));
+    s.strings_ = reinterpret_cast<const Ref*>(section(Strings, sizeof(Ref), header.stringCount));
+    s.ids_ = reinterpret_cast<const Ref*>(section(Ids, sizeof(Ref), n));
+    s.titles_ = reinterpret_cast<const Ref*>(section(Titles, sizeof(Ref), n));
+    s.sources_ = reinterpret_cast<const Ref*>(section(Sources, sizeof(Ref), n));
+    s.artists_ = reinterpret_cast<const uint32_t*>(section(Artists, sizeof(uint32_t), n));
+    s.albums_ = reinterpret_cast<const uint32_t*>(section(Albums, sizeof(uint32_t), n));
+    s.covers_ = reinterpret_cast<const uint32_t*>(section(Covers, sizeof(uint32_t), n));
+    s.durations_ = reinterpret_cast<const float*>(section(Durations, sizeof(float), n));
+    s.sizes_ = reinterpret_cast<const uint64_t*>(section(Sizes, sizeof(uint64_t), n));
+    s.types_ = section(Types, 1, n);
+    s.liked_ = section(Liked, 1, n);
+    s.index_ = reinterpret_cast<const uint32_t*>(section(IdIndex, sizeof(uint32_t), header.indexSlots));
+    s.lists_ = reinterpret_cast<const ListRecord*>(section(Lists, sizeof(ListRecord), header.listCount));
+    s.listTracks_ = reinterpret_cast<const uint32_t*>(section(ListTracks, sizeof(uint32_t), UINT64_MAX));
+    if (header.sectionCount > Journal) {
+        if (const uint8_t* seq = section(Journal, sizeof(uint64_t), 1)) std::memcpy(&s.journalSeq_, seq, sizeof(uint64_t));
+    }
+    if (!ok || header.stringCount == 0) {
+        LOG_WARN("Library snapshot sections are broken: %s", path.string().c_str());
+        return nullptr;
+    }
+
+    s.trackCount_ = header.trackCount;
+    s.stringCount_ = header.stringCount;
+    s.listCount_ = header.listCount;
+    s.indexSlots_ = header.indexSlots;
+    s.textBytes_ = sections[Text].size;
+    s.listTrackCount_ = sections[ListTracks].size / sizeof(uint32_t);
+    s.bodyOffset_ = bodyOffset;
+    s.checksum_ = header.bodyChecksum;
+    return snap;
+}
+
+bool LibrarySnapshot::verify() const {
+    if (fnv1a(file_.data() + bodyOffset_, file_.size() - bodyOffset_) != checksum_) return false;
+
+    auto refOk = [this](Ref r) { return static_cast<uint64_t>(r.offset) + r.length <= textBytes_; };
+    for (uint32_t i = 0; i < stringCount_; ++i) {
+        if (!refOk(strings_[i])) return false;
+    }
+    for (uint32_t h = 0; h < trackCount_; ++h) {
+        if (!refOk(ids_[h]) || !refOk(titles_[h]) || !refOk(sources_[h])
+            || artists_[h] >= stringCount_ || albums_[h] >= stringCount_ || covers_[h] >= stringCount_) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < indexSlots_; ++i) {
+        if (index_[i] != EmptySlot && index_[i] >= trackCount_) return false;
+    }
+    for (uint32_t i = 0; i < listCount_; ++i) {
+        const ListRecord& list = lists_[i];
+        if (!refOk(list.name) || static_cast<uint64_t>(list.first) + list.count > listTrackCount_) return false;
+    }
+    for (uint64_t i = 0; i < listTrackCount_; ++i) {
+        if (listTracks_[i] >= trackCount_) return false;
+    }
+    return true;
+}
+
+TrackHandle LibrarySnapshot::find(std::string_view trackId) const {
+    const uint32_t mask = indexSlots_ - 1;
+    uint32_t i = static_cast<uint32_t>(hashId(trackId)) & mask;
+    // 探测次数封顶，文件坏了也不会死循环
+    for (uint32_t probes = 0; probes < indexSlots_; ++probes, i = (i + 1) & mask) {
+        const uint32_t h = index_[i];
+        if (h == EmptySlot) break;
+        if (h < trackCount_ && this->trackId(h) == trackId) return h;
+    }
+    return InvalidTrack;
+}
+
+AudioTrack LibrarySnapshot::get(TrackHandle h) const {
+    AudioTrack t;
+    t.trackId = trackId(h);
+    t.sourceURL = sourceURL(h);
+    t.sourceType = sourceType(h);
+    t.liked = liked(h);
+    t.meta.title = title(h);
+    t.meta.artist = artist(h);
+    t.meta.album = album(h);
+    t.meta.coverURL = coverURL(h);
+    t.meta.duration = duration(h);
+    t.meta.size = static_cast<size_t>(fileSize(h));
+    return t;
+}
+
+size_t LibrarySnapshot::findList(std::string_view name) const {
+    // 歌单就那么几个，扫一遍就行
+    for (size_t i = 0; i < listCount_; ++i) {
+        if (listName(i) == name) return i;
+    }
+    return NoList;
+}
+
+std::shared_ptr<AudioList> LibrarySnapshot::toAudioList(size_t list) const {
+    if (list >= listCount_) return nullptr;
+    auto out = std::make_shared<AudioList>(std::string(listName(list)));
+    std::vector<AudioTrack> tracks;
+    const ListView rows = listTracks(list);
+    tracks.reserve(rows.size);
+    for (uint32_t h : rows) {
+        tracks.push_back(get(h));
+    }
+    out->addTracks(std::move(tracks));
+    return out;
+}
+
+void LibrarySnapshot::toLibrary(AudioLibrary& library) const {
+    // 库里原来有歌的话行号对不上，记一下快照行号 -> 库里的编号
+    library.table().reserve(library.table().size() + trackCount_);
+    std::vector<TrackHandle> handles(trackCount_);
+    for (TrackHandle h = 0; h < trackCount_; ++h) {
+        handles[h] = library.addTrack(get(h));
+    }
+    for (size_t i = 0; i < listCount_; ++i) {
+        const std::string name(listName(i));
+        library.createList(name);
+        for (uint32_t h : listTracks(i)) {
+            library.addTrackToList(handles[h], name);
+        }
+    }
+}
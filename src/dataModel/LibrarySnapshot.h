@@ -0,0 +1,115 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <cstdint>
+#include "AudioList.h"
+#include "TrackTable.h"
+#include "utils/MappedFile.h"
+
+class AudioLibrary;
+
+// 整个曲库（歌的表、字符串池、歌单）的二进制快照，mmap 上来直接原地用，没有解析这一步
+// 文件布局：Header + 节目录 + 各节。节里的位置都是相对文件头 / 文本节开头的偏移，映射到哪个地址都能用
+// - 歌的表和 TrackTable 一样按列存，每列一节
+// - 歌手/专辑/封面存的是快照自己的字符串池编号，池按字典序排好，编号大小就是名次
+// - trackId -> 行号的开放寻址哈希表也在文件里，按 id 查歌不用先建索引
+// - 每节按 8 字节对齐；只认小端，和写它的机器一样的字节序
+// 版本：Version 变了就不认；同一个版本往后加节是兼容的，老的读者只看自己认识的那几节
+class LibrarySnapshot {
+public:
+    static constexpr uint32_t Version = 1;
+
+    // 文本节里的一段
+    struct Ref {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+    struct ListRecord {
+        Ref name;
+        uint32_t first = 0;     // 在 ListTracks 节里的起始下标
+        uint32_t count = 0;
+    };
+    // 一个歌单里的行号，指着映射的内存
+    struct ListView {
+        const uint32_t* data = nullptr;
+        size_t size = 0;
+        const uint32_t* begin() const { return data; }
+        const uint32_t* end() const { return data + size; }
+    };
+
+    static constexpr size_t NoList = SIZE_MAX;
+
+    // 写到 path.tmp 再换过去，写一半崩了旧的快照还在
+    // journalSeq 是这份快照已经包含了的日志序号（见 LibraryJournal），不用日志就是 0
+    static bool write(const AudioLibrary& library, const std::filesystem::path& path, uint64_t journalSeq = 0);
+    // 只做常数时间的结构检查（魔数、版本、各节大小对得上），不碰正文；没有或者不认返回 nullptr
+    static std::unique_ptr<LibrarySnapshot> open(const std::filesystem::path& path);
+
+    // 把正文从头到尾校验一遍（校验和、所有偏移都在范围里），要 O(文件大小)，怀疑文件坏了再调
+    bool verify() const;
+
+    size_t size() const { return trackCount_; }
+    std::string_view trackId(TrackHandle h) const { return text(ids_[h]); }
+    std::string_view title(TrackHandle h) const { return text(titles_[h]); }
+    std::string_view sourceURL(TrackHandle h) const { return text(sources_[h]); }
+    std::string_view artist(TrackHandle h) const { return string(artists_[h]); }
+    std::string_view album(TrackHandle h) const { return string(albums_[h]); }
+    std::string_view coverURL(TrackHandle h) const { return string(covers_[h]); }
+    // 快照池里的编号，按字典序排的，直接比大小就是比名字
+    uint32_t artistId(TrackHandle h) const { return artists_[h]; }
+    uint32_t albumId(TrackHandle h) const { return albums_[h]; }
+    AudioSourceType sourceType(TrackHandle h) const { return static_cast<AudioSourceType>(types_[h]); }
+    double duration(TrackHandle h) const { return durations_[h]; }
+    uint64_t fileSize(TrackHandle h) const { return sizes_[h]; }
+    bool liked(TrackHandle h) const { return liked_[h] != 0; }
+    TrackHandle find(std::string_view trackId) const;
+    AudioTrack get(TrackHandle h) const;
+
+    size_t stringCount() const { return stringCount_; }
+    std::string_view string(uint32_t id) const { return text(strings_[id]); }
+
+    size_t listCount() const { return listCount_; }
+    std::string_view listName(size_t list) const { return text(lists_[list].name); }
+    ListView listTracks(size_t list) const { return { listTracks_ + lists_[list].first, lists_[list].count }; }
+    size_t findList(std::string_view name) const;
+    std::shared_ptr<AudioList> toAudioList(size_t list) const;
+    // 整个倒进一个可以改的 AudioLibrary 里（要改再写回去的时候用）
+    void toLibrary(AudioLibrary& library) const;
+
+    size_t fileBytes() const { return file_.size(); }
+    uint64_t journalSequence() const { return journalSeq_; }
+
+private:
+    LibrarySnapshot() = default;
+    std::string_view text(Ref ref) const { return { text_ + ref.offset, ref.length }; }
+
+    MappedFile file_;
+    uint32_t trackCount_ = 0;
+    uint32_t stringCount_ = 0;
+    uint32_t listCount_ = 0;
+    uint32_t indexSlots_ = 0;
+    uint64_t textBytes_ = 0;
+    uint64_t listTrackCount_ = 0;
+    uint64_t bodyOffset_ = 0;           // 校验和从这里算到文件尾
+    uint64_t checksum_ = 0;
+    uint64_t journalSeq_ = 0;
+
+    // 都指着映射的内存
+    const char* text_ = nullptr;
+    const Ref* strings_ = nullptr;
+    const Ref* ids_ = nullptr;
+    const Ref* titles_ = nullptr;
+    const Ref* sources_ = nullptr;
+    const uint32_t* artists_ = nullptr;
+    const uint32_t* albums_ = nullptr;
+    const uint32_t* covers_ = nullptr;
+    const float* durations_ = nullptr;
+    const uint64_t* sizes_ = nullptr;
+    const uint8_t* types_ = nullptr;
+    const uint8_t* liked_ = nullptr;
+    const uint32_t* index_ = nullptr;
+    const ListRecord* lists_ = nullptr;
+    const uint32_t* listTracks_ = nullptr;
+};
@@ -0,0 +1,66 @@
+#include "SnapshotAudioListService.h"
+#include "utils/Logger.h"
+
+SnapshotAudioListService::SnapshotAudioListService(std::filesystem::path path)
+    : path_(std::move(path)) {
+    snapshot_ = LibrarySnapshot::open(path_);
+    if (snapshot_) {
+        LOG_INFO("Library snapshot mapped: %zu tracks, %zu lists", snapshot_->size(), snapshot_->listCount());
+    }
+}
+
+std::vector<std::string> SnapshotAudioListService::listAudioLists() const {
+    std::lock_guard lock(mutex_);
+    std::vector<std::string> names;
+    if (library_) {
+        for (const auto& list : library_->playlists()) names.push_back(list.name);
+    }
+    else if (snapshot_) {
+        for (size_t i = 0; i < snapshot_->listCount(); ++i) names.emplace_back(snapshot_->listName(i));
+    }
+    return names;
+}
+
+std::optional<AudioList> SnapshotAudioListService::loadAudioList(const std::string& name) const {
+    std::lock_guard lock(mutex_);
+    std::shared_ptr<AudioList> list;
+    if (library_) {
+        list = library_->toAudioList(name);
+    }
+    else if (snapshot_) {
+        list = snapshot_->toAudioList(snapshot_->findList(name));
+    }
+    if (!list) return std::nullopt;
+    return std::move(*list);
+}
+
+bool SnapshotAudioListService::saveAudioList(const AudioList& list) {
+    std::lock_guard lock(mutex_);
+    library().importList(list);
+    return commit();
+}
+
+bool SnapshotAudioListService::deleteAudioList(const std::string& name) {
+    std::lock_guard lock(mutex_);
+    if (!library().deleteList(name)) return false;
+    return commit();
+}
+
+AudioLibrary& SnapshotAudioListService::library() {
+    if (!library_) {
+        library_ = std::make_unique<AudioLibrary>();
+        if (snapshot_) snapshot_->toLibrary(*library_);
+    }
+    return *library_;
+}
+
+bool SnapshotAudioListService::commit() {
+    // Windows 上映射着的文件换不掉，先放开；写失败了旧文件还在，重新映射回来
+    snapshot_.reset();
+    const bool ok = LibrarySnapshot::write(*library_, path_);
+    snapshot_ = LibrarySnapshot::open(path_);
+    if (!ok) {
+        LOG_ERROR("Save library snapshot failed: %s", path_.string().c_str());
+    }
+    return ok;
+}
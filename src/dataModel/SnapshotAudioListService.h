@@ -0,0 +1,32 @@
+#pragma once
+#include <mutex>
+#include <memory>
+#include <filesystem>
+#include "AudioList.h"
+#include "AudioLibrary.h"
+#include "LibrarySnapshot.h"
+
+// 本地歌单存在一个 LibrarySnapshot 文件里
+// - 启动只 mmap 一下，读歌单直接从映射里拼，百万首的库也是毫秒级
+// - 第一次改的时候才把快照倒进内存里的 AudioLibrary，之后读写都走它；每次保存把整个快照重写一遍再重新映射
+class SnapshotAudioListService : public ImplAudioListService {
+public:
+    explicit SnapshotAudioListService(std::filesystem::path path);
+
+    std::vector<std::string> listAudioLists() const override;
+    bool saveAudioList(const AudioList& list) override;
+    std::optional<AudioList> loadAudioList(const std::string& name) const override;
+    bool deleteAudioList(const std::string& name) override;
+
+    // 当前映射着的快照，没有文件或者文件不认的时候是空
+    const LibrarySnapshot* snapshot() const { return snapshot_.get(); }
+
+private:
+    AudioLibrary& library();
+    bool commit();
+
+    mutable std::mutex mutex_;
+    const std::filesystem::path path_;
+    std::unique_ptr<LibrarySnapshot> snapshot_;
+    std::unique_ptr<AudioLibrary> library_;     // 改过才有
+};
@@ -0,0 +1,212 @@
+#include "TrackTable.h"
+#include <algorithm>
+#include <unordered_set>
+#include "utils/Logger.h"
+
+TrackHandle TrackTable::add(const AudioTrack& track) {
+    const size_t hash = std::hash<std::string_view>{}(track.trackId);
+    auto idOf = [this](uint32_t h) { return text(ids_[h]); };
+    TrackHandle h = idIndex_.find(track.trackId, hash, idOf);
+    const bool fresh = h == Index::Empty;
+
+    // 先算好要追加多少文本，放不下就整首不动，别留下半截的一行
+    size_t bytes = fresh ? track.trackId.size() + track.meta.title.size() + track.sourceURL.size() : 0;
+    if (!fresh) {
+        if (text(titles_[h]) != track.meta.title) bytes += track.meta.title.size();
+        if (text(sources_[h]) != track.sourceURL) bytes += track.sourceURL.size();
+    }
+    if (text_.size() + bytes > UINT32_MAX) {
+        LOG_ERROR("TrackTable text arena full, dropping track %s", track.trackId.c_str());
+        return InvalidTrack;
+    }
+
+    if (fresh) {
+        h = static_cast<TrackHandle>(ids_.size());
+        ids_.push_back(store(track.trackId));
+        titles_.emplace_back();
+        sources_.emplace_back();
+        artists_.push_back(0);
+        albums_.push_back(0);
+        covers_.push_back(0);
+        durations_.push_back(0);
+        sizes_.push_back(0);
+        types_.push_back(0);
+        liked_.push_back(0);
+        idIndex_.insert(h, hash, idOf);
+    }
+
+    // 没变的文本不重复存
+    if (text(titles_[h]) != track.meta.title) titles_[h] = store(track.meta.title);
+    if (text(sources_[h]) != track.sourceURL) sources_[h] = store(track.sourceURL);
+    auto& interner = StringInterner::global();
+    artists_[h] = interner.intern(track.meta.artist);
+    albums_[h] = interner.intern(track.meta.album);
+    covers_[h] = interner.intern(track.meta.coverURL);
+    durations_[h] = static_cast<float>(track.meta.duration);
+    sizes_[h] = track.meta.size;
+    types_[h] = static_cast<uint8_t>(track.sourceType);
+    liked_[h] = track.liked ? 1 : 0;
+    return h;
+}
+
+TrackHandle TrackTable::find(std::string_view trackId) const {
+    const uint32_t h = idIndex_.find(trackId, std::hash<std::string_view>{}(trackId),
+        [this](uint32_t v) { return text(ids_[v]); });
+    return h == Index::Empty ? InvalidTrack : h;
+}
+
+void TrackTable::reserve(size_t tracks) {
+    ids_.reserve(tracks);
+    titles_.reserve(tracks);
+    sources_.reserve(tracks);
+    artists_.reserve(tracks);
+    albums_.reserve(tracks);
+    covers_.reserve(tracks);
+    durations_.reserve(tracks);
+    sizes_.reserve(tracks);
+    types_.reserve(tracks);
+    liked_.reserve(tracks);
+}
+
+void TrackTable::shrinkToFit() {
+    text_.shrink_to_fit();
+    ids_.shrink_to_fit();
+    titles_.shrink_to_fit();
+    sources_.shrink_to_fit();
+    artists_.shrink_to_fit();
+    albums_.shrink_to_fit();
+    covers_.shrink_to_fit();
+    durations_.shrink_to_fit();
+    sizes_.shrink_to_fit();
+    types_.shrink_to_fit();
+    liked_.shrink_to_fit();
+}
+
+AudioTrack TrackTable::get(TrackHandle h) const {
+    AudioTrack t;
+    t.trackId = trackId(h);
+    t.sourceURL = sourceURL(h);
+    t.sourceType = sourceType(h);
+    t.liked = liked(h);
+    t.meta.title = title(h);
+    t.meta.artist = artist(h);
+    t.meta.album = album(h);
+    t.meta.coverURL = coverURL(h);
+    t.meta.duration = duration(h);
+    t.meta.size = static_cast<size_t>(fileSize(h));
+    return t;
+}
+
+std::vector<TrackHandle> TrackTable::filter(const std::function<bool(TrackHandle)>& pred) const {
+    std::vector<TrackHandle> out;
+    for (TrackHandle h = 0; h < ids_.size(); ++h) {
+        if (pred(h)) out.push_back(h);
+    }
+    return out;
+}
+
+std::vector<TrackHandle> TrackTable::byArtist(std::string_view artist) const {
+    // 先查一次池，之后整列比整数
+    const StringInterner::Id want = StringInterner::global().find(artist);
+    std::vector<TrackHandle> out;
+    if (want == StringInterner::Empty && !artist.empty()) return out;
+    for (TrackHandle h = 0; h < artists_.size(); ++h) {
+        if (artists_[h] == want) out.push_back(h);
+    }
+    return out;
+}
+
+std::vector<TrackHandle> TrackTable::sortedBy(Field field) const {
+    std::vector<TrackHandle> out(ids_.size());
+    for (TrackHandle h = 0; h < out.size(); ++h) out[h] = h;
+
+    switch (field) {
+    case Field::Artist:
+    case Field::Album: {
+        // 名次表一次取好，排序里只比整数
+        const auto ranks = StringInterner::global().ranks();
+        const auto& column = field == Field::Artist ? artists_ : albums_;
+        std::stable_sort(out.begin(), out.end(), [&](TrackHandle a, TrackHandle b) {
+            return (*ranks)[column[a]] < (*ranks)[column[b]];
+            });
+        break;
+    }
+    case Field::Title:
+        std::stable_sort(out.begin(), out.end(), [&](TrackHandle a, TrackHandle b) { return title(a) < title(b); });
+        break;
+    case Field::Duration:
+        std::stable_sort(out.begin(), out.end(), [&](TrackHandle a, TrackHandle b) { return durations_[a] < durations_[b]; });
+        break;
+    }
+    return out;
+}
+
+TrackTable::Groups TrackTable::groupBy(Field field) const {
+    Groups result;
+    if (field != Field::Artist && field != Field::Album) {
+        LOG_WARN("TrackTable::groupBy only supports artist/album");
+        return result;
+    }
+    const auto& column = field == Field::Artist ? artists_ : albums_;
+    const auto ranks = StringInterner::global().ranks();
+
+    // 编号是稠密的：先数每个编号有几首，再按名次排出组的顺序，最后把歌放进各自的段
+    std::vector<uint32_t> counts(ranks->size());
+    for (StringInterner::Id id : column) ++counts[id];
+    std::vector<StringInterner::Id> order;
+    for (StringInterner::Id id = 0; id < counts.size(); ++id) {
+        if (counts[id]) order.push_back(id);
+    }
+    std::sort(order.begin(), order.end(), [&](StringInterner::Id a, StringInterner::Id b) { return (*ranks)[a] < (*ranks)[b]; });
+
+    std::vector<uint32_t> cursor(counts.size());
+    uint32_t begin = 0;
+    result.groups.reserve(order.size());
+    for (StringInterner::Id id : order) {
+        cursor[id] = begin;
+        result.groups.push_back({ id, begin, begin + counts[id] });
+        begin += counts[id];
+    }
+    result.handles.resize(column.size());
+    for (TrackHandle h = 0; h < column.size(); ++h) {
+        result.handles[cursor[column[h]]++] = h;
+    }
+    return result;
+}
+
+TrackTable::Stats TrackTable::stats() const {
+    Stats s;
+    s.tracks = ids_.size();
+    for (size_t i = 0; i < s.tracks; ++i) {
+        s.liked += liked_[i];
+        s.totalSeconds += durations_[i];
+        s.totalBytes += sizes_[i];
+    }
+    // 驻留编号是稠密的，用位图数不同的值
+    std::vector<uint8_t> seen(StringInterner::global().size());
+    for (uint32_t id : artists_) {
+        if (id && !seen[id]) { seen[id] = 1; ++s.distinctArtists; }
+    }
+    std::fill(seen.begin(), seen.end(), 0);
+    for (uint32_t id : albums_) {
+        if (id && !seen[id]) { seen[id] = 1; ++s.distinctAlbums; }
+    }
+    return s;
+}
+
+size_t TrackTable::memoryBytes() const {
+    return text_.capacity()
+        + (ids_.capacity() + titles_.capacity() + sources_.capacity()) * sizeof(TextRef)
+        + (artists_.capacity() + albums_.capacity() + covers_.capacity()) * sizeof(StringInterner::Id)
+        + durations_.capacity() * sizeof(float)
+        + sizes_.capacity() * sizeof(uint64_t)
+        + types_.capacity() + liked_.capacity()
+        + idIndex_.memoryBytes();
+}
+
+TrackTable::TextRef TrackTable::store(std::string_view s) {
+    // 偏移是 32 位的，放不放得下 add 里已经算过了
+    TextRef ref{ static_cast<uint32_t>(text_.size()), static_cast<uint32_t>(s.size()) };
+    text_.insert(text_.end(), s.begin(), s.end());
+    return ref;
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "AudioList.h"
+#include "utils/StringInterner.h"
+
+// 曲库里一首歌的编号，就是在 TrackTable 里的行号，一直有效（表只增不删）
+using TrackHandle = uint32_t;
+constexpr TrackHandle InvalidTrack = UINT32_MAX;
+
+// 按列存的曲库表：每个字段一列，一首歌一行
+// - 文本都追加到一块连续的 text_ 里，列里只存 {偏移, 长度}，没有一首歌一堆小 string 的分配
+// - 歌手、专辑、封面重复得厉害，进全局的 StringInterner，列里只存 32 位的编号，分组比较都是整数
+// - 全库扫描（过滤、排序、统计）只碰要用的那几列，缓存友好
+// 改一首歌的文本字段时旧的文本不回收，留在 text_ 里，真要省就重建一遍表
+// 返回的 string_view 指着 text_，下次 add 之后可能失效
+class TrackTable {
+public:
+    struct TextRef {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    enum class Field { Title, Artist, Album, Duration };
+
+    // groupBy 的结果：handles 按组排好，每组是其中连续的一段，组按名字的字典序排
+    struct Groups {
+        struct Group {
+            StringInterner::Id id;      // 歌手/专辑的驻留编号
+            uint32_t begin;
+            uint32_t end;
+        };
+        std::vector<TrackHandle> handles;
+        std::vector<Group> groups;
+    };
+
+    struct Stats {
+        size_t tracks = 0;
+        size_t liked = 0;
+        double totalSeconds = 0;
+        uint64_t totalBytes = 0;        // 歌的大小之和
+        size_t distinctArtists = 0;
+        size_t distinctAlbums = 0;
+    };
+
+    // 已经有这个 trackId 的话更新那一行，返回原来的编号
+    // 文本区满了（32 位偏移，4GB）存不下返回 InvalidTrack，表不动
+    TrackHandle add(const AudioTrack& track);
+    TrackHandle find(std::string_view trackId) const;
+    size_t size() const { return ids_.size(); }
+    size_t capacity() const { return ids_.capacity(); }
+    // 批量导入前先把列的空间留够，导完了再 shrinkToFit 把翻倍多出来的还掉
+    void reserve(size_t tracks);
+    void shrinkToFit();
+
+    // 还原成 AudioTrack，给播放器那边用
+    AudioTrack get(TrackHandle h) const;
+
+    std::string_view trackId(TrackHandle h) const { return text(ids_[h]); }
+    std::string_view title(TrackHandle h) const { return text(titles_[h]); }
+    std::string_view sourceURL(TrackHandle h) const { return text(sources_[h]); }
+    std::string_view artist(TrackHandle h) const { return pooled(artists_[h]); }
+    std::string_view album(TrackHandle h) const { return pooled(albums_[h]); }
+    std::string_view coverURL(TrackHandle h) const { return pooled(covers_[h]); }
+    StringInterner::Id artistId(TrackHandle h) const { return artists_[h]; }
+    StringInterner::Id albumId(TrackHandle h) const { return albums_[h]; }
+    StringInterner::Id coverId(TrackHandle h) const { return covers_[h]; }
+    AudioSourceType sourceType(TrackHandle h) const { return static_cast<AudioSourceType>(types_[h]); }
+    double duration(TrackHandle h) const { return durations_[h]; }
+    uint64_t fileSize(TrackHandle h) const { return sizes_[h]; }
+    bool liked(TrackHandle h) const { return liked_[h] != 0; }
+    void setLiked(TrackHandle h, bool liked) { liked_[h] = liked ? 1 : 0; }
+
+    // 驻留编号对应的文本，0 号是空串
+    static std::string_view pooled(StringInterner::Id id) { return StringInterner::global().view(id); }
+
+    // 全库扫描
+    std::vector<TrackHandle> filter(const std::function<bool(TrackHandle)>& pred) const;
+    std::vector<TrackHandle> byArtist(std::string_view artist) const;
+    // 按某个字段排好的全部歌，稳定排序（同名的保持入库顺序）；歌手/专辑比的是名次，不比字符串
+    std::vector<TrackHandle> sortedBy(Field field) const;
+    // 按歌手或专辑分组，计数排序，O(歌数 + 驻留串数)
+    Groups groupBy(Field field) const;
+    Stats stats() const;
+    // 表本身占的内存（容量算），看看省了多少
+    size_t memoryBytes() const;
+
+private:
+    // 存 uint32 编号的开放寻址哈希表，键的文本在表外面，比较靠调用方给的 keyOf
+    // 只增不删，负载到 1/2 就翻倍
+    class Index {
+    public:
+        static constexpr uint32_t Empty = UINT32_MAX;
+
+        template <typename KeyOf>
+        uint32_t find(std::string_view key, size_t hash, KeyOf keyOf) const {
+            if (slots_.empty()) return Empty;
+            for (size_t i = hash & mask_;; i = (i + 1) & mask_) {
+                const uint32_t v = slots_[i];
+                if (v == Empty || keyOf(v) == key) return v;
+            }
+        }
+        // 调用方保证 key 不在表里
+        template <typename KeyOf>
+        void insert(uint32_t value, size_t hash, KeyOf keyOf) {
+            if ((count_ + 1) * 2 > slots_.size()) grow(keyOf);
+            place(value, hash);
+            ++count_;
+        }
+        size_t memoryBytes() const { return slots_.capacity() * sizeof(uint32_t); }
+
+    private:
+        void place(uint32_t value, size_t hash) {
+            size_t i = hash & mask_;
+            while (slots_[i] != Empty) i = (i + 1) & mask_;
+            slots_[i] = value;
+        }
+        template <typename KeyOf>
+        void grow(KeyOf keyOf) {
+            std::vector<uint32_t> old = std::move(slots_);
+            slots_.assign(old.empty() ? 16 : old.size() * 2, Empty);
+            mask_ = slots_.size() - 1;
+            for (uint32_t v : old) {
+                if (v != Empty) place(v, std::hash<std::string_view>{}(keyOf(v)));
+            }
+        }
+
+        std::vector<uint32_t> slots_;
+        size_t mask_ = 0;
+        size_t count_ = 0;
+    };
+
+    std::string_view text(TextRef ref) const { return { text_.data() + ref.offset, ref.length }; }
+    TextRef store(std::string_view s);
+
+    std::vector<char> text_;
+
+    // 列
+    std::vector<TextRef> ids_;
+    std::vector<TextRef> titles_;
+    std::vector<TextRef> sources_;
+    std::vector<StringInterner::Id> artists_;
+    std::vector<StringInterner::Id> albums_;
+    std::vector<StringInterner::Id> covers_;
+    std::vector<float> durations_;      // 秒，float 到几个小时也还是亚毫秒
+    std::vector<uint64_t> sizes_;
+    std::vector<uint8_t> types_;
+    std::vector<uint8_t> liked_;
+
+    Index idIndex_;                     // trackId -> 行号
+};
@@ -0,0 +1,92 @@
+#include "DnsCache.h"
+#include <algorithm>
+#include "utils/Logger.h"
+
+void DnsCache::asyncResolve(asio::io_context& io, const std::string& host, const std::string& port, Handler handler) {
+    const std::string key = makeKey(host, port);
+    {
+        std::lock_guard lock(mutex_);
+        Entry& entry = entries_[key];
+
+        // 命中且没过期
+        if (!entry.endpoints.empty() && std::chrono::steady_clock::now() < entry.expiry) {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            asio::post(io, [handler = std::move(handler), endpoints = entry.endpoints] {
+                handler(asio::error_code(), endpoints);
+                });
+            return;
+        }
+
+        entry.waiters.push_back({ &io, std::move(handler) });
+        // 已经有人在查了，等它的结果
+        if (entry.resolving) {
+            coalesced_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        entry.resolving = true;
+        misses_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 解析器跑在发起者的 io 上，结果回来再分发给所有等待者
+    auto resolver = std::make_shared<tcp::resolver>(io);
+    resolver->async_resolve(host, port,
+        [this, resolver, key](const asio::error_code& ec, tcp::resolver::results_type results) {
+            onResolved(key, ec, results);
+        });
+}
+
+void DnsCache::onResolved(const std::string& key, const asio::error_code& ec, const tcp::resolver::results_type& results) {
+    std::vector<Waiter> waiters;
+    Endpoints endpoints;
+    {
+        std::lock_guard lock(mutex_);
+        Entry& entry = entries_[key];
+        entry.resolving = false;
+        waiters.swap(entry.waiters);
+
+        // 失败不缓存，下次重新查
+        if (!ec) {
+            for (const auto& result : results) {
+                endpoints.push_back(result.endpoint());
+            }
+            entry.endpoints = endpoints;
+            entry.expiry = std::chrono::steady_clock::now() + ttl_;
+        }
+    }
+
+    if (ec) {
+        LOG_WARN("Resolve %s failed: %s", key.c_str(), ec.message().c_str());
+    }
+    for (auto& waiter : waiters) {
+        asio::post(*waiter.io, [handler = std::move(waiter.handler), ec, endpoints] {
+            handler(ec, endpoints);
+            });
+    }
+}
+
+void DnsCache::reportConnected(const std::string& host, const std::string& port, const tcp::endpoint& endpoint) {
+    std::lock_guard lock(mutex_);
+    auto it = entries_.find(makeKey(host, port));
+    if (it == entries_.end()) return;
+
+    auto& endpoints = it->second.endpoints;
+    auto pos = std::find(endpoints.begin(), endpoints.end(), endpoint);
+    // 前面那些没连上的整体挪到后面去
+    if (pos != endpoints.end() && pos != endpoints.begin()) {
+        std::rotate(endpoints.begin(), pos, endpoints.end());
+    }
+}
+
+void DnsCache::invalidate(const std::string& host, const std::string& port) {
+    std::lock_guard lock(mutex_);
+    auto it = entries_.find(makeKey(host, port));
+    if (it != entries_.end() && !it->second.resolving) {
+        entries_.erase(it);
+    }
+}
+
+DnsCache::Stats DnsCache::stats() const {
+    return { hits_.load(std::memory_order_relaxed),
+        misses_.load(std::memory_order_relaxed),
+        coalesced_.load(std::memory_order_relaxed) };
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <asio.hpp>
+
+using asio::ip::tcp;
+
+// 下载器共用的 DNS 缓存，按 host:port 存解析结果
+// - 过期时间固定（系统解析器拿不到记录的 TTL）
+// - 同一个 key 正在解析时，后来的请求排队等同一个结果，不重复查
+// - 连上的端点排到最前面，挂掉的端点下次自然往后排
+class DnsCache {
+public:
+    using Endpoints = std::vector<tcp::endpoint>;
+    using Handler = std::function<void(const asio::error_code&, const Endpoints&)>;
+
+    struct Stats {
+        size_t hits = 0;        // 直接用了缓存
+        size_t misses = 0;      // 真的发了查询
+        size_t coalesced = 0;   // 搭了别人正在进行的查询
+    };
+
+    explicit DnsCache(std::chrono::seconds ttl = std::chrono::seconds(60)) : ttl_(ttl) {}
+
+    // 解析 host:port，handler 总是投递到 io 上执行（不会在调用栈里直接回调）
+    void asyncResolve(asio::io_context& io, const std::string& host, const std::string& port, Handler handler);
+
+    // 用 endpoint 连上了：把它挪到最前，下次优先用
+    void reportConnected(const std::string& host, const std::string& port, const tcp::endpoint& endpoint);
+    // 所有端点都连不上：这条缓存作废，下次重新查
+    void invalidate(const std::string& host, const std::string& port);
+
+    Stats stats() const;
+
+private:
+    struct Waiter {
+        asio::io_context* io;
+        Handler handler;
+    };
+    struct Entry {
+        Endpoints endpoints;
+        std::chrono::steady_clock::time_point expiry;
+        bool resolving = false;
+        std::vector<Waiter> waiters;    // 等这次查询结果的请求
+    };
+
+    static std::string makeKey(const std::string& host, const std::string& port) { return host + ":" + port; }
+    void onResolved(const std::string& key, const asio::error_code& ec, const tcp::resolver::results_type& results);
+
+    const std::chrono::seconds ttl_;
+    mutable std::mutex mutex_;      // 不同 IO 线程上的下载器会同时来查
+    std::unordered_map<std::string, Entry> entries_;
+
+    std::atomic<size_t> hits_{ 0 };
+    std::atomic<size_t> misses_{ 0 };
+    std::atomic<size_t> coalesced_{ 0 };
+};
@@ -1,4 +1,5 @@
 #include "Network.h"
+#include "SegmentFetcher.h"
 #include "utils/Logger.h"
 std::string extractHost(const std::string& url) {
     // 1. 查找 "://" 确定协议头结束位置
@@ -55,12 +56,101 @@ ParsedUrl parseUrl(const std::string& url) {
     return result;
 }
 
+// 从 buffer 里解析一个响应头（状态行 + 头部），只消费到空行为止，后面的 body 留在 buffer 里
+void parseResponseHead(asio::streambuf& buffer, HttpResponse& response) {
+    // 同一条连接上会连续解析多个响应，上一个的字段不能留着
+    response.reset();
+
+    // 使用一个 std::istream 来从 buffer 中读取数据
+    std::istream header_stream(&buffer);
+    std::string status_line;
+    std::getline(header_stream, status_line);
+
+    DEBUG_COUT << "响应状态行: " << status_line << "\n";
+
+    // HTTP/1.0 默认不保持连接
+    if (status_line.find("HTTP/1.0") == 0) {
+        response.keep_alive = false;
+    }
+
+    // 新增状态码解析（极简版）
+    size_t code_start = status_line.find(' ') + 1;    // 找到第一个空格后
+    response.status_code = std::stoi(status_line.substr(code_start, 3)); // 直接截取3位数字
+
+    std::string line;
+    while (std::getline(header_stream, line) && line != "\r") {
+        DEBUG_COUT << "响应头部: " << line << "\n";
+
+        // 这个content_length 是为了chunk传输用的
+        if (line.find("Content-Length:") == 0) {
+            response.content_length = std::stoull(line.substr(15));
+        }
+        else if (line.find("Content-Type:") == 0) {
+            response.content_type = line.substr(13);
+            response.content_type.pop_back(); // 去掉最后的 '\r' 或 '\n'
+        }
+        else if (line.find("Transfer-Encoding: chunked") != std::string::npos) {
+            response.is_chunked = true;
+        }
+        else if (line.find("Connection:") == 0 || line.find("connection:") == 0) {
+            response.keep_alive = line.find("close") == std::string::npos;
+        }
+        // 总长度
+        else if (line.find("Content-Range:") == 0) {
+            response.is_partial = true;
+
+            // "Content-Range: bytes 0-262143/8945125"，起点用来核对管线响应的顺序
+            size_t bytesPos = line.find("bytes ");
+            if (bytesPos != std::string::npos) {
+                try {
+                    response.range_start = std::stoull(line.substr(bytesPos + 6));
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Failed to parse Content-Range start: " << e.what() << std::endl;
+                }
+            }
+
+            // 直接定位到 '/' 符号提取 total_length
+            size_t slashPos = line.find('/');
+            if (slashPos != std::string::npos) {
+                try {
+                    // 截取 '/' 后的部分并转换为数值
+                    std::string totalStr = line.substr(slashPos + 1);
+                    response.total_length = std::stoull(totalStr);
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Failed to parse Content-Range total_length: " << e.what() << std::endl;
+                }
+            }
+        }
+    }
+}
+
+bool prepareTlsStream(ssl::stream<tcp::socket>& stream, const std::string& host) {
+    SSL* ssl = stream.native_handle();
+    if (!SSL_set_tlsext_host_name(ssl, host.c_str())) {
+        return false;
+    }
+    if (auto* cache = TlsSessionCache::fromSsl(ssl)) {
+        cache->resume(ssl, host);
+    }
+    return true;
+}
+
+void onTlsHandshakeDone(ssl::stream<tcp::socket>& stream) {
+    SSL* ssl = stream.native_handle();
+    if (auto* cache = TlsSessionCache::fromSsl(ssl)) {
+        cache->recordHandshake(ssl);
+    }
+    LOG_DEBUG("TLS handshake done, session %s", SSL_session_reused(ssl) ? "resumed" : "full");
+}
+
 NetworkDownloader::NetworkDownloader(asio::io_context& io, ssl::context& ctx, const std::string& url) : ioContext_(io),                   // 初始化IO上下文引用
 sslContext_(ctx),                 // 初始化SSL上下文引用
-socket_(ioContext_, sslContext_), // 创建SSL流（底层TCP socket未打开）
+socket_(std::make_shared<ssl::stream<tcp::socket>>(ioContext_, sslContext_)), // 创建SSL流（底层TCP socket未打开）
 heartbeatTimer_(ioContext_),        // 心跳请求
 url_(url),                        // 存储原始URL
-ringBuffer_(BufferCapacity_),      // 分配 4MB 空间
+ring_(BufferCapacity_, BufferHistory_), // 分配 4MB 空间，留 1MB 已读数据给往回 seek
 active_(true)                     // 标记为活跃状态
 {
 
@@ -73,15 +163,16 @@ active_(true)                     // 标记为活跃状态
     }
 
     // 在 TLS 握手阶段告诉服务器要访问的域名（通过 SNI 扩展），确保服务器返回正确的证书
-    bool flag = SSL_set_tlsext_host_name(socket_.native_handle(), parsedUrl_.host.c_str());
+    // 这个 host 之前握手过的话顺便带上缓存的会话
+    bool flag = prepareTlsStream(*socket_, parsedUrl_.host);
     if (!flag) {
         std::cerr << "Failed to set SNI hostname " << '\n';
     }
 
 
     // 配置SSL验证模式（可选）在Mgr里设置的?
-    // socket_.set_verify_mode(ssl::verify_peer);
-    // socket_.set_verify_callback(...);
+    // socket_->set_verify_mode(ssl::verify_peer);
+    // socket_->set_verify_callback(...);
 }
 
 NetworkDownloader::~NetworkDownloader() {
@@ -91,36 +182,77 @@ NetworkDownloader::~NetworkDownloader() {
     // 2. 安全关闭连接
     asio::error_code ec; // 忽略错误避免抛出异常
     {
-        std::lock_guard<std::mutex> lock(bufferMutex_);
-
         // 关闭SSL流
-        if (socket_.lowest_layer().is_open()) {
-            socket_.shutdown(ec); // 发送SSL关闭通知
+        if (socket_->lowest_layer().is_open()) {
+            socket_->shutdown(ec); // 发送SSL关闭通知
             if (ec && ec != asio::error::eof) {
                 std::cerr << "SSL Shutdown error: " << ec.message() << std::endl;
             }
 
             // 关闭底层TCP套接字
-            socket_.lowest_layer().close(ec);
+            socket_->lowest_layer().close(ec);
             if (ec) {
                 std::cerr << "Socket close error: " << ec.message() << std::endl;
             }
         }
     }
 
+    // 分段连接只持有 weak_ptr，这里把它们的 socket 也关掉
+    stopSegmentWorkers();
+
     // 3. 通知所有等待线程（避免死锁）
     //dataAvailable_.notify_all();
 }
 
 void NetworkDownloader::start() {
 
-    LOG_INFO("Async resolve...");
     if (!active_) return;
 
-    // 异步DNS解析 resolver = std::move(resolver)
-    auto resolver = std::make_shared<tcp::resolver>(ioContext_);
-    resolver->async_resolve(parsedUrl_.host, parsedUrl_.port,
-        [self = shared_from_this(), resolver](const asio::error_code& ec, tcp::resolver::results_type endpoints) {
+    // 池子里拿出来的连接，DNS、TCP、TLS 都省了
+    if (tlsReady_ && socket_->lowest_layer().is_open()) {
+        LOG_INFO("Reuse pooled connection to %s", parsedUrl_.host.c_str());
+        asio::post(ioContext_, [self = shared_from_this()] {
+            self->sendRangeRequest();
+            });
+        return;
+    }
+
+    // 有磁盘缓存就先从本地供，碰到缓存里没有的块再连网络
+    if (diskCache_) {
+        asio::post(ioContext_, [self = shared_from_this()] {
+            self->pumpCache();
+            });
+        return;
+    }
+    connectNetwork();
+}
+
+void NetworkDownloader::pumpCache() {
+    if (!active_) return;
+    // 已经连上了就走正常流程，claimBlock 里照样先查缓存
+    if (tlsReady_) {
+        sendRangeRequest();
+        return;
+    }
+
+    checkSeekRange();
+    auto range = claimBlock();
+    if (!range) return;     // 全都从缓存交付了，或者窗口满了
+
+    // 缓存供不上了，这块留给网络
+    requeueBlock(range->first, range->second);
+    if (!connecting_) {
+        connectNetwork();
+    }
+}
+
+void NetworkDownloader::connectNetwork() {
+    connecting_ = true;
+    LOG_INFO("Async resolve...");
+
+    // 异步DNS解析，走管理器的缓存，重连和同一主机的其他下载器都不用再查一遍
+    NetworkDownloadMgr::getInstance().getDnsCache().asyncResolve(ioContext_, parsedUrl_.host, parsedUrl_.port,
+        [self = shared_from_this()](const asio::error_code& ec, const DnsCache::Endpoints& endpoints) {
             if (ec || !self->active_) {
                 std::cerr << "Resolve failed: " << ec.message() << std::endl;
                 return;
@@ -129,115 +261,682 @@ void NetworkDownloader::start() {
         });
 }
 
+void NetworkDownloader::attachDiskCache(std::shared_ptr<CachedTrack> track) {
+    diskCache_ = std::move(track);
+    // 以前下过这首的话总长度已经知道了
+    if (diskCache_ && diskCache_->totalLength() != 0) {
+        rangeBlock_.total_length = diskCache_->totalLength();
+        rangeBlock_.range_end = (std::min)(rangeBlock_.range_end, rangeBlock_.total_length - 1);
+    }
+}
+
+bool NetworkDownloader::detachForReuse() {
+    stopSegmentWorkers();
+    diskCache_.reset();     // 关掉缓存文件，写完索引，池子里的连接不占着它
+    asio::error_code ec;
+    heartbeatTimer_.cancel(ec);
+
+    // 还有请求没收完响应的话，残留的 body 会被下一首歌当成自己的，这种连接不能复用
+    return active_ && tlsReady_ && socket_->lowest_layer().is_open()
+        && !writing_ && !reading_ && !ringReserved_ && inflightRanges_.empty();
+}
+
+void NetworkDownloader::retarget(const std::string& url) {
+    url_ = url;
+    parsedUrl_ = parseUrl(url_);
+    reset();
+
+    notFirstParse = false;
+    isEnd.store(false, std::memory_order_release);
+    pendingSeekPos_.store(std::nullopt, std::memory_order_relaxed);
+    seekApplied_.store(seekRequested_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    reconnectRetries_ = 0;
+    retryRanges_.clear();
+    stagedBlocks_.clear();
+    stagedRanges_.clear();
+    stagedBytes_ = 0;
+    buffer_.consume(buffer_.size());
+    // 测到的网速还是这个 host 的，留着；码率是上一首的，不能用
+    readAhead_.setBitrate(0);
+    readAhead_.setConnections(1);
+    readAhead_.restart();
+    prefetchThrottled_ = false;
+    producerParked_.store(false, std::memory_order_relaxed);
+    fetchLimit_ = 0;
+    updateLastUsedTime();
+}
+
 void NetworkDownloader::reconnect() {
     asio::error_code ec;
     // 关闭旧的 socket，保险起见
-    socket_.lowest_layer().shutdown(tcp::socket::shutdown_both, ec);
-    socket_.lowest_layer().close(ec);
+    socket_->lowest_layer().shutdown(tcp::socket::shutdown_both, ec);
+    socket_->lowest_layer().close(ec);
+
+    // 旧连接上还挂着的读写回调会带着 operation_aborted 回来，换代后直接忽略
+    ++connGeneration_;
+    writing_ = false;
+    reading_ = false;
+    tlsReady_ = false;
+    connecting_ = false;
+
+    // 没收到响应的请求全部作废，从第一个没收到的块重新请求
+    rewindToFirstPending();
 
     // 清空 buffer 避免残留数据影响后续
     buffer_.consume(buffer_.size());
     DEBUG_COUT << "reconnect 后buffer大小" << buffer_.size() << std::endl;
-    // 在原位置直接新建一个 socket对象
-    socket_ = ssl::stream<tcp::socket>(ioContext_, sslContext_);
+    // 换一个新的流，不在旧的上面移动赋值：旧连接上挂着的读写还没回来，
+    // 它们的回调各自拿着旧流的 shared_ptr，等 operation_aborted 都回来了旧流才析构
+    socket_ = std::make_shared<ssl::stream<tcp::socket>>(ioContext_, sslContext_);
 
-    // 在 握手阶段告诉服务器要访问的域名，确保服务器返回正确的证书
-    SSL_set_tlsext_host_name(socket_.native_handle(), parsedUrl_.host.c_str());
+    // 在 握手阶段告诉服务器要访问的域名，确保服务器返回正确的证书；有缓存的会话就走恢复
+    prepareTlsStream(*socket_, parsedUrl_.host);
     start();
 }
 
 void NetworkDownloader::sendRangeRequest() {
+    // 同一时刻只允许一个 async_write，写完回调里会再补满管线
+    if (writing_) return;
+
     checkSeekRange(); // 更新rangBlock里的 start 和 end
 
-    ////计算缓冲区当前可写入的空间
-    //size_t available = BufferCapacity_ - size_ - 1;
-    //if ((std::min)(block_, rangeBlock_.total_length-rangeBlock_.range_start) > available) {
-    //    // 缓冲区溢出处理
-    //    std::cerr << "Buffer overflow!" << std::endl;
-    //    return;
-    //}
+    // 总长度未知（第一块）或服务器不支持管线时，一次只挂一个请求
+    const size_t depth = (rangeBlock_.total_length == 0 || !pipelineSupported_) ? 1 : pipelineDepth_;
 
-    // 使用 ostringstream 高效拼接
+    // 使用 ostringstream 高效拼接，多个请求拼成一次写
     std::ostringstream request;
-    request << "GET " << parsedUrl_.path << " HTTP/1.1\r\n"
-        << "Host: " << parsedUrl_.host << "\r\n"
-        << "Range: bytes=" << rangeBlock_.range_start << "-" << rangeBlock_.range_end << "\r\n"
-        << CommonHeaders_ << "\r\n";  // 插入公共头
+    size_t batched = 0;
+    const bool idle = inflightRanges_.empty();
+    while (inflightRanges_.size() < depth) {
+        // 分段模式下和其他连接抢同一个游标；窗口满了或全领完就先停
+        auto range = claimBlock();
+        if (!range) break;
+
+        writeRangeRequest(request, parsedUrl_, range->first, range->second);
+        inflightRanges_.push_back(*range);
+        ++batched;
+    }
+    if (batched == 0) return;
 
-    rangeBlock_.moveToNextBlock(); // 更新信息，以后seek网络流的时候直接改block
+    // 连接闲着的时候发出去的，从现在开始计时；管线里后面的块从前一块收完算
+    if (idle) {
+        mainBusySince_ = ReadAheadController::Clock::now();
+        awaitingFirstByte_ = true;
+    }
 
-    // 异步发送请求
-    asio::async_write(socket_, asio::buffer(request.str()),
-        [self = shared_from_this()](const asio::error_code& ec, size_t /*bytes*/) {
-            if (ec || !self->active_) {
+    // 异步发送请求 请求串要活到写完，交给 shared_ptr 保管
+    writing_ = true;
+    auto req = std::make_shared<std::string>(request.str());
+    asio::async_write(*socket_, asio::buffer(*req),
+        [self = shared_from_this(), stream = socket_, req, gen = connGeneration_](const asio::error_code& ec, size_t /*bytes*/) {
+            if (!self->active_ || gen != self->connGeneration_) return;
+            self->writing_ = false;
+            if (ec) {
+                // keep-alive 连接可能已经被服务器超时关掉了，换条新连接重发
                 std::cerr << "Send HTTP request failed: " << ec.message() << std::endl;
-                self->shutdown();
+                self->retryCurrentBlock(ec);
                 return;
             }
-            self->ParseHeaders();
+            // 读端空闲就开始解析响应，否则读端会按顺序一个个读下去
+            if (!self->reading_) {
+                self->ParseHeaders();
+            }
+            // 写的过程中可能已经有响应读完，顺手把管线补满
+            self->sendRangeRequest();
         });
 
 }
 
-void NetworkDownloader::ParseHeaders() {
-    asio::async_read_until(socket_, buffer_, "\r\n\r\n",
-        [self = shared_from_this()](const asio::error_code& ec, size_t bytes_transferred) {
-            DEBUG_COUT << "准备解析头部，此时buffersize " << self->buffer_.size() << std::endl;
-            if (ec) {
-                if (!self->socket_.lowest_layer().is_open()) {
-                    std::cout << "连接关闭" << std::endl << std::endl;;
-                }
-                std::cerr << "Read error (header): " << ec.message() << std::endl;
+void NetworkDownloader::asyncReadRangeBody() {
+    // 以响应头里的 Content-Length 为准，最后一块和被暂存截断的块会比 block_size 小
+    const size_t expected_size = httpResponse_.content_length;
+    const size_t offset = inflightRanges_.front().first;
+
+    // 顺序对得上、环形缓冲区放得下：socket 直接读进 ring_ 的空闲区域，body 不再经过 buffer_
+    if (auto dest = reserveRing(offset, expected_size, buffer_)) {
+        readBodyIntoRing(offset, expected_size, *dest);
+        return;
+    }
+
+    // 读头部时 async_read_until 可能已经多读了一部分 body 进 buffer_
+    const size_t already = (std::min)(buffer_.size(), expected_size);
+
+    asio::async_read(*socket_, buffer_, asio::transfer_exactly(expected_size - already),
+        [self = shared_from_this(), stream = socket_, offset, expected_size, gen = connGeneration_](const asio::error_code& ec, size_t bytes_transferred) {
+            if (!self->active_ || gen != self->connGeneration_) return;
+            if (ec && (ec != asio::error::eof || self->buffer_.size() < expected_size)) {
+                DEBUG_CERR << "读取 range 数据出错: " << ec.message() << std::endl;
+                self->retryCurrentBlock(ec);
                 return;
             }
+            // 对端读完就关了，这块数据是完整的，但下一块要换新连接
+            if (ec == asio::error::eof) {
+                self->httpResponse_.keep_alive = false;
+            }
+            DEBUG_COUT << "预期读取: " << expected_size << " 字节，实际读取: " << bytes_transferred << " 字节\n";
+            DEBUG_COUT << "读完后buffersize: " << self->buffer_.size() << "\n";
 
-            //// 根据标记来办事，要是
-            //if (self->notFirstParse && self->httpResponse_.is_partial) {
-            //    self->asyncReadRangeBody();
-            //}
+            // 按文件偏移交付，乱序或者放不下就先暂存等前面的块
+            self->deliverBlock(offset, self->buffer_, expected_size);
+
+            // 只消费这一块，keep-alive 下后面可能已经跟着下一个响应的数据
+            self->buffer_.consume(expected_size);
 
-            // 使用一个 std::istream 来从 buffer_ 中读取数据
-            std::istream header_stream(&self->buffer_);
-            std::string status_line;
-            std::getline(header_stream, status_line);
+            self->onRangeBlockDone();
+        });
+}
 
-            DEBUG_COUT << "响应状态行: " << status_line << "\n";
+void NetworkDownloader::readBodyIntoRing(size_t offset, size_t expected_size, std::array<asio::mutable_buffer, 2> dest) {
+    const size_t remaining = asio::buffer_size(dest);
+
+    asio::async_read(*socket_, dest, asio::transfer_exactly(remaining),
+        [self = shared_from_this(), stream = socket_, offset, expected_size, remaining, gen = connGeneration_](const asio::error_code& ec, size_t bytes_transferred) {
+            // 换了连接也要把预留还回去，不然 ring_ 再也写不进东西
+            if (gen != self->connGeneration_ || !self->active_) {
+                self->commitReserved(offset, expected_size, false);
+                return;
+            }
+            if (ec && (ec != asio::error::eof || bytes_transferred < remaining)) {
+                DEBUG_CERR << "读取 range 数据出错: " << ec.message() << std::endl;
+                self->commitReserved(offset, expected_size, false);
+                self->retryCurrentBlock(ec);
+                return;
+            }
+            if (ec == asio::error::eof) {
+                self->httpResponse_.keep_alive = false;
+            }
 
-            // 新增状态码解析（极简版）
-            size_t code_start = status_line.find(' ') + 1;    // 找到第一个空格后
-            self->httpResponse_.status_code = std::stoi(status_line.substr(code_start, 3)); // 直接截取3位数字
+            self->commitReserved(offset, expected_size, true);
+            self->onRangeBlockDone();
+        });
+}
 
-            std::string line;
-            while (std::getline(header_stream, line) && line != "\r") {
-                DEBUG_COUT << "响应头部: " << line << "\n";
+void NetworkDownloader::onRangeBlockDone() {
+    reading_ = false;
+    reconnectRetries_ = 0;
+    inflightRanges_.pop_front();
 
-                // 这个content_length 是为了chunk传输用的
-                if (line.find("Content-Length:") == 0) {
-                    self->httpResponse_.content_length = std::stoull(line.substr(15));
-                }
-                else if (line.find("Content-Type:") == 0) {
-                    self->httpResponse_.content_type = line.substr(13);
-                    self->httpResponse_.content_type.pop_back(); // 去掉最后的 '\r' 或 '\n'
+    const auto now = ReadAheadController::Clock::now();
+    readAhead_.onBlockDone(httpResponse_.content_length, now - mainBusySince_);
+    mainBusySince_ = now;
+
+    // 第一块发出去时还不知道总长度，这里把后面的范围收紧到文件末尾
+    if (rangeBlock_.total_length != 0 && rangeBlock_.range_end >= rangeBlock_.total_length) {
+        rangeBlock_.range_end = rangeBlock_.total_length - 1;
+    }
+
+    // 流结束由 deliverBlock 按 commitOffset_ 判断，这里只管要不要继续发请求
+    if (isEnd.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    // 知道总长度了，按需开分段连接
+    if (segmentConnections_ > 1 && segmentWorkers_.empty() && !rangeBlock_.isFinished()) {
+        startSegmentWorkers();
+    }
+
+    // 服务器要关连接了，管线里剩下的请求不会再有响应
+    if (!httpResponse_.keep_alive || !socket_->lowest_layer().is_open()) {
+        reconnect();
+        return;
+    }
+
+    // 服务器愿意保持连接就在同一条 TLS 连接上接着发 Range，省掉 DNS + TCP + TLS 握手
+    // 管线里还有请求的话，下一个响应多半已经在 buffer_ 里了，直接接着解析
+    if (!inflightRanges_.empty()) {
+        ParseHeaders();
+    }
+    sendRangeRequest();
+}
+
+void NetworkDownloader::rewindToFirstPending() {
+    // 退回调度，claimBlock 会按偏移从小到大优先重新领
+    for (const auto& range : inflightRanges_) {
+        requeueBlock(range.first, range.second);
+    }
+    inflightRanges_.clear();
+}
+
+void NetworkDownloader::writeRangeRequest(std::ostream& os, const ParsedUrl& url, size_t start, size_t end) {
+    os << "GET " << url.path << " HTTP/1.1\r\n"
+        << "Host: " << url.host << "\r\n"
+        << "Range: bytes=" << start << "-" << end << "\r\n"
+        << CommonHeaders_ << "\r\n";  // 插入公共头
+}
+
+std::optional<std::pair<size_t, size_t>> NetworkDownloader::claimBlock() {
+    // 缓存里有的直接从本地交付，只把缓存里没有的部分交给网络
+    while (auto range = nextBlock()) {
+        if (!serveFromCache(*range)) {
+            return range;
+        }
+    }
+    return std::nullopt;
+}
+
+bool NetworkDownloader::serveFromCache(std::pair<size_t, size_t>& range) {
+    if (!diskCache_) return false;
+
+    const size_t end = range.second + 1;
+    const size_t cached = (std::min)(diskCache_->cachedUntil(range.first), end);
+    if (cached <= range.first || !deliverFromCache(range.first, cached - range.first)) {
+        return false;
+    }
+    range.first = cached;
+    return cached == end;
+}
+
+bool NetworkDownloader::deliverFromCache(size_t offset, size_t len) {
+    // seek 之后的旧块
+    if (offset < commitOffset_) return true;
+
+    // 接得上就从文件直接读进 ring_ 的空闲区域，否则和网络块一样暂存
+    if (offset == commitOffset_ && !ringReserved_ && len <= ring_.writeAvailable()) {
+        auto regions = ring_.writeRegions(len);
+        if (!diskCache_->read(offset, regions.first.data, regions.first.size)
+            || !diskCache_->read(offset + regions.first.size, regions.second.data, regions.second.size)) {
+            return false;
+        }
+        ring_.commitWrite(len);
+        commitOffset_ += len;
+        notifyConsumer();
+    }
+    else {
+        std::vector<uint8_t> block(len);
+        if (!diskCache_->read(offset, block.data(), len)) {
+            return false;
+        }
+        stageBlock(offset, std::move(block));
+    }
+    LOG_DEBUG("Served %zu bytes at %zu from disk cache", len, offset);
+
+    // 这里可能是在 afterCommit 里被调进来的，只做入环和结束判断，叫醒其他连接的事留给 afterCommit
+    drainStagedBlocks();
+    if (rangeBlock_.total_length != 0 && commitOffset_ >= rangeBlock_.total_length) {
+        isEnd.store(true, std::memory_order_release);
+        notifyConsumer();
+    }
+    return true;
+}
+
+std::optional<std::pair<size_t, size_t>> NetworkDownloader::nextBlock() {
+    // 之前失败退回来的块优先
+    if (!retryRanges_.empty()) {
+        auto range = *retryRanges_.begin();
+        retryRanges_.erase(retryRanges_.begin());
+        return range;
+    }
+    // 暂存里已经有的（seek 之前下好的）跳过去，只领缺的
+    const size_t skipTo = stagedRanges_.contiguousEnd(rangeBlock_.range_start);
+    if (skipTo > rangeBlock_.range_start) {
+        rangeBlock_.range_start = skipTo;
+    }
+    if (rangeBlock_.isFinished()) {
+        return std::nullopt;
+    }
+
+    // 预取只要开头一段，真要播的时候 liftFetchLimit 会再叫醒
+    if (fetchLimit_ != 0 && rangeBlock_.range_start >= fetchLimit_) {
+        return std::nullopt;
+    }
+
+    // 已经领先播放够多了，攒着也是占内存，等消费一些再领
+    if (isStopPrefetch()) {
+        return std::nullopt;
+    }
+
+    // 块大小按最新的测速来
+    rangeBlock_.resize(readAhead_.blockSize());
+
+    // 环里连一块的空都没有了：再领只能暂存，先停下，等消费者腾出一块的地方
+    const size_t ringFree = ring_.writeAvailable();
+    if (ringFree < rangeBlock_.block_size) {
+        parkProducer(ring_.readIndex() + (rangeBlock_.block_size - ringFree));
+        return std::nullopt;
+    }
+
+    // 领得太靠前的话数据只能暂存，暂存超过 MaxBufferSize 就先不领了
+    if (rangeBlock_.range_start > commitOffset_ + ringFree + MaxBufferSize) {
+        return std::nullopt;
+    }
+
+    // 后面紧接着有暂存的，这块只领到它前面
+    const auto& staged = stagedRanges_.intervals();
+    auto next = staged.upper_bound(rangeBlock_.range_start);
+    if (next != staged.end() && next->first <= rangeBlock_.range_end) {
+        rangeBlock_.range_end = next->first - 1;
+    }
+
+    std::pair<size_t, size_t> range{ rangeBlock_.range_start, rangeBlock_.range_end };
+    rangeBlock_.moveToNextBlock(); // 更新信息，以后seek网络流的时候直接改block
+    return range;
+}
+
+void NetworkDownloader::deliverBlock(size_t offset, asio::streambuf& src, size_t len) {
+    // seek 之后还在路上的旧块，直接丢掉
+    if (offset < commitOffset_) {
+        return;
+    }
+    if (diskCache_) {
+        diskCache_->write(offset, src.data(), len);
+    }
+
+    // 正好接在后面且放得下，直接进环形缓冲区；否则暂存
+    if (offset != commitOffset_ || !writeToRing(asio::buffer(src.data(), len))) {
+        std::vector<uint8_t> block(len);
+        asio::buffer_copy(asio::buffer(block), src.data(), len);
+        stageBlock(offset, std::move(block));
+    }
+    afterCommit();
+}
+
+void NetworkDownloader::stageBlock(size_t offset, std::vector<uint8_t> block) {
+    // seek 之后同一个位置可能被领了两次，留大的那块
+    auto it = stagedBlocks_.find(offset);
+    if (it != stagedBlocks_.end()) {
+        if (it->second.size() >= block.size()) return;
+        stagedBytes_ -= it->second.size();
+    }
+    stagedBytes_ += block.size();
+    stagedRanges_.add(offset, offset + block.size());
+    stagedBlocks_[offset] = std::move(block);
+}
+
+std::optional<std::array<asio::mutable_buffer, 2>> NetworkDownloader::reserveRing(size_t offset, size_t len, asio::streambuf& src) {
+    if (ringReserved_ || offset != commitOffset_ || len > ring_.writeAvailable()) {
+        return std::nullopt;
+    }
+    ringReserved_ = true;
+
+    // 环绕的时候是两段；先把头部多读的 body 搬进去（这一小段没法避免拷贝）
+    auto regions = ring_.writeRegions(len);
+    std::array<asio::mutable_buffer, 2> dest{
+        asio::buffer(regions.first.data, regions.first.size),
+        asio::buffer(regions.second.data, regions.second.size) };
+    const size_t already = asio::buffer_copy(dest, src.data(), len);
+    src.consume(already);
+
+    // 剩下的区域给 socket 直接写
+    if (already < dest[0].size()) {
+        dest[0] += already;
+    }
+    else {
+        dest[1] += already - dest[0].size();
+        dest[0] = asio::mutable_buffer();
+    }
+    return dest;
+}
+
+void NetworkDownloader::commitReserved(size_t offset, size_t len, bool ok) {
+    ringReserved_ = false;
+
+    // 读的过程中 seek 过的话 commitOffset_ 已经变了，这块作废
+    if (ok && offset == commitOffset_) {
+        // 发布之前先落一份到磁盘缓存，发布之后这块内存随时可能被消费者读走、再被覆盖
+        if (diskCache_) {
+            auto regions = ring_.writeRegions(len);
+            std::array<asio::const_buffer, 2> src{
+                asio::buffer(regions.first.data, regions.first.size),
+                asio::buffer(regions.second.data, regions.second.size) };
+            diskCache_->write(offset, src, len);
+        }
+        // release 发布，消费者 acquire 之后才能看到这批字节
+        ring_.commitWrite(len);
+        commitOffset_ += len;
+        notifyConsumer();
+    }
+    afterCommit();
+}
+
+void NetworkDownloader::afterCommit() {
+    drainStagedBlocks();
+
+    if (rangeBlock_.total_length != 0 && commitOffset_ >= rangeBlock_.total_length) {
+        LOG_INFO("Range stream finished, total %zu bytes", rangeBlock_.total_length);
+        isEnd.store(true, std::memory_order_release);
+        notifyConsumer();
+        stopSegmentWorkers();
+        if (diskCache_) {
+            diskCache_->requestFlush();
+        }
+        return;
+    }
+
+    wakeFetchers();
+}
+
+void NetworkDownloader::wakeFetchers() {
+    // 窗口往前挪了，空闲的分段连接接着领块；领块时可能从缓存交付到结尾，所以遍历一份拷贝
+    auto workers = segmentWorkers_;
+    for (auto& worker : workers) {
+        worker->fetchNext();
+    }
+    // 主连接因为窗口满停下来的话也叫醒它（主连接自己交付时 inflight 还没弹出，不会走到这里）
+    if (inflightRanges_.empty() && tlsReady_) {
+        sendRangeRequest();
+    }
+    else if (!tlsReady_ && !connecting_) {
+        pumpCache();
+    }
+}
+
+bool NetworkDownloader::isStopPrefetch() {
+    // 消费者读到的文件偏移；seek 之后旧位置的数据还没被扔掉时按 seek 的位置算
+    const size_t readIndex = (std::max)(ring_.readIndex(), seekStartIndex_.load(std::memory_order_acquire));
+    const size_t consumer = bufferStartOffset_.load(std::memory_order_acquire) + readIndex;
+    const size_t ahead = rangeBlock_.range_start > consumer ? rangeBlock_.range_start - consumer : 0;
+
+    // 到了目标就停，退到四分之三才恢复，免得在线上一块一块地抖
+    const size_t target = readAhead_.readAheadBytes(BufferPrefetchMax_);
+    const size_t lowWater = target - target / 4;
+    prefetchThrottled_ = ahead >= (prefetchThrottled_ ? lowWater : target);
+    if (prefetchThrottled_) {
+        // 消费者读到 range_start - lowWater 这个文件偏移时正好退到低水位
+        parkProducer(readIndex + (ahead - lowWater));
+    }
+    return prefetchThrottled_;
+}
+
+void NetworkDownloader::parkProducer(size_t resumeIndex) {
+    // 已经停着的话取近的那个，醒了之后会重新判断一遍
+    if (producerParked_.load(std::memory_order_relaxed)) {
+        resumeIndex = (std::min)(resumeIndex, resumeReadIndex_.load(std::memory_order_relaxed));
+    }
+    resumeReadIndex_.store(resumeIndex, std::memory_order_relaxed);
+    producerParked_.store(true, std::memory_order_release);
+
+    // 和 maybeResumeProducer 配对：要么消费者看到我们停着，要么我们看到它已经读过去了
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring_.readIndex() >= resumeIndex && producerParked_.exchange(false, std::memory_order_acq_rel)) {
+        asio::post(ioContext_, [self = shared_from_this()] {
+            self->resumeProducer();
+            });
+    }
+}
+
+void NetworkDownloader::maybeResumeProducer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!producerParked_.load(std::memory_order_acquire)) return;
+    if (ring_.readIndex() < resumeReadIndex_.load(std::memory_order_relaxed)) return;
+
+    // 只有抢到的那一个去投递，连着读几次也只叫醒一次
+    if (producerParked_.exchange(false, std::memory_order_acq_rel)) {
+        asio::post(ioContext_, [self = shared_from_this()] {
+            self->resumeProducer();
+            });
+    }
+}
+
+void NetworkDownloader::resumeProducer() {
+    if (!active_) return;
+    LOG_DEBUG("Producer resumed, %zu bytes buffered", ring_.readAvailable());
+    // 暂存块先入环，再叫醒各条连接；还不够的话它们会在 nextBlock 里重新停下
+    afterCommit();
+}
+
+void NetworkDownloader::liftFetchLimit() {
+    asio::post(ioContext_, [self = shared_from_this()] {
+        if (self->fetchLimit_ == 0) return;
+        self->fetchLimit_ = 0;
+        self->wakeFetchers();
+        });
+}
+
+void NetworkDownloader::setTrackBitrate(double bytesPerSecond) {
+    asio::post(ioContext_, [self = shared_from_this(), bytesPerSecond] {
+        self->readAhead_.setBitrate(bytesPerSecond);
+        // 码率变大的话预读目标跟着变大，停着的可以接着领了
+        if (self->prefetchThrottled_) {
+            self->wakeFetchers();
+        }
+        });
+}
+
+bool NetworkDownloader::writeToRing(asio::const_buffer src) {
+    const size_t len = src.size();
+    //计算缓冲区当前可写入的空间；有 socket 正往预留区域里读时也不能写
+    if (ringReserved_ || len > ring_.writeAvailable()) {
+        return false;
+    }
+
+    // 环绕的时候分两段写入（尾部到末尾 + 头部剩余部分）
+    auto regions = ring_.writeRegions(len);
+    std::array<asio::mutable_buffer, 2> dest{
+        asio::buffer(regions.first.data, regions.first.size),
+        asio::buffer(regions.second.data, regions.second.size) };
+    asio::buffer_copy(dest, src);
+
+    // release 发布，消费者 acquire 之后才能看到这批字节
+    ring_.commitWrite(len);
+    commitOffset_ += len;
+
+    notifyConsumer(); // 通知可以初始化了
+    return true;
+}
+
+void NetworkDownloader::waitForData(size_t requiredBytes) {
+    // 先无锁看一眼，大多数时候数据是够的
+    // seek 还没被 IO 线程应用时，旧位置的 isEnd 和数据都不算数
+    auto ready = [&] {
+        if (!active_.load(std::memory_order_acquire)) return true;
+        if (seekApplied_.load(std::memory_order_acquire) != seekRequested_.load(std::memory_order_relaxed)) return false;
+        return readableNow() >= requiredBytes || isEnd.load(std::memory_order_acquire);
+        };
+    if (ready()) return;
+
+    // 如果下载失败或 shutdown() 后没有触发通知，这个地方会永远卡住，所以带个超时兜底
+    std::unique_lock<std::mutex> lock(waitMutex_);
+    consumerWaiting_.store(true, std::memory_order_seq_cst);
+    while (!ready()) {
+        dataAvailable_.wait_for(lock, std::chrono::milliseconds(100));
+    }
+    consumerWaiting_.store(false, std::memory_order_relaxed);
+}
+
+void NetworkDownloader::notifyConsumer() {
+    // 和 waitForData 里的 store 配对：先发布数据再看有没有人在睡，消费者不睡就不碰锁
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumerWaiting_.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(waitMutex_);
+        dataAvailable_.notify_all();
+    }
+}
+
+void NetworkDownloader::drainStagedBlocks() {
+    while (!stagedBlocks_.empty()) {
+        auto it = stagedBlocks_.begin();
+        const size_t start = it->first;
+        const size_t end = start + it->second.size();
+        if (start > commitOffset_) {
+            break;
+        }
+
+        // seek 之后可能落在一块的中间，只要 commitOffset_ 之后的部分；整块都在前面的就扔掉
+        if (end > commitOffset_) {
+            const size_t skip = commitOffset_ - start;
+            const size_t len = end - commitOffset_;
+            if (!writeToRing(asio::buffer(it->second.data() + skip, len))) {
+                // 环形缓冲区满了，等消费者腾出这一块的地方再叫我们；有 socket 在往预留区读的话它读完会再来
+                const size_t ringFree = ring_.writeAvailable();
+                if (!ringReserved_) {
+                    parkProducer(ring_.readIndex() + (len > ringFree ? len - ringFree : 0));
                 }
-                else if (line.find("Transfer-Encoding: chunked") != std::string::npos) {
-                    self->httpResponse_.is_chunked = true;
+                break;
+            }
+        }
+        stagedBytes_ -= it->second.size();
+        stagedRanges_.erase(start, end);
+        stagedBlocks_.erase(it);
+    }
+}
+
+void NetworkDownloader::startSegmentWorkers() {
+    LOG_INFO("Segmented fetch: %zu connections for %zu bytes", segmentConnections_, rangeBlock_.total_length);
+    readAhead_.setConnections(segmentConnections_);
+    // 主连接自己算一条
+    for (size_t i = 1; i < segmentConnections_; ++i) {
+        auto worker = std::make_shared<SegmentFetcher>(shared_from_this(), ioContext_, sslContext_, parsedUrl_);
+        segmentWorkers_.push_back(worker);
+        worker->start();
+    }
+}
+
+void NetworkDownloader::stopSegmentWorkers() {
+    for (auto& worker : segmentWorkers_) {
+        worker->stop();
+    }
+    segmentWorkers_.clear();
+}
+
+void NetworkDownloader::disablePipeline(const char* reason) {
+    if (!pipelineSupported_) return;
+    LOG_WARN("HTTP pipelining disabled for %s: %s", parsedUrl_.host.c_str(), reason);
+    pipelineSupported_ = false;
+}
+
+void NetworkDownloader::retryCurrentBlock(const asio::error_code& ec) {
+    if (!active_) return;
+
+    // 挂着多个请求时连接断掉，多半是服务器不支持管线，退回到一问一答
+    if (inflightRanges_.size() > 1) {
+        disablePipeline(ec.message().c_str());
+    }
+    if (++reconnectRetries_ > MaxReconnectRetries_) {
+        LOG_ERROR("Range request failed %zu times, give up: %s", reconnectRetries_ - 1, ec.message().c_str());
+        shutdown();
+        return;
+    }
+    LOG_WARN("Connection lost (%s), reconnect and retry from %zu",
+        ec.message().c_str(), inflightRanges_.empty() ? rangeBlock_.range_start : inflightRanges_.front().first);
+    reconnect();
+}
+
+void NetworkDownloader::ParseHeaders() {
+    reading_ = true;
+    asio::async_read_until(*socket_, buffer_, "\r\n\r\n",
+        [self = shared_from_this(), stream = socket_, gen = connGeneration_](const asio::error_code& ec, size_t bytes_transferred) {
+            if (!self->active_ || gen != self->connGeneration_) return;
+            DEBUG_COUT << "准备解析头部，此时buffersize " << self->buffer_.size() << std::endl;
+            if (ec) {
+                if (!self->socket_->lowest_layer().is_open()) {
+                    std::cout << "连接关闭" << std::endl << std::endl;;
                 }
-                // 总长度
-                else if (line.find("Content-Range:") == 0) {
-                    self->httpResponse_.is_partial = true;
-
-                    // 直接定位到 '/' 符号提取 total_length
-                    size_t slashPos = line.find('/');
-                    if (slashPos != std::string::npos) {
-                        try {
-                            // 截取 '/' 后的部分并转换为数值
-                            std::string totalStr = line.substr(slashPos + 1);
-                            self->rangeBlock_.total_length = std::stoull(totalStr);
-                        }
-                        catch (const std::exception& e) {
-                            std::cerr << "Failed to parse Content-Range total_length: " << e.what() << std::endl;
-                        }
-                    }
+                std::cerr << "Read error (header): " << ec.message() << std::endl;
+                // 复用的连接在发请求和读响应之间被对端关掉，属于正常情况
+                self->retryCurrentBlock(ec);
+                return;
+            }
+
+            // 同一条连接上会连续解析多个响应，上一个的字段不能留着
+            parseResponseHead(self->buffer_, self->httpResponse_);
+            if (self->awaitingFirstByte_) {
+                self->readAhead_.onFirstByte(ReadAheadController::Clock::now() - self->mainBusySince_);
+                self->awaitingFirstByte_ = false;
+            }
+            if (self->httpResponse_.total_length != 0) {
+                self->rangeBlock_.total_length = self->httpResponse_.total_length;
+                if (self->diskCache_) {
+                    self->diskCache_->setTotalLength(self->httpResponse_.total_length);
                 }
             }
 
@@ -261,21 +960,103 @@ void NetworkDownloader::ParseHeaders() {
 
             // 接着处理 body（可能已经部分读入 buffer_）
             else if (self->httpResponse_.is_partial) {
+                // 响应和请求对不上，说明服务器没按顺序处理管线里的请求
+                if (!self->inflightRanges_.empty()
+                    && self->httpResponse_.range_start != self->inflightRanges_.front().first) {
+                    self->disablePipeline("response out of order");
+                    self->reconnect();
+                    return;
+                }
                 self->asyncReadRangeBody();
             }
+            // 请求越过了文件末尾
+            else if (self->httpResponse_.status_code == 416) {
+                LOG_INFO("Range not satisfiable, end of stream");
+                self->isEnd.store(true, std::memory_order_release);
+                self->notifyConsumer();
+            }
         });
 }
 
 void NetworkDownloader::checkSeekRange() {
-    // 检查是否有等待的seek请求
-    auto pending = pendingSeekPos_.load(std::memory_order_relaxed);
+    // 先取次数再取位置：取完之后消费者又 seek 的话次数对不上，下一次还会进来
+    const size_t requested = seekRequested_.load(std::memory_order_acquire);
+    if (requested == seekApplied_.load(std::memory_order_relaxed)) return;
+
+    auto pending = pendingSeekPos_.exchange(std::nullopt, std::memory_order_acq_rel);
     if (pending.has_value()) {
         // 应用seek
-        rangeBlock_.range_start = pending.value();
-        rangeBlock_.range_end = pending.value() + block_ - 1;
-        // 清除pending
-        pendingSeekPos_.store(std::nullopt, std::memory_order_relaxed);
+        const size_t pos = pending.value();
+        rangeBlock_.range_start = pos;
+        // 新位置要尽快出声，先从小块开始
+        readAhead_.restart();
+        prefetchThrottled_ = false;
+        producerParked_.store(false, std::memory_order_relaxed);   // applySeek 接着就会叫醒连接
+        rangeBlock_.resize(readAhead_.blockSize());
+        // 退回的块游标会重新领到；暂存块还是这个文件的数据，留着，drain 时只丢 seek 位置之前的
+        retryRanges_.clear();
+        commitOffset_ = pos;
+        isEnd.store(rangeBlock_.total_length != 0 && pos >= rangeBlock_.total_length, std::memory_order_release);
+
+        // 之后写进 ring_ 的字节从 seek 位置算起，这之前的下标留给消费者扔掉
+        const size_t head = ring_.writeIndex();
+        bufferStartOffset_.store(pos - head, std::memory_order_release);
+        seekStartIndex_.store(head, std::memory_order_release);
     }
+    seekApplied_.store(requested, std::memory_order_release);
+    notifyConsumer();
+}
+
+void NetworkDownloader::applySeek() {
+    if (!active_) return;
+    checkSeekRange();
+    // 暂存块里正好有 seek 位置的数据就直接入环，再叫醒连接补缺的部分（没连网络就先查磁盘缓存）
+    afterCommit();
+}
+
+bool NetworkDownloader::seek(size_t pos) {
+    if (seekApplied_.load(std::memory_order_acquire) == seekRequested_.load(std::memory_order_relaxed)) {
+        readableNow();
+        const size_t base = bufferStartOffset_.load(std::memory_order_acquire);
+        const size_t tail = ring_.readIndex();
+        const size_t readOffset = base + tail;
+
+        // 往后跳：目标已经下载到了，跳过中间的数据
+        if (pos >= readOffset && pos < readOffset + ring_.readAvailable()) {
+            ring_.commitRead(pos - readOffset);
+            maybeResumeProducer();
+            return true;
+        }
+        // 往回跳：刚读过的数据还没被覆盖，也没跨过上一次 seek
+        const size_t floorIndex = (std::max)(tail - ring_.rewindAvailable(), seekStartIndex_.load(std::memory_order_acquire));
+        if (pos < readOffset && pos >= base + floorIndex) {
+            ring_.rewindRead(readOffset - pos);
+            return true;
+        }
+    }
+
+    // 不在缓冲区里：旧位置的数据不要了，先腾出地方，再让 IO 线程从新位置开始供
+    LOG_DEBUG("Seek to %zu outside ring buffer", pos);
+    ring_.commitRead(ring_.readAvailable());
+    pendingSeekPos_.store(pos, std::memory_order_relaxed);
+    seekRequested_.fetch_add(1, std::memory_order_release);
+    asio::post(ioContext_, [self = shared_from_this()] {
+        self->applySeek();
+        });
+    return false;
+}
+
+size_t NetworkDownloader::readableNow() {
+    if (seekApplied_.load(std::memory_order_acquire) != seekRequested_.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+    // seek 应用之前 IO 线程写进来的都是旧位置的数据
+    const size_t start = seekStartIndex_.load(std::memory_order_acquire);
+    const size_t tail = ring_.readIndex();
+    if (tail < start) {
+        ring_.commitRead(start - tail);
+    }
+    return ring_.readAvailable();
 }
 
 void NetworkDownloader::startHeartbeat() {
@@ -307,34 +1088,43 @@ void NetworkDownloader::sendHeartbeat() {
         << "\r\n";  // 空请求体
 
     // 直接发送心跳请求
-    if (socket_.next_layer().is_open()) {
-        asio::write(socket_, asio::buffer(request.str()));
+    if (socket_->next_layer().is_open()) {
+        asio::write(*socket_, asio::buffer(request.str()));
     }
     else {
         DEBUG_CERR << "SSL Socket is not open!" << std::endl;
     }
 }
 
-void NetworkDownloader::asyncConnect(const tcp::resolver::results_type& endpoints) {
+void NetworkDownloader::asyncConnect(const DnsCache::Endpoints& endpoints) {
     LOG_INFO("Async connect...");
-    asio::async_connect(socket_.next_layer(), endpoints,
-        [self = shared_from_this()](const asio::error_code& ec, const tcp::endpoint&) {
+    asio::async_connect(socket_->next_layer(), endpoints,
+        [self = shared_from_this(), stream = socket_](const asio::error_code& ec, const tcp::endpoint& endpoint) {
+            auto& dns = NetworkDownloadMgr::getInstance().getDnsCache();
+            if (ec) {
+                // 缓存里的地址全都连不上，可能已经换了，下次重新解析
+                dns.invalidate(self->parsedUrl_.host, self->parsedUrl_.port);
+            }
             if (ec || !self->active_) {
                 std::cerr << "Connect failed: " << ec.message() << std::endl;
                 return;
             }
+            dns.reportConnected(self->parsedUrl_.host, self->parsedUrl_.port, endpoint);
             self->sslHandShake();
         });
 }
 
 void NetworkDownloader::sslHandShake() {
     LOG_INFO("SSL handShake...");
-    socket_.async_handshake(ssl::stream_base::client,
-        [self = shared_from_this()](const asio::error_code& ec) {
+    socket_->async_handshake(ssl::stream_base::client,
+        [self = shared_from_this(), stream = socket_](const asio::error_code& ec) {
             if (ec || !self->active_) {
                 std::cerr << "SSL Handshake failed: " << ec.message() << std::endl;
                 return;
             }
+            onTlsHandshakeDone(*stream);
+            self->connecting_ = false;
+            self->tlsReady_ = true;
             self->sendRangeRequest();
         });
 }
@@ -349,8 +1139,8 @@ void NetworkDownloader::sendHttpRequest() {
         "Connection: close\r\n\r\n"; // 短连接
 
     // 异步发送请求
-    asio::async_write(socket_, asio::buffer(request),
-        [self = shared_from_this()](const asio::error_code& ec, size_t /*bytes*/) {
+    asio::async_write(*socket_, asio::buffer(request),
+        [self = shared_from_this(), stream = socket_](const asio::error_code& ec, size_t /*bytes*/) {
             if (ec || !self->active_) {
                 std::cerr << "Send HTTP request failed: " << ec.message() << std::endl;
                 self->shutdown();
@@ -363,8 +1153,8 @@ void NetworkDownloader::sendHttpRequest() {
 
 void NetworkDownloader::asyncReadChunks(std::ofstream& file) {
     //  一次可能会从 socket 里读出很多数据（比如 512 字节）所以有/r/n就行，后面可能还有很多数据
-    asio::async_read_until(socket_, buffer_, "\r\n",
-        [self = shared_from_this(), &file](const asio::error_code& ec, size_t bytes_transferred) {
+    asio::async_read_until(*socket_, buffer_, "\r\n",
+        [self = shared_from_this(), stream = socket_, &file](const asio::error_code& ec, size_t bytes_transferred) {
             if (ec) {
                 std::cerr << "Read error (chunk size line): " << ec.message() << std::endl;
                 return;
@@ -407,8 +1197,8 @@ void NetworkDownloader::asyncReadChunkData(size_t chunk_size, std::ofstream& fil
     std::cout << "没读前buffer的大小 " << buffer_.size() << '\n';
     // 要求把 /r/n也读了，后面会丢弃
                             // 总共必须读取 n 字节（可能 buffer_ 里已存在）
-    asio::async_read(socket_, buffer_, asio::transfer_exactly(chunk_size + 2),
-        [self = shared_from_this(), chunk_size, &file](const asio::error_code& ec, size_t bytes_transferred) {
+    asio::async_read(*socket_, buffer_, asio::transfer_exactly(chunk_size + 2),
+        [self = shared_from_this(), stream = socket_, chunk_size, &file](const asio::error_code& ec, size_t bytes_transferred) {
 
             if (ec && ec != asio::error::eof) {
                 // 处理错误
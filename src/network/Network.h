@@ -7,17 +7,28 @@
 #include <chrono>
 #include <fstream>
 #include <unordered_set>
+#include <unordered_map>
+#include <deque>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <array>
 #include <string_view>
 #include <optional>
 #include <asio.hpp>
 #include <asio/ssl.hpp>
 #include "utils/Macros.h"
+#include "utils/SpscRingBuffer.h"
+#include "TlsSessionCache.h"
+#include "DnsCache.h"
+#include "RangeDiskCache.h"
+#include "ReadAheadController.h"
 #include "utils/Logger.h"
 using asio::ip::tcp;
 namespace ssl = asio::ssl;
 
 // 配置参数示例
-constexpr size_t MaxConnections = 4;       // 最大并行连接数
+constexpr size_t MaxConnections = 4;       // 最大并行连接数（单首歌分段下载）
 constexpr size_t MaxBufferSize = 16 * 1024 * 1024; // 16MB全局缓冲
 constexpr size_t ConnectionTTL = 5;      // 空闲连接保留时间
 
@@ -33,46 +44,72 @@ struct ParsedUrl {
 std::string extractHost(const std::string& url);
 ParsedUrl parseUrl(const std::string& url);
 
+// 新建的 TLS 流在握手前调用：设置 SNI，Mgr 里缓存过这个 host 的会话就带上去恢复
+bool prepareTlsStream(ssl::stream<tcp::socket>& stream, const std::string& host);
+// 握手成功后调用：统计会话恢复的命中情况
+void onTlsHandshakeDone(ssl::stream<tcp::socket>& stream);
+
 
 //--------------------- HTTP响应解析 ---------------------
 
-static constexpr size_t block_ = 1024 * 256; // 每次申请字节
 struct HttpResponse {
     std::string content_type;
     size_t content_length = 0;
+    size_t range_start = 0;     // Content-Range 的起点
+    size_t total_length = 0;    // Content-Range 里 '/' 后面的总长度
     int status_code = 0;
     bool is_chunked = false;
     bool is_partial = false;
+    bool keep_alive = true;     // 服务器没说 Connection: close 就继续复用这条连接
 
     // 重置函数
     void reset() {
         content_type.clear(); // 重置 std::string
         content_length = 0;
+        range_start = 0;
+        total_length = 0;
         status_code = 0;
         is_chunked = false;
         is_partial = false;
+        keep_alive = true;
     }
 };
 
+// 从 buffer 里解析一个响应头，body 留在 buffer 里
+void parseResponseHead(asio::streambuf& buffer, HttpResponse& response);
+
 struct RangeBlock {
     size_t range_start = 0;
-    size_t range_end = block_ - 1;
+    size_t range_end = ReadAheadController::MinBlock - 1;
     size_t content_length = 0;
     size_t total_length = 0;
+    size_t block_size = ReadAheadController::MinBlock;   // 每次申请字节，领块前按测速更新
 
     // 重置函数
     void reset() {
         range_start = 0;
-        range_end = block_ - 1;
+        block_size = ReadAheadController::MinBlock;
+        range_end = block_size - 1;
         content_length = 0;
         total_length = 0;
     }
 
+    // 按 block_size 重新算当前块的末尾
+    void resize(size_t size) {
+        block_size = size;
+        range_end = (std::min)(range_start + block_size - 1, total_length - 1);
+    }
+
     // 更新到下一块
     void moveToNextBlock() {
         content_length = range_end - range_start + 1;
         range_start = range_end + 1;
-        range_end = (std::min)(range_start + block_ - 1, total_length - 1);
+        range_end = (std::min)(range_start + block_size - 1, total_length - 1);
+    }
+
+    // 总长度已知且已经请求到末尾
+    bool isFinished() const {
+        return total_length != 0 && range_start >= total_length;
     }
 };
 
@@ -91,45 +128,77 @@ struct DummyLock {
 
 
 
+class SegmentFetcher;
+
 //改进的小“下载器”（支持连接复用）,被Source持有，相当于下载功能
 class NetworkDownloader : public std::enable_shared_from_this<NetworkDownloader> {
 public:
     NetworkDownloader(asio::io_context& io, ssl::context& ctx, const std::string& url);
     ~NetworkDownloader();   // 通知所有等待线程（避免死锁）
     size_t totalLength() { return rangeBlock_.total_length; }
-    bool isEndOfStream() { return isEnd; }
+    bool isEndOfStream() { return isEnd.load(std::memory_order_acquire); }
     bool matchHost(const std::string& url) { return parsedUrl_.host == extractHost(url); }
-    bool isReusable() const { return socket_.next_layer().is_open(); }  // 或更复杂策略，如状态标志
+    asio::io_context& ioContext() { return ioContext_; }  // 所在的 IO 线程
+    bool isReusable() const { return socket_->next_layer().is_open(); }  // 或更复杂策略，如状态标志
     void updateLastUsedTime() { lastUsed_ = std::chrono::steady_clock::now(); }
     std::chrono::steady_clock::time_point lastUsedTime() const { return lastUsed_; }
 
     void reset() {
         httpResponse_.reset();
         rangeBlock_.reset();
-        ringBuffer_.clear();
-        readPos_ = 0;
-        writePos_ = 0;
-        size_ = 0;
+        ring_.reset();
+        bufferStartOffset_ = 0;
+        seekStartIndex_ = 0;
+        commitOffset_ = 0;
     }
-    // 启动异步下载流程 DNS解析
+    // 连接池用：池子的 key 是 host:port
+    std::string poolKey() const { return parsedUrl_.host + ":" + parsedUrl_.port; }
+    size_t segmentConnections() const { return segmentConnections_; }
+    // 放回连接池前在 IO 线程上调：停掉分段连接，连接上没有没收完的响应才能给下一首歌用
+    bool detachForReuse();
+    // 从池子里取出来换一首歌（同一个 host）：只重置下载状态，socket 和 4MB 缓冲区都留着
+    // 只能在连接空闲（detachForReuse 返回 true 之后）时调用
+    void retarget(const std::string& url);
+    // 挂上这首歌的磁盘缓存，start() 之前调用；缓存里有的范围直接从本地读，网络下到的也会写进去
+    void attachDiskCache(std::shared_ptr<CachedTrack> track);
+    // 启动异步下载流程 DNS解析；从连接池复用、TLS 还连着的话直接发 Range 请求
     void start();
     void reconnect();
-    bool seek(size_t pos) {
-        // 有缓存的情况
-        if (bufferStartOffset_ < pos) {
-            readPos_ = pos;
-            return true;
-        }
-        
-        pendingSeekPos_.store(pos, std::memory_order_relaxed);
-        return false;
-    }
+    // 同一连接上同时挂着的 Range 请求数，1 表示不开管线，start() 之前设置
+    void setPipelineDepth(size_t depth) { pipelineDepth_ = (std::max)(depth, size_t{ 1 }); }
+    // 分段并行下载用的连接数（含主连接），1 表示只用主连接，最多 MaxConnections，start() 之前设置
+    void setSegmentConnections(size_t n) { segmentConnections_ = (std::clamp)(n, size_t{ 1 }, MaxConnections); }
+    // 预取用：只下到文件的 limit 字节为止（0 表示不限），start() 之前设置
+    void setFetchLimit(size_t limit) { fetchLimit_ = limit; }
+    // 真的要播了，取消限制接着往下下；任意线程都能调
+    void liftFetchLimit();
+    void stopSegmentWorkers();
+
+    // 多条连接共用的块调度：领一块 [start, end]，窗口满了或取完了返回 nullopt
+    std::optional<std::pair<size_t, size_t>> claimBlock();
+    // 没拿到响应的块退回去，谁先空闲谁重新领
+    void requeueBlock(size_t start, size_t end) { retryRanges_.emplace(start, end); }
+    // 交付 src 开头 len 字节，它们是文件偏移 offset 处的数据；按顺序写入环形缓冲区
+    void deliverBlock(size_t offset, asio::streambuf& src, size_t len);
+    // 零拷贝收包：offset 正好接得上且放得下时，预留 ring_ 的空闲区域给 socket 直接读进去
+    // 头部多读进 src 的那部分 body 会先搬过去并从 src 里消费掉，返回剩下要从 socket 读的区域
+    std::optional<std::array<asio::mutable_buffer, 2>> reserveRing(size_t offset, size_t len, asio::streambuf& src);
+    // 预留区域读完（ok）就发布给消费者，读失败或期间发生了 seek 就作废
+    void commitReserved(size_t offset, size_t len, bool ok);
+    // 组一条 Range 请求，主连接和分段连接共用
+    static void writeRangeRequest(std::ostream& os, const ParsedUrl& url, size_t start, size_t end);
+    // 消费者这一侧调用。目标还在环形缓冲区里（前面已下载的，或者刚读过、还没被覆盖的）就只挪读指针，返回 true
+    // 否则交给 IO 线程：暂存块和磁盘缓存里有的直接入环，只有缺的部分才发请求；在这之前 readBuffer 会等着
+    bool seek(size_t pos);
+    // 这首歌的码率（字节/秒），预读多远按它换算成秒数；任意线程都能调
+    void setTrackBitrate(double bytesPerSecond);
+    // 分段连接测到的数据也交给 readAhead_，和主连接的一起算
+    void recordFirstByte(ReadAheadController::Clock::duration elapsed) { readAhead_.onFirstByte(elapsed); }
+    void recordBlockDone(size_t bytes, ReadAheadController::Clock::duration elapsed) { readAhead_.onBlockDone(bytes, elapsed); }
+    ReadAheadController::Stats readAheadStats() const { return readAhead_.stats(); }   // 只在 IO 线程上看才准
     void waitUntilBuffered(size_t requiredBytes) {
         LOG_INFO("wait for buffer...");
-        std::unique_lock<std::mutex> lock(bufferMutex_);
-        dataAvailable_.wait(lock, [&]() {
-            return size_ >= requiredBytes;
-            });
+        waitForData(requiredBytes);
         LOG_INFO("CV awake ,buffered!");
 
     }
@@ -143,83 +212,46 @@ private:
         "Upgrade: none\r\n";          // 明确拒绝升级
 
     static constexpr size_t BufferCapacity_ = 4 * 1024 * 1024; // 4MB 缓冲区
-    static constexpr size_t BufferPrefetch_ = 2 * 1024 * 1024; // 2MB 预读
+    static constexpr size_t BufferHistory_ = 1024 * 1024;      // 其中 1MB 留着已读数据，往回 seek 几秒不用重新下载
+    static constexpr size_t BufferPrefetchMax_ = BufferCapacity_ - BufferHistory_; // 预读最多领先这么多，具体多少 readAhead_ 按码率定
+    static constexpr size_t MaxReconnectRetries_ = 3;          // 同一块连续重连的上限
+    static constexpr size_t DefaultPipelineDepth_ = 4;         // 默认管线深度
     void sendRangeRequest(); //start和end在rangeBlock里
     void ParseHeaders();
-    bool isStopPrefetch() const {
-        return size_ > BufferPrefetch_;
-    }
+    void onRangeBlockDone();                        // 一块读完：keep-alive 就直接发下一块的 Range 请求
+    void retryCurrentBlock(const asio::error_code& ec); // 连接被服务器关掉时，重连后重新请求当前块
+    void rewindToFirstPending();                    // 没收到响应的请求退回调度，从第一个没收到的块重新请求
+    void drainStagedBlocks();                       // 暂存块里接得上的部分搬进环形缓冲区
+    void afterCommit();                             // 入环之后：判断结束、叫醒空闲连接
+    bool writeToRing(asio::const_buffer src);
+    std::optional<std::pair<size_t, size_t>> nextBlock();  // 从游标或重试队列里取下一块，不管缓存
+    bool serveFromCache(std::pair<size_t, size_t>& range); // 缓存覆盖的前缀直接交付，range 缩成剩下的部分，全覆盖返回 true
+    bool deliverFromCache(size_t offset, size_t len);
+    void pumpCache();                               // 还没连网络时从磁盘缓存供数据，供不上了再去连
+    void connectNetwork();                          // DNS -> TCP -> TLS
+    void disablePipeline(const char* reason);       // 服务器不支持管线时退回一问一答
+    void startSegmentWorkers();                     // 第一块拿到 total_length 后开额外的分段连接
+    bool isStopPrefetch();                          // 领先消费者够多了就先不领新块，到低水位再恢复
+    void wakeFetchers();                            // 叫醒空闲的主连接和分段连接接着领块
+
+    // 背压：生产者停下来，记下消费者读到 ring_ 的哪个下标时再叫醒它；停着的时候不轮询
+    void parkProducer(size_t resumeIndex);
+    void resumeProducer();                          // IO 线程上：把暂存的搬进环，接着领块
+    void maybeResumeProducer();                     // 消费者读完一批之后看一眼，到了低水位就投递 resumeProducer
 
     
-    void asyncReadRangeBody() {
-        const size_t expected_size = rangeBlock_.content_length;
-
-        asio::async_read(socket_, buffer_, asio::transfer_exactly(expected_size),
-            [self = shared_from_this(), expected_size](const asio::error_code& ec, size_t bytes_transferred) {
-                if (ec && ec != asio::error::eof) {
-                    DEBUG_CERR << "读取 range 数据出错: " << ec.message() << std::endl;
-                    return;
-                }
-                DEBUG_COUT << "预期读取: " << expected_size << " 字节，实际读取: " << bytes_transferred << " 字节\n";
-                DEBUG_COUT << "读完后buffersize: " << self->buffer_.size() << "\n";
-
-                // 将数据写入环形缓冲区  {}限制锁的作用域 RAII  防止启动多个线程运行 io_context 线程安全
-                {
-                    //std::unique_lock<std::mutex> lock(self->bufferMutex_);
-                    
-                    //计算缓冲区当前可写入的空间
-                    size_t available = BufferCapacity_ - self->size_ - 1;
-
-                    if (expected_size > available) {
-                        // 缓冲区溢出处理
-                        std::cerr << "Buffer overflow!" << std::endl;
-                        return;
-                    }
-                    // 直接写入（无需绕到头部）
-                    if (self->writePos_ + expected_size <= BufferCapacity_) {
-                        std::copy(
-                            asio::buffers_begin(self->buffer_.data()),
-                            asio::buffers_end(self->buffer_.data()),
-                            self->ringBuffer_.begin() + self->writePos_ 
-                        );
-                    }
-                    // 分两段写入（尾部到末尾 + 头部剩余部分）
-                    else {
-                        size_t firstChunk = BufferCapacity_ - self->writePos_;
-                        std::copy(
-                            asio::buffers_begin(self->buffer_.data()),
-                            asio::buffers_begin(self->buffer_.data()) + firstChunk,
-                            self->ringBuffer_.begin() + self->writePos_); // 目标起始位置
-                        std::copy(
-                            asio::buffers_begin(self->buffer_.data()) + firstChunk,
-                            asio::buffers_begin(self->buffer_.data()) + expected_size,
-                            self->ringBuffer_.begin());                   // 目标起始位置
-                    }
-                    // 更新写的位置，当前位置是没有数据的
-                    self->writePos_ = (self->writePos_ + expected_size) % BufferCapacity_;
-                    //DEBUG_COUT << "writePos_ 位置 " << self->writePos_ << std::endl;
-
-                    self->size_ += expected_size;
-                }
-                    LOG_INFO("ringbuffer size_%zu",self->size_);
-                    self->dataAvailable_.notify_one(); // 通知可以初始化了
-
-                // 文件先不写
-                //file.write(reinterpret_cast<char*>(self->ringBuffer_.data()), expected_size);
-
-                self->buffer_.consume(expected_size); // 安全的，超过size也没事
-                //std::this_thread::sleep_for(std::chrono::milliseconds(7000));
-
-                self->reconnect();
-            });
-    }
+    void asyncReadRangeBody();
+    void readBodyIntoRing(size_t offset, size_t expected_size, std::array<asio::mutable_buffer, 2> dest);
 
     void checkSeekRange(); // 用于网络请求不同的range
+    void applySeek();      // seek() 投递过来的，应用之后接着供数据
+    size_t readableNow();  // 消费者用：seek 还没应用时为 0，应用了就先扔掉旧位置的数据
+    void stageBlock(size_t offset, std::vector<uint8_t> block);  // 接不上的块先放着
 
     void startHeartbeat();
     void sendHeartbeat();
 
-    void asyncConnect(const tcp::resolver::results_type& endpoints);// 尝试连接端点
+    void asyncConnect(const DnsCache::Endpoints& endpoints);// 尝试连接端点
     void sslHandShake(); // SSL握手
     void sendHttpRequest();
 
@@ -230,51 +262,28 @@ private:
 public:
     // 从缓冲区读取数据（供播放器调用）
     size_t readBuffer(void* dest, size_t requestSize) {
-        // 这个是为了防止decoder拉不到数据然后停下来
-        {
-            // 如果下载失败或 shutdown() 后没有触发 notify_one()，这个地方会永远卡住 可加入超时与退出机制
-            std::unique_lock<std::mutex> lock(bufferMutex_);
-            dataAvailable_.wait(lock, [&]() {
-                return size_ > 0;
-                });
-        }
-        // 计算可读数据量
-        size_t readSize = (std::min)(requestSize, size_);
-
-        // 执行拷贝
-        uint8_t* byteDest = static_cast<uint8_t*>(dest);  // 将 void* 转为 uint8_t*
-
-        if (readPos_ + readSize <= BufferCapacity_) {
-            std::copy(ringBuffer_.begin() + readPos_,
-                ringBuffer_.begin() + readPos_ + readSize,
-                byteDest);  // 拷贝数据到目标缓冲区
-        }
-        else {
-            size_t firstChunk = BufferCapacity_ - readPos_;
-            std::copy(ringBuffer_.begin() + readPos_,
-                ringBuffer_.end(),
-                byteDest);  // 拷贝第一部分数据
-            std::copy(ringBuffer_.begin(),
-                ringBuffer_.begin() + (readSize - firstChunk),
-                byteDest + firstChunk);  // 拷贝第二部分数据
-        }
-
-        readPos_ = (readPos_ + readSize) % BufferCapacity_;
-        size_ -= readSize;
+        // 这个是为了防止decoder拉不到数据然后停下来，流结束或者连接关掉也会醒
+        waitForData(1);
 
-        return readSize;
+        // 无锁读，实际读到多少就返回多少
+        const size_t n = ring_.read(static_cast<uint8_t*>(dest), requestSize);
+        maybeResumeProducer();
+        return n;
     }
 
+    // 环形缓冲区里还没被读走的字节数
+    size_t bufferedBytes() const { return ring_.readAvailable(); }
+
     // 关闭连接
     void shutdown() {
         std::cout << "~socket shut down!" << '\n';
-        //std::unique_lock<std::mutex> lock(bufferMutex_);
         active_ = false;
+        notifyConsumer();   // 别让读的一方一直等下去
         asio::error_code ec;
-        socket_.shutdown(ec); // 安全关闭SSL
+        socket_->shutdown(ec); // 安全关闭SSL
 
         // 2. 确保底层socket关闭
-        socket_.lowest_layer().close(ec);
+        socket_->lowest_layer().close(ec);
         if (ec) {
             std::cerr << "Socket close error:" << ec;
         }
@@ -284,8 +293,42 @@ private:
     friend class NetworkStreamSource;
     std::ofstream outFile;
     bool notFirstParse = false;             // 第一次解析，供初始化contextlength用
-    bool isEnd = false;                     // 标记流是否传输完了
+    std::atomic<bool> isEnd{ false };       // 标记流是否传输完了
+    size_t reconnectRetries_ = 0;           // 当前块已经重连的次数，成功读完一块就清零
+
+    // HTTP/1.1 管线：请求按顺序写出去，响应按同样顺序从 buffer_ 里一个接一个解析
+    std::deque<std::pair<size_t, size_t>> inflightRanges_;  // 已发出、还没读完响应的 [start, end]
+    size_t pipelineDepth_ = DefaultPipelineDepth_;
+    bool pipelineSupported_ = true;         // 出过乱序或断连就关掉
+    bool writing_ = false;                  // 有 async_write 在进行
+    bool reading_ = false;                  // 有响应正在解析
+    size_t connGeneration_ = 0;             // 每次 reconnect 加一，用来丢弃旧连接的回调
+    bool tlsReady_ = false;                 // 握手完成，可以发请求
+    bool connecting_ = false;               // 正在解析/连接/握手
+    std::shared_ptr<CachedTrack> diskCache_;    // 没开磁盘缓存时为空
+
+    // 分段并行下载：所有连接从 rangeBlock_ 领块，乱序到达的块暂存在 stagedBlocks_，按 commitOffset_ 顺序入环
+    size_t segmentConnections_ = 1;
+    size_t fetchLimit_ = 0;                 // 预取时只领到这里
+    std::vector<std::shared_ptr<SegmentFetcher>> segmentWorkers_;
+    std::set<std::pair<size_t, size_t>> retryRanges_;           // 退回来的块，优先重新领
+    std::map<size_t, std::vector<uint8_t>> stagedBlocks_;       // 文件偏移 -> 还接不上的块
+    IntervalSet stagedRanges_;              // 暂存块覆盖的文件范围，领块时跳过这些，seek 之后只补缺口
+    size_t stagedBytes_ = 0;
+    size_t commitOffset_ = 0;               // 环形缓冲区写入位置对应的文件偏移
+    bool ringReserved_ = false;             // 有 socket 正在直接往 ring_ 的空闲区域里读
+
+    // 测速和预读：主连接按 空闲->发请求->响应头->收完 计时，分段连接自己计时再报上来
+    ReadAheadController readAhead_;
+    ReadAheadController::Clock::time_point mainBusySince_{};   // 主连接这一块从什么时候开始算
+    bool awaitingFirstByte_ = false;        // 空闲后第一个请求的响应头还没回来，回来时记一次 RTT
+    bool prefetchThrottled_ = false;        // 领先够多停下来了
+    std::atomic<bool> producerParked_{ false };     // 生产者停着，等消费者叫
+    std::atomic<size_t> resumeReadIndex_{ 0 };      // 消费者的读下标到这里就叫醒生产者
     std::atomic<std::optional<size_t>> pendingSeekPos_; // C++17 optional，也可以自己用标志
+    std::atomic<size_t> seekRequested_{ 0 };    // 消费者发起的 seek 次数
+    std::atomic<size_t> seekApplied_{ 0 };      // IO 线程应用到第几次，和上面不等说明还有 seek 没生效
+    std::atomic<size_t> seekStartIndex_{ 0 };   // 最近一次 seek 应用时的写下标，之前的数据属于旧位置
 
     std::atomic<bool> isPaused_ = false;    // 控制readProc是否暂停
     std::mutex pauseMutex_;
@@ -295,7 +338,9 @@ private:
     // ASIO核心
     asio::io_context& ioContext_;
     ssl::context& sslContext_;
-    ssl::stream<tcp::socket> socket_;    //SSL/TLS 加密流，基于一个底层的 TCP 套接字（tcp::socket）
+    // SSL/TLS 加密流，基于一个底层的 TCP 套接字（tcp::socket）
+    // 重连时换成新的一个；挂着的异步操作的回调各自拿着一份，旧流要等它们都带着 operation_aborted 回来才析构
+    std::shared_ptr<ssl::stream<tcp::socket>> socket_;
     asio::streambuf buffer_;
 
     asio::steady_timer heartbeatTimer_;
@@ -304,17 +349,18 @@ private:
     ParsedUrl parsedUrl_;
     HttpResponse httpResponse_;
     RangeBlock rangeBlock_;
-    std::vector<uint8_t> ringBuffer_{}; // 在构造函数预分配 4MB 空间
+    SpscRingBuffer<uint8_t> ring_;      // 下载线程写、解码读，构造时预分配 4MB
 
-    size_t bufferStartOffset_ = 0;      // ringBuffer 中的起始位置（全局文件偏移）
-    size_t readPos_ = 0;                // 数据拿走的位置
-    size_t writePos_ = 0;               // 数据 通过async_read_some() 写入的为主
-    size_t size_ = 0;                   // 现有数据量
+    std::atomic<size_t> bufferStartOffset_{ 0 };    // ring_ 下标 0 对应的文件偏移，文件偏移 = 它 + 下标
     bool downloading_ = false;          // 得考虑好是不是下载本地文件
     std::chrono::steady_clock::time_point lastUsed_ = std::chrono::steady_clock::now();
 
-    LockType bufferMutex_;
+    // 数据本身走无锁环形缓冲区；这对锁和条件变量只用来让读空了的消费者睡一会
+    std::mutex waitMutex_;
     std::condition_variable dataAvailable_;
+    std::atomic<bool> consumerWaiting_{ false };
+    void waitForData(size_t requiredBytes);
+    void notifyConsumer();
     std::atomic<bool> active_{ true };  // 用来标记是不是活跃的连接，和空闲连接做区分，给Mgr优化用
 };
 
@@ -324,70 +370,229 @@ public:
     NetworkDownloadMgr(const NetworkDownloadMgr&) = delete;
     NetworkDownloadMgr& operator=(const NetworkDownloadMgr&) = delete;
     static NetworkDownloadMgr& getInstance() { static NetworkDownloadMgr instance; return instance; }
-    asio::io_context& getIoContext() { return ioContext_; }
+    // IO 线程数，0 表示按核数；只在第一次 getInstance() 之前设置才生效
+    static void setIoThreadCount(size_t n) { configuredIoThreads_ = n; }
+    asio::io_context& getIoContext() { return ioWorkers_[pickIoWorker()]->io; }  // 当前负载最轻的那个
     ssl::context& getSslContext() { return sslContext_; }// 获取 SSL 上下文
 
+    // TLS 会话恢复的命中/未命中次数，用来确认复用有没有生效
+    TlsSessionCache::Stats tlsSessionStats() const { return tlsSessions_.stats(); }
+    // 所有下载器共用的 DNS 缓存
+    DnsCache& getDnsCache() { return dnsCache_; }
+    DnsCache::Stats dnsCacheStats() const { return dnsCache_.stats(); }
+    // 下载范围的磁盘缓存，可以随时 configure 换目录和预算（目录为空就关掉）
+    RangeDiskCache& getDiskCache() { return diskCache_; }
+
+    // 调优用：IO 线程数，以及每个线程上正在跑的下载器数量
+    size_t ioThreadCount() const { return ioWorkers_.size(); }
+    std::vector<size_t> ioThreadLoads() const {
+        std::vector<size_t> loads;
+        for (const auto& worker : ioWorkers_) {
+            loads.push_back(worker->load.load(std::memory_order_relaxed));
+        }
+        return loads;
+    }
+
     // 核心接口：获取下载器（线程安全）
-    std::shared_ptr<NetworkDownloader> getDownloader(const std::string& url) {
+    // segmentConnections > 1 时，拿到总长度后会再开几条连接分段并行下载（最多 MaxConnections）
+    // 同一个 host 的连接总数不超过 MaxConnectionsPerHost，超出的分段连接会被砍掉
+    std::shared_ptr<NetworkDownloader> getDownloader(const std::string& url, size_t segmentConnections = 1) {
+        const ParsedUrl parsed = parseUrl(url);
 
         // 是否会异步地从多个线程提交任务？先加锁，，后续再看
         std::lock_guard lock(poolMutex_);
+        HostPool& pool = pools_[parsed.host + ":" + parsed.port];
+
+        // 这个 host 剩下的连接额度，主连接总是给的
+        const size_t used = pool.connections + pool.idle.size();
+        const size_t budget = used < MaxConnectionsPerHost ? MaxConnectionsPerHost - used : 0;
+        if (segmentConnections > 1 && budget < segmentConnections) {
+            LOG_WARN("Host %s connection limit reached, segments %zu -> %zu",
+                parsed.host.c_str(), segmentConnections, (std::max)(budget, size_t{ 1 }));
+            segmentConnections = (std::max)(budget, size_t{ 1 });
+        }
 
-        // 尝试复用连接
-        auto it = std::find_if(idleConnections_.begin(), idleConnections_.end(),
-            [&url](std::shared_ptr<NetworkDownloader>& conn) {
-
-                return conn->matchHost(url) && conn->isReusable();
-            });
-
-        if (it != idleConnections_.end()) {
-            auto& conn = *it;
-            idleConnections_.erase(it);
+        // 尝试复用连接：最近放回来的最可能还活着
+        if (!pool.idle.empty()) {
+            auto conn = std::move(pool.idle.back());
+            pool.idle.pop_back();
+            conn->retarget(url);
+            conn->attachDiskCache(diskCache_.open(url));
+            conn->setSegmentConnections(segmentConnections);
+            pool.connections += conn->segmentConnections();
             activeConnections_.insert(conn);
+            addLoad(conn->ioContext());  // 复用的连接留在原来的 IO 线程上
             return conn;
         }
 
-        // 创建新下载器
-        auto newConn = std::make_shared<NetworkDownloader>(ioContext_, sslContext_, url);
+        // 创建新下载器，挂到负载最轻的 IO 线程上；一个下载器的所有回调都在同一个线程里跑，不需要 strand
+        auto& worker = *ioWorkers_[pickIoWorker()];
+        auto newConn = std::make_shared<NetworkDownloader>(worker.io, sslContext_, url);
+        newConn->attachDiskCache(diskCache_.open(url));
+        newConn->setSegmentConnections(segmentConnections);
+        pool.connections += newConn->segmentConnections();
         activeConnections_.insert(newConn);
+        worker.load.fetch_add(1, std::memory_order_relaxed);
         return newConn;
     }
 
     // 释放下载器（线程安全）
+    // 连接状态只能在它自己的 IO 线程上看，所以先投递过去收拾干净，再决定进池子还是关掉
     void releaseDownloader(std::shared_ptr<NetworkDownloader> conn) {
-        std::lock_guard lock(poolMutex_);
+        {
+            std::lock_guard lock(poolMutex_);
+            if (!activeConnections_.erase(conn)) return;
+            removeLoad(conn->ioContext());
+        }
+
+        asio::post(conn->ioContext(), [this, conn] {
+            const bool reusable = conn->detachForReuse();
+
+            std::lock_guard lock(poolMutex_);
+            HostPool& pool = pools_[conn->poolKey()];
+            pool.connections -= (std::min)(pool.connections, conn->segmentConnections());
 
-        // erase(conn)将其从活跃集合中移除.如果直接调用close()。但此时连接可能还在activeConnections_中
-        if (activeConnections_.erase(conn)) {
-            if (conn->isReusable()) {
+            // 超过每个 host 的上限就不留了
+            if (reusable && running_ && pool.connections + pool.idle.size() < MaxConnectionsPerHost) {
                 conn->updateLastUsedTime(); // 更新时间
-                idleConnections_.push_front(conn);
+                pool.idle.push_back(conn);
             }
             else {
                 conn->shutdown();
             }
+            });
+    }
+
+    // 预取下一首：拿一个下载器（池子里有同 host 的热连接就直接用）先下前 bytes 字节
+    // 之前预取的另一首没被用上的话就放回去；同一首重复调不会重开
+    void prefetch(const std::string& url, size_t bytes) {
+        std::shared_ptr<NetworkDownloader> stale;
+        {
+            std::lock_guard lock(prefetchMutex_);
+            if (prefetched_ && prefetchUrl_ == url) return;
+            stale = std::move(prefetched_);
+        }
+        if (stale) {
+            releaseDownloader(stale);
         }
+
+        auto conn = getDownloader(url);
+        conn->setFetchLimit(bytes);
+        conn->start();
+        LOG_INFO("Prefetch %zu bytes of %s", bytes, url.c_str());
+
+        std::lock_guard lock(prefetchMutex_);
+        prefetchUrl_ = url;
+        prefetched_ = std::move(conn);
+    }
+
+    // 要播的正好是预取过的就拿走（已经 start 过，缓冲区里有数据），否则返回空
+    std::shared_ptr<NetworkDownloader> takePrefetched(const std::string& url) {
+        std::lock_guard lock(prefetchMutex_);
+        if (!prefetched_ || prefetchUrl_ != url) return nullptr;
+        auto conn = std::move(prefetched_);
+        prefetchUrl_.clear();
+        conn->liftFetchLimit();
+        return conn;
+    }
+
+    // 调优用：每个 host 的空闲连接数
+    std::vector<std::pair<std::string, size_t>> idleConnectionCounts() {
+        std::lock_guard lock(poolMutex_);
+        std::vector<std::pair<std::string, size_t>> counts;
+        for (const auto& [key, pool] : pools_) {
+            counts.emplace_back(key, pool.idle.size());
+        }
+        return counts;
     }
 
 private:
     // 用于清理空闲连接的时间
     static constexpr auto IDLE_TIMEOUT = std::chrono::seconds(30);
+    static constexpr auto REAP_INTERVAL = std::chrono::seconds(1);
+    static constexpr size_t MaxConnectionsPerHost = 6;   // 同一个 host 同时开的连接上限（含空闲和分段连接）
+    static constexpr size_t DefaultDiskCacheBudget = 512ull * 1024 * 1024;
+
+    // 每个 host 一个池子
+    struct HostPool {
+        std::vector<std::shared_ptr<NetworkDownloader>> idle;  // 空闲连接，尾部是最近放回来的
+        size_t connections = 0;     // 正在用的下载器占着的连接数（含分段连接）
+    };
 
-    // 清理过期连接 ,在构造函数中就调用，每隔1秒 
+    // 清理过期连接，由 reaper_ 定时器每秒调一次
     void cleanupExpiredConnections() {
         std::lock_guard lock(poolMutex_);
         auto now = std::chrono::steady_clock::now();
 
-        // 清理空闲连接（超过 IDLE_TIMEOUT 的连接）
-        idleConnections_.remove_if([now](const std::shared_ptr<NetworkDownloader>& conn) {
-            return (now - conn->lastUsedTime()) > IDLE_TIMEOUT;
+        // 清理空闲连接（超过 IDLE_TIMEOUT 的连接），关闭动作投递回各自的 IO 线程
+        for (auto it = pools_.begin(); it != pools_.end();) {
+            auto& idle = it->second.idle;
+            auto expired = std::stable_partition(idle.begin(), idle.end(),
+                [now](const std::shared_ptr<NetworkDownloader>& conn) {
+                    return (now - conn->lastUsedTime()) <= IDLE_TIMEOUT;
+                });
+            for (auto conn = expired; conn != idle.end(); ++conn) {
+                asio::post((*conn)->ioContext(), [c = std::move(*conn)] { c->shutdown(); });
+            }
+            idle.erase(expired, idle.end());
+
+            if (idle.empty() && it->second.connections == 0) {
+                it = pools_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    void scheduleReaper() {
+        reaper_->expires_after(REAP_INTERVAL);
+        reaper_->async_wait([this](const asio::error_code& ec) {
+            if (ec || !running_) return;
+            cleanupExpiredConnections();
+            scheduleReaper();
             });
     }
 
+    // 一个 IO 线程：独立的 io_context + 保活的 work guard
+    using ExecutorWorkGuard = asio::executor_work_guard<asio::io_context::executor_type>;
+    struct IoWorker {
+        asio::io_context io{ 1 };           // 只有一个线程跑它，告诉 asio 可以省掉内部的锁
+        ExecutorWorkGuard workGuard{ asio::make_work_guard(io) };  // 保持io一直运行，避免在没有任务时退出
+        std::thread thread;
+        std::atomic<size_t> load{ 0 };      // 分到这个线程上的活跃下载器数
+    };
+
+    // 负载最轻的 IO 线程下标
+    size_t pickIoWorker() const {
+        size_t best = 0;
+        for (size_t i = 1; i < ioWorkers_.size(); ++i) {
+            if (ioWorkers_[i]->load.load(std::memory_order_relaxed) < ioWorkers_[best]->load.load(std::memory_order_relaxed)) {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    IoWorker* workerOf(asio::io_context& io) {
+        for (auto& worker : ioWorkers_) {
+            if (&worker->io == &io) return worker.get();
+        }
+        return nullptr;
+    }
+    void addLoad(asio::io_context& io) {
+        if (auto* worker = workerOf(io)) {
+            worker->load.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    void removeLoad(asio::io_context& io) {
+        if (auto* worker = workerOf(io)) {
+            worker->load.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
     NetworkDownloadMgr()
-        : ioContext_(), 
-        sslContext_(ssl::context::tlsv12_client),
-        workGuard_(asio::make_work_guard(ioContext_)){
+        : sslContext_(ssl::context::tlsv12_client) {
         // 初始化 SSL 上下文
         SSL_CTX_set_options(sslContext_.native_handle(),
             SSL_OP_ALL | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
@@ -395,24 +600,39 @@ private:
         //sslContext_.set_verify_mode(ssl::verify_peer); // 必须添加
         sslContext_.set_default_verify_paths();
 
-        // 启动IO线程
-        ioThread_ = std::thread([this] {
-            ioContext_.run();
-            });
+        // 同一个 host 再次连接时恢复 TLS 会话
+        tlsSessions_.install(sslContext_.native_handle());
 
-        //// 启动连接清理线程 若其他线程操作可能不安全（当前有锁保护，但需确认）
-        //cleanupThread_ = std::thread([this] {
-        //    while (running_) {
-        //        cleanupExpiredConnections();
-        //        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-        //    }
-        //    });
+        // 默认把下载过的范围缓存到临时目录，重复播放不再走网络
+        std::error_code ec;
+        auto tmpDir = std::filesystem::temp_directory_path(ec);
+        if (!ec) {
+            diskCache_.configure(tmpDir / "MyTinyPlayer" / "range_cache", DefaultDiskCacheBudget);
+        }
+
+        // 启动IO线程，每个核一个 io_context，TLS 解密跟着连接分散到各个核上
+        size_t threads = configuredIoThreads_ ? configuredIoThreads_ : std::thread::hardware_concurrency();
+        threads = (std::max)(threads, size_t{ 1 });
+        for (size_t i = 0; i < threads; ++i) {
+            ioWorkers_.push_back(std::make_unique<IoWorker>());
+        }
+        for (auto& worker : ioWorkers_) {
+            worker->thread = std::thread([&io = worker->io] {
+                io.run();
+                });
+        }
+        LOG_INFO("NetworkDownloadMgr: %zu io threads", ioWorkers_.size());
 
+        // 空闲连接的清理挂在第一个 IO 线程上，不用单独开线程
+        reaper_ = std::make_unique<asio::steady_timer>(ioWorkers_.front()->io);
+        scheduleReaper();
     }
     ~NetworkDownloadMgr() {
         running_ = false;
-        workGuard_.reset(); // 允许io_context自然停止
-        ioContext_.stop();  // 取消所有未完成操作
+        for (auto& worker : ioWorkers_) {
+            worker->workGuard.reset(); // 允许io_context自然停止
+            worker->io.stop();         // 取消所有未完成操作
+        }
 
         // 清理 停止所有下载任务？保存不？？
         //如何确保所有异步操作都被正确取消？例如，
@@ -424,28 +644,32 @@ private:
         //    ioContext_会停止，因此ioThread_.join()应该能够正确结束
 
         //join清理线程。之后join ioThread_
-        
-        //cleanupThread_.join();
-        if (ioThread_.joinable()) ioThread_.join();
+        for (auto& worker : ioWorkers_) {
+            if (worker->thread.joinable()) worker->thread.join();
+        }
     }
 
 private:
 
     // ASIO核心
-    asio::io_context ioContext_;        // 共享的 io_context
-    ssl::context sslContext_;           // SSL 上下文
-    using ExecutorWorkGuard = asio::executor_work_guard<asio::io_context::executor_type>;
-    ExecutorWorkGuard workGuard_;       // 保持ioContext_一直运行，避免在没有任务时退出
+    TlsSessionCache tlsSessions_;       // 要比 sslContext_ 活得久，SSL_CTX 释放时还可能回调到它
+    ssl::context sslContext_;           // SSL 上下文，所有线程共用（OpenSSL 的 SSL_CTX 本身线程安全）
+    DnsCache dnsCache_;                 // 放在 ioWorkers_ 前面，IO 线程停下之后才析构
+    RangeDiskCache diskCache_;          // 要比连接池里的下载器活得久，它们析构时还会写索引
+    std::vector<std::unique_ptr<IoWorker>> ioWorkers_;  // IO 线程池，下载器按负载分到各个线程
+    static inline size_t configuredIoThreads_ = 0;
 
     // 线程控制
-    std::atomic<bool> running_{ true }; // 原子变量控制清理线程的运行
-    std::thread ioThread_;              /* 运行ioContext_的处理循环
-                                            可能成为性能瓶颈。如果下载任务很多，
-                                             单个IO线程可能无法处理所有请求，应考虑使用多个线程运行io_context*/
-    std::thread cleanupThread_;         // 定期清理空闲连接
+    std::atomic<bool> running_{ true }; // 析构时置 false，清理定时器不再续
+    std::unique_ptr<asio::steady_timer> reaper_;   // 定期清理空闲连接，要在 ioWorkers_ 之前析构
 
     // 连接池
     std::mutex poolMutex_; //保护连接池的访问
-    std::list<std::shared_ptr<NetworkDownloader>> idleConnections_;  // 空闲连接池
+    std::unordered_map<std::string, HostPool> pools_;  // host:port -> 空闲连接和连接计数
     std::unordered_set<std::shared_ptr<NetworkDownloader>> activeConnections_;  // 活跃连接池
+
+    // 预取的下一首，只留一个
+    std::mutex prefetchMutex_;
+    std::string prefetchUrl_;
+    std::shared_ptr<NetworkDownloader> prefetched_;
 };
@@ -0,0 +1,445 @@
+#include "RangeDiskCache.h"
+#include <vector>
+#include <cstring>
+#include "utils/Logger.h"
+#include "utils/FileSync.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char IndexMagic[8] = { 'M', 'T', 'P', 'R', 'C', '0', '0', '1' };
+
+uint64_t fnv1a(const uint8_t* data, size_t len) {
+    uint64_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+template <typename T>
+void put(std::vector<uint8_t>& out, T value) {
+    const auto* p = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+bool get(const std::vector<uint8_t>& in, size_t& pos, T& value) {
+    if (pos + sizeof(T) > in.size()) return false;
+    std::memcpy(&value, in.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+// 索引文件内容：魔数 | 总长度 | url | 区间个数 | 区间... | 前面所有字节的校验和
+struct IndexData {
+    std::string url;
+    size_t totalLength = 0;
+    IntervalSet ranges;
+};
+
+bool readIndexFile(const fs::path& path, IndexData& index) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (bytes.size() < sizeof(IndexMagic) + sizeof(uint64_t)) return false;
+
+    // 校验和对不上说明文件没写完整
+    uint64_t checksum = 0;
+    std::memcpy(&checksum, bytes.data() + bytes.size() - sizeof(uint64_t), sizeof(uint64_t));
+    bytes.resize(bytes.size() - sizeof(uint64_t));
+    if (checksum != fnv1a(bytes.data(), bytes.size())
+        || std::memcmp(bytes.data(), IndexMagic, sizeof(IndexMagic)) != 0) {
+        return false;
+    }
+
+    size_t pos = sizeof(IndexMagic);
+    uint64_t total = 0;
+    uint32_t urlLen = 0;
+    uint32_t count = 0;
+    if (!get(bytes, pos, total) || !get(bytes, pos, urlLen) || pos + urlLen > bytes.size()) return false;
+    index.totalLength = static_cast<size_t>(total);
+    index.url.assign(reinterpret_cast<const char*>(bytes.data() + pos), urlLen);
+    pos += urlLen;
+
+    if (!get(bytes, pos, count)) return false;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint64_t start = 0, end = 0;
+        if (!get(bytes, pos, start) || !get(bytes, pos, end)) return false;
+        index.ranges.add(static_cast<size_t>(start), static_cast<size_t>(end));
+    }
+    return true;
+}
+
+}
+
+//--------------------- CachedTrack ---------------------
+
+CachedTrack::CachedTrack(RangeDiskCache* owner, std::string key, std::string url,
+    fs::path dataPath, fs::path indexPath)
+    : owner_(owner),
+    key_(std::move(key)),
+    url_(std::move(url)),
+    dataPath_(std::move(dataPath)),
+    indexPath_(std::move(indexPath)) {
+
+    // 索引坏了或者是别的 url（哈希撞了）就整个重来
+    if (!loadIndex()) {
+        std::error_code ec;
+        fs::remove(indexPath_, ec);
+        fs::remove(dataPath_, ec);
+        ranges_.clear();
+        totalLength_ = 0;
+    }
+
+    // fstream 的 in|out 模式不会新建文件，先确保文件存在
+    if (!fs::exists(dataPath_)) {
+        std::ofstream create(dataPath_, std::ios::binary);
+    }
+    data_.open(dataPath_, std::ios::in | std::ios::out | std::ios::binary);
+    if (!data_.is_open()) {
+        LOG_WARN("Disk cache disabled for %s: cannot open %s", url_.c_str(), dataPath_.string().c_str());
+        broken_ = true;
+    }
+}
+
+CachedTrack::~CachedTrack() {
+    if (unflushedBytes_ > 0) {
+        flushIndex();
+    }
+}
+
+bool CachedTrack::loadIndex() {
+    IndexData index;
+    if (!readIndexFile(indexPath_, index) || index.url != url_) {
+        return false;
+    }
+
+    // 数据文件比索引说的短，说明数据文件被动过
+    std::error_code ec;
+    const auto dataSize = fs::file_size(dataPath_, ec);
+    if (ec || (!index.ranges.empty() && dataSize < index.ranges.intervals().rbegin()->second)) {
+        return false;
+    }
+    ranges_ = std::move(index.ranges);
+    totalLength_ = index.totalLength;
+    return true;
+}
+
+size_t CachedTrack::totalLength() const {
+    std::lock_guard lock(mutex_);
+    return totalLength_;
+}
+
+void CachedTrack::setTotalLength(size_t total) {
+    std::lock_guard lock(mutex_);
+    totalLength_ = total;
+}
+
+size_t CachedTrack::cachedBytes() const {
+    std::lock_guard lock(mutex_);
+    return ranges_.totalBytes();
+}
+
+size_t CachedTrack::cachedUntil(size_t offset) const {
+    std::lock_guard lock(mutex_);
+    return broken_ ? offset : ranges_.contiguousEnd(offset);
+}
+
+bool CachedTrack::read(size_t offset, uint8_t* dest, size_t len) {
+    std::lock_guard lock(mutex_);
+    if (broken_) return false;
+
+    data_.seekg(static_cast<std::streamoff>(offset));
+    data_.read(reinterpret_cast<char*>(dest), static_cast<std::streamsize>(len));
+    if (static_cast<size_t>(data_.gcount()) != len) {
+        LOG_WARN("Disk cache read failed at %zu for %s", offset, url_.c_str());
+        data_.clear();
+        broken_ = true;
+        return false;
+    }
+    return true;
+}
+
+fs::path CachedTrack::sidecarPath(const char* extension) const {
+    fs::path path = dataPath_;
+    path.replace_extension(extension);
+    return path;
+}
+
+void CachedTrack::writeLocked(size_t offset, const uint8_t* src, size_t len) {
+    if (broken_) return;
+
+    // 跳着写的地方操作系统会留成空洞，不占磁盘
+    data_.seekp(static_cast<std::streamoff>(offset));
+    data_.write(reinterpret_cast<const char*>(src), static_cast<std::streamsize>(len));
+    if (!data_) {
+        LOG_WARN("Disk cache write failed at %zu for %s", offset, url_.c_str());
+        data_.clear();
+        broken_ = true;
+    }
+}
+
+bool CachedTrack::commitLocked(size_t start, size_t end) {
+    if (broken_) return false;
+    ranges_.add(start, end);
+    unflushedBytes_ += end - start;
+    if (unflushedBytes_ < IndexFlushBytes || flushQueued_) return false;
+    flushQueued_ = true;
+    return true;
+}
+
+void CachedTrack::requestFlush() {
+    {
+        std::lock_guard lock(mutex_);
+        if (broken_ || unflushedBytes_ == 0 || flushQueued_) return;
+        flushQueued_ = true;
+    }
+    enqueueFlush();
+}
+
+void CachedTrack::enqueueFlush() {
+    owner_->scheduleFlush(weak_from_this());
+}
+
+void CachedTrack::flushIndex() {
+    std::lock_guard flushLock(flushMutex_);
+
+    // 锁里只把缓冲交给系统、抄一份范围；fsync 和 rename 都在锁外，下载和读缓存不用等它
+    IntervalSet ranges;
+    size_t totalLength = 0;
+    size_t flushing = 0;
+    bool broken = false;
+    {
+        std::lock_guard lock(mutex_);
+        flushQueued_ = false;
+        if (!broken_) {
+            data_.flush();
+            if (!data_) {
+                data_.clear();
+                broken_ = true;
+            }
+        }
+        broken = broken_;
+        ranges = ranges_;
+        totalLength = totalLength_;
+        flushing = unflushedBytes_;
+    }
+
+    if (!broken && writeIndexFile(ranges, totalLength)) {
+        // 这期间新写进来的还算没记进索引
+        std::lock_guard lock(mutex_);
+        unflushedBytes_ -= (std::min)(unflushedBytes_, flushing);
+    }
+    owner_->onTrackUpdated(key_, ranges.totalBytes());
+}
+
+bool CachedTrack::writeIndexFile(const IntervalSet& ranges, size_t totalLength) {
+    // 数据先真正落盘，索引才能说这些范围有了；只 flush 的话断电后索引里的范围可能还是空洞，读出来全是 0
+    if (!FileSync::syncFile(dataPath_)) {
+        return false;
+    }
+
+    std::vector<uint8_t> bytes(IndexMagic, IndexMagic + sizeof(IndexMagic));
+    put<uint64_t>(bytes, totalLength);
+    put<uint32_t>(bytes, static_cast<uint32_t>(url_.size()));
+    bytes.insert(bytes.end(), url_.begin(), url_.end());
+    put<uint32_t>(bytes, static_cast<uint32_t>(ranges.intervals().size()));
+    for (const auto& [start, end] : ranges.intervals()) {
+        put<uint64_t>(bytes, start);
+        put<uint64_t>(bytes, end);
+    }
+    put<uint64_t>(bytes, fnv1a(bytes.data(), bytes.size()));
+
+    // 写临时文件再整个换掉，旧索引要么完整保留要么被完整替换
+    fs::path tmpPath = indexPath_;
+    tmpPath += ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        out.close();
+        if (!out) {
+            LOG_WARN("Disk cache index write failed: %s", tmpPath.string().c_str());
+            return false;
+        }
+    }
+    // 临时索引也要先落盘再换过去，不然 rename 先落了盘、内容没落，换上去的是个空文件
+    std::error_code ec;
+    if (!FileSync::syncFile(tmpPath)) {
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+    fs::rename(tmpPath, indexPath_, ec);
+    if (ec) {
+        LOG_WARN("Disk cache index rename failed: %s", ec.message().c_str());
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+    FileSync::syncDirectory(indexPath_.parent_path());
+    return true;
+}
+
+//--------------------- RangeDiskCache ---------------------
+
+RangeDiskCache::~RangeDiskCache() {
+    {
+        std::lock_guard lock(flushQueueMutex_);
+        flusherRunning_ = false;
+    }
+    flushWakeup_.notify_all();
+    // 队列里剩下的后台线程退出前会做完
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+}
+
+void RangeDiskCache::configure(const fs::path& dir, size_t budgetBytes) {
+    std::lock_guard lock(mutex_);
+    dir_ = dir;
+    budget_ = budgetBytes;
+    totalBytes_ = 0;
+    catalog_.clear();
+    if (dir_.empty()) return;
+
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    if (ec) {
+        LOG_WARN("Disk cache disabled, cannot create %s: %s", dir_.string().c_str(), ec.message().c_str());
+        dir_.clear();
+        return;
+    }
+
+    {
+        std::lock_guard queueLock(flushQueueMutex_);
+        if (!flusherRunning_) {
+            flusherRunning_ = true;
+            flusher_ = std::thread(&RangeDiskCache::runFlusher, this);
+        }
+    }
+
+    // 把已有的缓存登记进来，顺便清掉上次崩溃留下的临时文件和没有索引的数据文件
+    for (const auto& file : fs::directory_iterator(dir_, ec)) {
+        const auto& path = file.path();
+        if (path.extension() == ".tmp") {
+            fs::remove(path, ec);
+            continue;
+        }
+        if (path.extension() != ".data") continue;
+
+        fs::path indexPath = path;
+        indexPath.replace_extension(".idx");
+        IndexData index;
+        if (!readIndexFile(indexPath, index)) {
+            removeFilesLocked(path.stem().string());
+            continue;
+        }
+        CatalogEntry& entry = catalog_[path.stem().string()];
+        entry.bytes = index.ranges.totalBytes();
+        entry.lastUse = fs::last_write_time(indexPath, ec);
+        totalBytes_ += entry.bytes;
+    }
+    LOG_INFO("Disk cache %s: %zu tracks, %zu bytes", dir_.string().c_str(), catalog_.size(), totalBytes_);
+    evictLocked();
+}
+
+std::shared_ptr<CachedTrack> RangeDiskCache::open(const std::string& url) {
+    std::lock_guard lock(mutex_);
+    if (dir_.empty()) return nullptr;
+
+    const std::string key = keyOf(url);
+    CatalogEntry& entry = catalog_[key];
+    if (auto track = entry.track.lock()) {
+        // 哈希撞了的极少数情况，这首就不缓存了
+        return track->url() == url ? track : nullptr;
+    }
+
+    auto track = std::make_shared<CachedTrack>(this, key, url, dir_ / (key + ".data"), dir_ / (key + ".idx"));
+    totalBytes_ = totalBytes_ - entry.bytes + track->cachedBytes();
+    entry.bytes = track->cachedBytes();
+    entry.lastUse = fs::file_time_type::clock::now();
+    entry.track = track;
+
+    // 索引的修改时间就是最近使用时间，重启之后 LRU 顺序还在
+    std::error_code ec;
+    fs::last_write_time(dir_ / (key + ".idx"), entry.lastUse, ec);
+    return track;
+}
+
+RangeDiskCache::Stats RangeDiskCache::stats() const {
+    std::lock_guard lock(mutex_);
+    return { catalog_.size(), totalBytes_, budget_ };
+}
+
+std::string RangeDiskCache::keyOf(const std::string& url) {
+    static constexpr char Hex[] = "0123456789abcdef";
+    uint64_t hash = fnv1a(reinterpret_cast<const uint8_t*>(url.data()), url.size());
+    std::string key(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        key[i] = Hex[hash & 0xF];
+        hash >>= 4;
+    }
+    return key;
+}
+
+void RangeDiskCache::onTrackUpdated(const std::string& key, size_t bytes) {
+    std::lock_guard lock(mutex_);
+    auto it = catalog_.find(key);
+    if (it == catalog_.end()) return;   // 中途 configure 换过目录
+
+    totalBytes_ = totalBytes_ - it->second.bytes + bytes;
+    it->second.bytes = bytes;
+    it->second.lastUse = fs::file_time_type::clock::now();
+    evictLocked();
+}
+
+void RangeDiskCache::scheduleFlush(std::weak_ptr<CachedTrack> track) {
+    {
+        std::lock_guard lock(flushQueueMutex_);
+        flushQueue_.push_back(std::move(track));
+    }
+    flushWakeup_.notify_one();
+}
+
+void RangeDiskCache::runFlusher() {
+    std::unique_lock lock(flushQueueMutex_);
+    while (true) {
+        flushWakeup_.wait(lock, [this] { return !flusherRunning_ || !flushQueue_.empty(); });
+        if (flushQueue_.empty()) break;     // 停了而且排着的都做完了
+        std::weak_ptr<CachedTrack> weak = std::move(flushQueue_.front());
+        flushQueue_.pop_front();
+        lock.unlock();
+        // 已经关掉的歌析构时自己写过索引了
+        if (auto track = weak.lock()) {
+            track->flushIndex();
+        }
+        lock.lock();
+    }
+}
+
+void RangeDiskCache::evictLocked() {
+    while (totalBytes_ > budget_) {
+        // 最久没用、而且现在没人打开的
+        auto victim = catalog_.end();
+        for (auto it = catalog_.begin(); it != catalog_.end(); ++it) {
+            if (!it->second.track.expired()) continue;
+            if (victim == catalog_.end() || it->second.lastUse < victim->second.lastUse) {
+                victim = it;
+            }
+        }
+        if (victim == catalog_.end()) break;   // 剩下的都在用，等关掉再说
+
+        LOG_INFO("Disk cache evict %s (%zu bytes)", victim->first.c_str(), victim->second.bytes);
+        removeFilesLocked(victim->first);
+        totalBytes_ -= victim->second.bytes;
+        catalog_.erase(victim);
+    }
+}
+
+void RangeDiskCache::removeFilesLocked(const std::string& key) {
+    std::error_code ec;
+    fs::remove(dir_ / (key + ".idx"), ec);
+    fs::remove(dir_ / (key + ".data"), ec);
+    fs::remove(dir_ / (key + ".seek"), ec);
+}
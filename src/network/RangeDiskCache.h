@@ -0,0 +1,140 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <filesystem>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <asio.hpp>
+#include "utils/IntervalSet.h"
+
+class RangeDiskCache;
+
+// 一首歌在磁盘上的缓存：稀疏数据文件 <key>.data 按文件偏移写，<key>.idx 记录哪些范围已经落盘
+// 索引总是先写临时文件再 rename 覆盖，进程中途崩掉最多丢掉最后一批范围，不会出现索引说有、数据却没写的情况
+// 更新索引要 fsync，慢；下载线程只管写数据，攒够了交给 RangeDiskCache 的后台线程去落盘
+class CachedTrack : public std::enable_shared_from_this<CachedTrack> {
+public:
+    CachedTrack(RangeDiskCache* owner, std::string key, std::string url,
+        std::filesystem::path dataPath, std::filesystem::path indexPath);
+    ~CachedTrack();     // 关闭时把还没记进索引的范围写进去
+
+    CachedTrack(const CachedTrack&) = delete;
+    CachedTrack& operator=(const CachedTrack&) = delete;
+
+    const std::string& url() const { return url_; }
+    size_t totalLength() const;
+    void setTotalLength(size_t total);
+    size_t cachedBytes() const;
+
+    // [offset, 返回值) 都在缓存里，offset 处没有缓存就返回 offset
+    size_t cachedUntil(size_t offset) const;
+    // 从缓存读 len 字节，调用前要确认 cachedUntil 覆盖了这段
+    bool read(size_t offset, uint8_t* dest, size_t len);
+
+    // 写入一段下载到的数据，buffers 里前 len 字节对应文件偏移 offset
+    template <typename ConstBufferSequence>
+    void write(size_t offset, const ConstBufferSequence& buffers, size_t len) {
+        bool needFlush = false;
+        {
+            std::lock_guard lock(mutex_);
+            if (broken_) return;
+            size_t pos = offset;
+            for (auto it = asio::buffer_sequence_begin(buffers); it != asio::buffer_sequence_end(buffers) && pos < offset + len; ++it) {
+                const asio::const_buffer b(*it);
+                const size_t n = (std::min)(b.size(), offset + len - pos);
+                writeLocked(pos, static_cast<const uint8_t*>(b.data()), n);
+                pos += n;
+            }
+            needFlush = commitLocked(offset, pos);
+        }
+        if (needFlush) {
+            enqueueFlush();
+        }
+    }
+
+    // 把新落盘的范围写进索引；会 fsync，别在 IO 线程上调
+    void flushIndex();
+    // 同上，排到后台线程上做，IO 线程上用这个
+    void requestFlush();
+
+    // 和这首歌的缓存放在一起的附属文件（比如跳转索引），淘汰时一起删
+    std::filesystem::path sidecarPath(const char* extension) const;
+
+private:
+    static constexpr size_t IndexFlushBytes = 1024 * 1024;  // 攒够这么多新数据就更新一次索引
+
+    bool loadIndex();
+    void writeLocked(size_t offset, const uint8_t* src, size_t len);
+    bool commitLocked(size_t start, size_t end);   // 返回要不要排一次索引更新
+    void enqueueFlush();            // 排到 owner_ 的后台线程上，flushQueued_ 调用方已经置好
+    // 同步数据文件、写临时索引、同步、换上去；不拿 mutex_，用的是抄出来的范围
+    bool writeIndexFile(const IntervalSet& ranges, size_t totalLength);
+
+    RangeDiskCache* owner_;
+    const std::string key_;
+    const std::string url_;
+    const std::filesystem::path dataPath_;
+    const std::filesystem::path indexPath_;
+
+    std::mutex flushMutex_;         // 索引更新一次只跑一个；同步、rename 的时候不拿 mutex_，读写不用等
+    mutable std::mutex mutex_;      // 同一个 url 可能被两个下载器同时打开（比如预取）
+    std::fstream data_;
+    IntervalSet ranges_;            // 已经写进数据文件的范围
+    size_t totalLength_ = 0;
+    size_t unflushedBytes_ = 0;     // 写进去了但还没记进索引的字节数
+    bool flushQueued_ = false;      // 已经排进后台队列了，别重复排
+    bool broken_ = false;           // 读写出过错就不再缓存，不影响播放
+};
+
+// 所有歌的磁盘缓存：按 url 的哈希分文件，总大小超过预算时按最近使用时间淘汰
+class RangeDiskCache {
+public:
+    struct Stats {
+        size_t tracks = 0;
+        size_t bytes = 0;
+        size_t budget = 0;
+    };
+
+    ~RangeDiskCache();
+
+    // 目录为空表示关掉磁盘缓存；会扫一遍目录里已有的索引
+    void configure(const std::filesystem::path& dir, size_t budgetBytes);
+    // 打开一首歌的缓存，同一个 url 同时只有一个 CachedTrack；没开缓存返回 nullptr
+    std::shared_ptr<CachedTrack> open(const std::string& url);
+    Stats stats() const;
+
+private:
+    friend class CachedTrack;
+
+    struct CatalogEntry {
+        size_t bytes = 0;
+        std::filesystem::file_time_type lastUse;
+        std::weak_ptr<CachedTrack> track;       // 正在用的不能淘汰
+    };
+
+    static std::string keyOf(const std::string& url);
+    void onTrackUpdated(const std::string& key, size_t bytes);
+    // 索引更新排到后台线程上做；歌先关掉了的话析构时自己会写
+    void scheduleFlush(std::weak_ptr<CachedTrack> track);
+    void runFlusher();
+    void evictLocked();
+    void removeFilesLocked(const std::string& key);
+
+    mutable std::mutex mutex_;
+    std::filesystem::path dir_;
+    size_t budget_ = 0;
+    size_t totalBytes_ = 0;
+    std::unordered_map<std::string, CatalogEntry> catalog_;
+
+    std::mutex flushQueueMutex_;
+    std::condition_variable flushWakeup_;
+    std::deque<std::weak_ptr<CachedTrack>> flushQueue_;
+    bool flusherRunning_ = false;
+    std::thread flusher_;           // 第一次 configure 到真目录时起
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <algorithm>
+
+// 按测到的带宽和 RTT 决定一个 Range 块要多大、预读领先消费者多远
+// - 刚开始或者 seek 之后先要小块，首字节来得快；之后每收完一块最多翻一倍，涨到一块大约要下 BlockSeconds 秒
+// - 预读按码率换算成秒数，网速只比码率快一点的话多攒一些，免得一抖就卡
+// 只在下载器所在的 IO 线程上用，不加锁
+class ReadAheadController {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t MinBlock = 64 * 1024;           // 首块和 seek 之后的第一块
+    static constexpr size_t MaxBlock = 1024 * 1024;         // 再大一块丢了重下的代价太高，也塞不进环形缓冲区的空闲部分
+    static constexpr size_t BlockAlign = 16 * 1024;
+    static constexpr double BlockSeconds = 0.5;             // 稳定之后一块大概下这么久
+    static constexpr double AheadSeconds = 20.0;            // 正常领先播放这么多秒
+    static constexpr double TightAheadSeconds = 60.0;       // 网速不到码率两倍时
+    static constexpr double DefaultBitrate = 40.0 * 1024;   // 不知道码率的时候按 320kbps 算，字节/秒
+
+    struct Stats {
+        double throughput = 0;  // 所有连接合计，字节/秒，还没测到为 0
+        double rtt = 0;         // 秒
+        size_t blockSize = MinBlock;
+    };
+
+    // 一条连接收完一块：elapsed 从请求发出（管线里是从上一块收完）算起，包含 RTT
+    void onBlockDone(size_t bytes, Clock::duration elapsed) {
+        const double seconds = std::chrono::duration<double>(elapsed).count();
+        // 响应早就躺在 buffer 里的话时间短得没意义
+        if (seconds < 0.001 || bytes == 0) return;
+        throughput_ = smooth(throughput_, bytes / seconds);
+
+        // 一块至少占几个 RTT，请求本身的开销才摊得开
+        const double target = throughput_ * (std::max)(BlockSeconds, 4 * rtt_);
+        const double grown = (std::min)(target, static_cast<double>(blockSize_) * 2);
+        blockSize_ = (std::clamp)(static_cast<size_t>(grown) / BlockAlign * BlockAlign, MinBlock, MaxBlock);
+    }
+
+    // 请求发出到响应头回来，近似一个 RTT（加上服务器处理时间）
+    void onFirstByte(Clock::duration elapsed) {
+        rtt_ = smooth(rtt_, std::chrono::duration<double>(elapsed).count());
+    }
+
+    // 测速是按单条连接算的，合计带宽要乘上连接数
+    void setConnections(size_t n) { connections_ = (std::max)(n, size_t{ 1 }); }
+    // 字节/秒，解码那边算出来告诉我们；0 表示不知道
+    void setBitrate(double bytesPerSecond) { bitrate_ = bytesPerSecond; }
+    // seek 之后从小块重新开始，测到的网速留着，涨起来很快
+    void restart() { blockSize_ = MinBlock; }
+
+    size_t blockSize() const { return blockSize_; }
+    double throughput() const { return throughput_ * connections_; }
+    double bitrate() const { return bitrate_ > 0 ? bitrate_ : DefaultBitrate; }
+
+    // 领先消费者多少字节就该停下；limit 是环形缓冲区能给的上限
+    size_t readAheadBytes(size_t limit) const {
+        const bool tight = throughput_ > 0 && throughput() < bitrate() * 2;
+        const double bytes = bitrate() * (tight ? TightAheadSeconds : AheadSeconds);
+        // 至少留两块的余量，不然刚领一块就停
+        const size_t floor = (std::min)(blockSize_ * 2, limit);
+        return (std::clamp)(static_cast<size_t>(bytes), floor, limit);
+    }
+
+    Stats stats() const { return { throughput(), rtt_, blockSize_ }; }
+
+private:
+    static constexpr double Alpha = 0.25;   // 新样本的权重
+
+    static double smooth(double current, double sample) {
+        return current > 0 ? current + Alpha * (sample - current) : sample;
+    }
+
+    double throughput_ = 0;     // 单条连接
+    double rtt_ = 0;
+    double bitrate_ = 0;
+    size_t connections_ = 1;
+    size_t blockSize_ = MinBlock;
+};
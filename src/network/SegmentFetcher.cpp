@@ -0,0 +1,229 @@
+#include "SegmentFetcher.h"
+#include "utils/Logger.h"
+
+// 同一块连续失败的上限，超过就这条连接就不干了，剩下的块主连接和其他连接会领走
+static constexpr size_t MaxSegmentRetries = 3;
+
+SegmentFetcher::SegmentFetcher(std::shared_ptr<NetworkDownloader> owner, asio::io_context& io,
+    ssl::context& ctx, const ParsedUrl& url)
+    : owner_(owner),
+    ioContext_(io),
+    sslContext_(ctx),
+    socket_(ioContext_, sslContext_),
+    parsedUrl_(url) {
+    prepareTlsStream(socket_, parsedUrl_.host);
+}
+
+void SegmentFetcher::start() {
+    if (stopped_) return;
+
+    NetworkDownloadMgr::getInstance().getDnsCache().asyncResolve(ioContext_, parsedUrl_.host, parsedUrl_.port,
+        [self = shared_from_this(), gen = connGeneration_](const asio::error_code& ec, const DnsCache::Endpoints& endpoints) {
+            if (self->stopped_ || gen != self->connGeneration_) return;
+            if (ec) {
+                self->fail(ec);
+                return;
+            }
+            self->asyncConnect(endpoints);
+        });
+}
+
+void SegmentFetcher::asyncConnect(const DnsCache::Endpoints& endpoints) {
+    asio::async_connect(socket_.next_layer(), endpoints,
+        [self = shared_from_this(), gen = connGeneration_](const asio::error_code& ec, const tcp::endpoint& endpoint) {
+            if (self->stopped_ || gen != self->connGeneration_) return;
+            auto& dns = NetworkDownloadMgr::getInstance().getDnsCache();
+            if (ec) {
+                dns.invalidate(self->parsedUrl_.host, self->parsedUrl_.port);
+                self->fail(ec);
+                return;
+            }
+            dns.reportConnected(self->parsedUrl_.host, self->parsedUrl_.port, endpoint);
+            self->sslHandShake();
+        });
+}
+
+void SegmentFetcher::sslHandShake() {
+    socket_.async_handshake(ssl::stream_base::client,
+        [self = shared_from_this(), gen = connGeneration_](const asio::error_code& ec) {
+            if (self->stopped_ || gen != self->connGeneration_) return;
+            if (ec) {
+                self->fail(ec);
+                return;
+            }
+            onTlsHandshakeDone(self->socket_);
+            self->connected_ = true;
+            self->fetchNext();
+        });
+}
+
+void SegmentFetcher::fetchNext() {
+    if (stopped_ || !connected_ || current_) return;
+
+    auto owner = owner_.lock();
+    if (!owner) {
+        stop();
+        return;
+    }
+    current_ = owner->claimBlock();
+    if (!current_) return;  // 窗口满了或者领完了，等主下载器再叫
+
+    std::ostringstream request;
+    NetworkDownloader::writeRangeRequest(request, parsedUrl_, current_->first, current_->second);
+
+    sentAt_ = ReadAheadController::Clock::now();
+    auto req = std::make_shared<std::string>(request.str());
+    asio::async_write(socket_, asio::buffer(*req),
+        [self = shared_from_this(), req, gen = connGeneration_](const asio::error_code& ec, size_t /*bytes*/) {
+            if (self->stopped_ || gen != self->connGeneration_) return;
+            if (ec) {
+                self->fail(ec);
+                return;
+            }
+            self->readHeaders();
+        });
+}
+
+void SegmentFetcher::readHeaders() {
+    asio::async_read_until(socket_, buffer_, "\r\n\r\n",
+        [self = shared_from_this(), gen = connGeneration_](const asio::error_code& ec, size_t /*bytes*/) {
+            if (self->stopped_ || gen != self->connGeneration_) return;
+            if (ec) {
+                self->fail(ec);
+                return;
+            }
+            parseResponseHead(self->buffer_, self->httpResponse_);
+
+            // 分段连接只认 206 且范围对得上的响应
+            if (!self->httpResponse_.is_partial || self->httpResponse_.range_start != self->current_->first) {
+                LOG_WARN("Segment response mismatch (status %d), drop this connection", self->httpResponse_.status_code);
+                self->retries_ = MaxSegmentRetries;
+                self->fail(asio::error::operation_not_supported);
+                return;
+            }
+            if (auto owner = self->owner_.lock()) {
+                owner->recordFirstByte(ReadAheadController::Clock::now() - self->sentAt_);
+            }
+            self->readBody();
+        });
+}
+
+void SegmentFetcher::readBody() {
+    const size_t expected_size = httpResponse_.content_length;
+    const size_t offset = current_->first;
+
+    // 这块刚好是主下载器下一块要的：直接读进它的环形缓冲区
+    if (auto owner = owner_.lock()) {
+        if (auto dest = owner->reserveRing(offset, expected_size, buffer_)) {
+            readBodyIntoRing(std::move(owner), offset, expected_size, *dest);
+            return;
+        }
+    }
+
+    const size_t already = (std::min)(buffer_.size(), expected_size);
+
+    asio::async_read(socket_, buffer_, asio::transfer_exactly(expected_size - already),
+        [self = shared_from_this(), expected_size, gen = connGeneration_](const asio::error_code& ec, size_t /*bytes*/) {
+            if (self->stopped_ || gen != self->connGeneration_) return;
+            if (ec && (ec != asio::error::eof || self->buffer_.size() < expected_size)) {
+                self->fail(ec);
+                return;
+            }
+
+            auto owner = self->owner_.lock();
+            if (!owner) {
+                self->stop();
+                return;
+            }
+            const size_t offset = self->current_->first;
+            const bool keepAlive = self->finishBlock(ec);
+            owner->deliverBlock(offset, self->buffer_, expected_size);
+            self->buffer_.consume(expected_size);
+            self->continueAfterBlock(keepAlive);
+        });
+}
+
+void SegmentFetcher::readBodyIntoRing(std::shared_ptr<NetworkDownloader> owner, size_t offset, size_t expected_size,
+    std::array<asio::mutable_buffer, 2> dest) {
+    const size_t remaining = asio::buffer_size(dest);
+
+    // socket 直接往主下载器的 ring_ 里写，读完之前主下载器不能析构：这里一直拿着强引用，平时只有 weak_ptr
+    asio::async_read(socket_, dest, asio::transfer_exactly(remaining),
+        [self = shared_from_this(), owner = std::move(owner), offset, expected_size, remaining, gen = connGeneration_](
+            const asio::error_code& ec, size_t bytes_transferred) {
+            // 不管成败都要把预留还回去
+            if (self->stopped_ || gen != self->connGeneration_
+                || (ec && (ec != asio::error::eof || bytes_transferred < remaining))) {
+                owner->commitReserved(offset, expected_size, false);
+                if (!self->stopped_ && gen == self->connGeneration_) {
+                    self->fail(ec);
+                }
+                return;
+            }
+
+            const bool keepAlive = self->finishBlock(ec);
+            owner->commitReserved(offset, expected_size, true);
+            self->continueAfterBlock(keepAlive);
+        });
+}
+
+bool SegmentFetcher::finishBlock(const asio::error_code& ec) {
+    current_.reset();
+    retries_ = 0;
+    if (auto owner = owner_.lock()) {
+        owner->recordBlockDone(httpResponse_.content_length, ReadAheadController::Clock::now() - sentAt_);
+    }
+
+    // 先把自己的连接状态收拾好，交付时主下载器会回头调 fetchNext
+    const bool keepAlive = httpResponse_.keep_alive && ec != asio::error::eof;
+    if (!keepAlive) {
+        connected_ = false;
+    }
+    return keepAlive;
+}
+
+void SegmentFetcher::continueAfterBlock(bool keepAlive) {
+    if (keepAlive) {
+        fetchNext();
+    }
+    else {
+        fail(asio::error::eof);
+    }
+}
+
+void SegmentFetcher::fail(const asio::error_code& ec) {
+    if (stopped_) return;
+
+    // 没取完的块还给调度
+    if (auto owner = owner_.lock(); owner && current_) {
+        owner->requeueBlock(current_->first, current_->second);
+    }
+    current_.reset();
+    connected_ = false;
+
+    // 服务器正常关连接不算失败
+    if (ec != asio::error::eof && ++retries_ > MaxSegmentRetries) {
+        LOG_WARN("Segment connection gave up: %s", ec.message().c_str());
+        stop();
+        return;
+    }
+
+    // 换条新连接
+    ++connGeneration_;
+    asio::error_code ignored;
+    socket_.lowest_layer().close(ignored);
+    buffer_.consume(buffer_.size());
+    socket_ = ssl::stream<tcp::socket>(ioContext_, sslContext_);
+    prepareTlsStream(socket_, parsedUrl_.host);
+    start();
+}
+
+void SegmentFetcher::stop() {
+    asio::post(ioContext_, [self = shared_from_this()] {
+        if (self->stopped_) return;
+        self->stopped_ = true;
+        self->connected_ = false;
+        asio::error_code ec;
+        self->socket_.lowest_layer().close(ec);
+        });
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "Network.h"
+
+// 分段下载的辅助连接：和主连接抢同一个块游标，拿到的数据交回 NetworkDownloader 按顺序入环
+// 跟主连接跑在同一个 io_context 上，调度状态不用加锁
+class SegmentFetcher : public std::enable_shared_from_this<SegmentFetcher> {
+public:
+    SegmentFetcher(std::shared_ptr<NetworkDownloader> owner, asio::io_context& io,
+        ssl::context& ctx, const ParsedUrl& url);
+
+    void start();       // DNS解析 -> 连接 -> 握手 -> 开始领块
+    void fetchNext();   // 空闲时领下一块，忙或者还没连上就什么都不做
+    void stop();        // 可以在任意线程调用，关闭动作投递回 io 线程
+
+private:
+    void asyncConnect(const DnsCache::Endpoints& endpoints);
+    void sslHandShake();
+    void readHeaders();
+    void readBody();
+    void readBodyIntoRing(std::shared_ptr<NetworkDownloader> owner, size_t offset, size_t expected_size,
+        std::array<asio::mutable_buffer, 2> dest);
+    bool finishBlock(const asio::error_code& ec);  // 一块收完，返回连接还能不能接着用
+    void continueAfterBlock(bool keepAlive);
+    void fail(const asio::error_code& ec);  // 当前块退回调度，换条连接重来
+
+    std::weak_ptr<NetworkDownloader> owner_;   // 主下载器持有我们，反过来只能是 weak
+    asio::io_context& ioContext_;
+    ssl::context& sslContext_;
+    ssl::stream<tcp::socket> socket_;
+    asio::streambuf buffer_;
+
+    ParsedUrl parsedUrl_;
+    HttpResponse httpResponse_;
+    std::optional<std::pair<size_t, size_t>> current_;   // 正在取的块
+    ReadAheadController::Clock::time_point sentAt_{};     // 当前块的请求什么时候发的，测速用
+
+    bool connected_ = false;
+    bool stopped_ = false;
+    size_t retries_ = 0;
+    size_t connGeneration_ = 0;
+};
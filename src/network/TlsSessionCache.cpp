@@ -0,0 +1,86 @@
+#include "TlsSessionCache.h"
+#include <ctime>
+#include "utils/Logger.h"
+
+TlsSessionCache::~TlsSessionCache() {
+    for (auto& [host, session] : sessions_) {
+        SSL_SESSION_free(session);
+    }
+}
+
+void TlsSessionCache::install(SSL_CTX* ctx) {
+    // 只做客户端缓存，OpenSSL 内部的表不用，会话全交给回调保存
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, &TlsSessionCache::onNewSession);
+    SSL_CTX_set_app_data(ctx, this);
+}
+
+TlsSessionCache* TlsSessionCache::fromSsl(SSL* ssl) {
+    return static_cast<TlsSessionCache*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+}
+
+int TlsSessionCache::onNewSession(SSL* ssl, SSL_SESSION* session) {
+    auto* cache = fromSsl(ssl);
+    // SNI 就是我们连的 host
+    const char* host = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    if (!cache || !host) {
+        return 0;   // 0：我们没留引用，OpenSSL 自己释放
+    }
+    cache->store(host, session);
+    return 1;       // 1：引用归我们了
+}
+
+void TlsSessionCache::store(const std::string& host, SSL_SESSION* session) {
+    std::lock_guard lock(mutex_);
+    auto it = sessions_.find(host);
+    if (it != sessions_.end()) {
+        SSL_SESSION_free(it->second);
+        it->second = session;
+        return;
+    }
+    if (sessions_.size() >= MaxEntries_) {
+        SSL_SESSION_free(sessions_.begin()->second);
+        sessions_.erase(sessions_.begin());
+    }
+    sessions_.emplace(host, session);
+}
+
+bool TlsSessionCache::resume(SSL* ssl, const std::string& host) {
+    std::lock_guard lock(mutex_);
+    auto it = sessions_.find(host);
+    if (it == sessions_.end()) {
+        return false;
+    }
+
+    // 过期或者不能再用的会话直接扔掉，免得白白多一次失败的恢复
+    SSL_SESSION* session = it->second;
+    // 3.3 起 SSL_SESSION_get_time 换成了返回 time_t 的 _ex 版本，老的 3.4 里标了弃用
+#if OPENSSL_VERSION_NUMBER >= 0x30300000L
+    const std::time_t created = SSL_SESSION_get_time_ex(session);
+#else
+    const std::time_t created = static_cast<std::time_t>(SSL_SESSION_get_time(session));
+#endif
+    const std::time_t expires = created + static_cast<std::time_t>(SSL_SESSION_get_timeout(session));
+    if (!SSL_SESSION_is_resumable(session) || expires <= std::time(nullptr)) {
+        SSL_SESSION_free(session);
+        sessions_.erase(it);
+        return false;
+    }
+
+    // SSL_set_session 自己会加引用，缓存里这份继续留着给别的连接用
+    return SSL_set_session(ssl, session) == 1;
+}
+
+void TlsSessionCache::recordHandshake(SSL* ssl) {
+    if (SSL_session_reused(ssl)) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+TlsSessionCache::Stats TlsSessionCache::stats() const {
+    std::lock_guard lock(mutex_);
+    return { hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed), sessions_.size() };
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <openssl/ssl.h>
+
+// 按 host 缓存 TLS 会话，同一个 CDN 再连的时候用 session ticket / session ID 恢复，省掉完整握手
+// 挂在 SSL_CTX 上：服务器发来新会话时由 OpenSSL 回调存进来（TLS1.3 的 ticket 是握手后才到的）
+class TlsSessionCache {
+public:
+    struct Stats {
+        size_t hits = 0;        // 握手时成功恢复的次数
+        size_t misses = 0;      // 做了完整握手的次数
+        size_t entries = 0;     // 当前缓存的 host 数
+    };
+
+    TlsSessionCache() = default;
+    ~TlsSessionCache();
+    TlsSessionCache(const TlsSessionCache&) = delete;
+    TlsSessionCache& operator=(const TlsSessionCache&) = delete;
+
+    // 在 SSL_CTX 上打开客户端会话缓存并注册回调，之后用这个 ctx 建的连接都会走这里
+    void install(SSL_CTX* ctx);
+
+    // 握手前调用：有这个 host 的会话就塞给 ssl，返回是否命中
+    bool resume(SSL* ssl, const std::string& host);
+    // 握手成功后调用：统计有没有真的恢复成功
+    void recordHandshake(SSL* ssl);
+
+    Stats stats() const;
+
+    // 从 SSL 反查挂在它 SSL_CTX 上的缓存，没装过就是 nullptr
+    static TlsSessionCache* fromSsl(SSL* ssl);
+
+private:
+    static int onNewSession(SSL* ssl, SSL_SESSION* session);
+    void store(const std::string& host, SSL_SESSION* session);
+
+    static constexpr size_t MaxEntries_ = 256;  // 够一个播放器用了，满了随便踢一个
+
+    mutable std::mutex mutex_;  // 多个 IO 线程会同时握手
+    std::unordered_map<std::string, SSL_SESSION*> sessions_;    // host -> 会话（持有一份引用）
+    std::atomic<size_t> hits_{ 0 };
+    std::atomic<size_t> misses_{ 0 };
+};
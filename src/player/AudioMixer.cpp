@@ -0,0 +1,309 @@
+#include "AudioMixer.h"
+#include <cstring>
+#include <algorithm>
+#include "utils/MixKernels.h"
+#include "utils/Logger.h"
+
+AudioMixer::Voice::~Voice() {
+    // 先停解码线程，源和转换器之后才能动
+    worker.reset();
+    if (convert) {
+        ma_data_converter_uninit(&converter, nullptr);
+    }
+}
+
+AudioMixer::AudioMixer(ma_format format, ma_uint32 channels, ma_uint32 sampleRate)
+    : format_(format),
+    channels_(channels),
+    sampleRate_(sampleRate),
+    frameBytes_(ma_get_bytes_per_frame(format, channels)),
+    commands_(CommandCapacity),
+    retired_(MaxVoices),
+    mixBuf_(static_cast<size_t>(ChunkFrames) * channels) {}
+
+AudioMixer::~AudioMixer() {
+    // 回调已经停了，声部全在 voices_ 里，直接析构
+    voices_.clear();
+}
+
+AudioMixer::VoiceId AudioMixer::add(std::unique_ptr<ImplAudioSource> src, float gain, ma_uint32 fadeMs, bool autoRemove) {
+    collect();
+    if (!src || !src->decoderInit_) {
+        LOG_ERROR("Mixer: source not ready");
+        return InvalidVoice;
+    }
+    if (voices_.size() >= MaxVoices) {
+        LOG_WARN("Mixer: too many voices (%zu)", voices_.size());
+        return InvalidVoice;
+    }
+
+    auto v = std::make_unique<Voice>();
+    v->id = nextId_++;
+    v->format = src->decoder_.outputFormat;
+    v->channels = src->decoder_.outputChannels;
+    v->sampleRate = src->decoder_.outputSampleRate;
+    v->autoRemove = autoRemove;
+    v->convert = v->channels != channels_ || v->sampleRate != sampleRate_;
+
+    // 回调里一段最多要这么多输入帧，重采样的话按比例多留一些
+    size_t rawFrames = ChunkFrames;
+    if (v->convert) {
+        ma_data_converter_config config = ma_data_converter_config_init(
+            v->format, ma_format_f32, v->channels, channels_, v->sampleRate, sampleRate_);
+        if (ma_data_converter_init(&config, nullptr, &v->converter) != MA_SUCCESS) {
+            LOG_ERROR("Mixer: converter init failed (%u ch %u Hz -> %u ch %u Hz)",
+                v->channels, v->sampleRate, channels_, sampleRate_);
+            v->convert = false;
+            return InvalidVoice;
+        }
+        rawFrames = static_cast<size_t>(ChunkFrames) * v->sampleRate / sampleRate_ + 16;
+    }
+    v->raw.resize(rawFrames * ma_get_bytes_per_frame(v->format, v->channels));
+    v->buf.resize(static_cast<size_t>(ChunkFrames) * channels_);
+
+    v->source = std::move(src);
+    v->worker = std::make_unique<DecodeWorker>(*v->source, v->format, v->channels, v->sampleRate);
+
+    const VoiceId id = v->id;
+    if (!push({ Command::Op::Add, v.get(), id, gain, msToFrames(fadeMs) })) {
+        return InvalidVoice;
+    }
+    voices_.push_back(std::move(v));
+    return id;
+}
+
+bool AudioMixer::setGain(VoiceId id, float gain, ma_uint32 rampMs) {
+    Voice* v = find(id);
+    if (!v || v->removing) return false;
+    return push({ Command::Op::Gain, nullptr, id, gain, msToFrames(rampMs) });
+}
+
+bool AudioMixer::remove(VoiceId id, ma_uint32 fadeMs) {
+    Voice* v = find(id);
+    if (!v || v->removing) return false;
+    if (!push({ Command::Op::Remove, nullptr, id, 0.f, msToFrames(fadeMs) })) return false;
+    v->removing = true;
+    return true;
+}
+
+size_t AudioMixer::collect() {
+    Voice* v = nullptr;
+    while (retired_.read(&v, 1) == 1) {
+        auto it = std::find_if(voices_.begin(), voices_.end(), [&](const auto& p) { return p.get() == v; });
+        if (it != voices_.end()) {
+            voices_.erase(it);
+        }
+    }
+    return voices_.size();
+}
+
+size_t AudioMixer::retiring() const {
+    return std::count_if(voices_.begin(), voices_.end(), [](const auto& v) { return v->removing; });
+}
+
+bool AudioMixer::replaceSource(VoiceId id, std::unique_ptr<ImplAudioSource>& src) {
+    Voice* v = find(id);
+    if (!v || v->removing || !src || !sameFormat(*v, *src)) return false;
+    v->worker->replaceSource(*src);
+    // replaceSource 返回之后解码线程不碰旧源和排队的源了
+    v->queued.reset();
+    v->source = std::move(src);
+    return true;
+}
+
+bool AudioMixer::queueNext(VoiceId id, std::unique_ptr<ImplAudioSource>& next) {
+    Voice* v = find(id);
+    if (!v || v->removing || v->queued || !next || !sameFormat(*v, *next)) return false;
+    if (!v->worker->queueNext(*next)) return false;
+    v->queued = std::move(next);
+    return true;
+}
+
+bool AudioMixer::advance(VoiceId id) {
+    Voice* v = find(id);
+    if (!v) return false;
+    const size_t changes = v->worker->trackChanges();
+    if (changes == v->handledChanges) return false;
+    v->handledChanges = changes;
+    // 换歌的位置没放到就被 seek/换源冲掉了的话，queued 已经清了
+    if (!v->queued) return false;
+    v->source = std::move(v->queued);
+    return true;
+}
+
+bool AudioMixer::finished(VoiceId id) const {
+    Voice* v = find(id);
+    return !v || v->worker->finished();
+}
+
+DecodeWorker* AudioMixer::worker(VoiceId id) const {
+    Voice* v = find(id);
+    return v ? v->worker.get() : nullptr;
+}
+
+ImplAudioSource* AudioMixer::source(VoiceId id) const {
+    Voice* v = find(id);
+    return v ? v->source.get() : nullptr;
+}
+
+bool AudioMixer::push(const Command& cmd) {
+    if (commands_.write(&cmd, 1) == 1) return true;
+    // 设备停着的时候回调不取命令，攒多了就丢
+    LOG_WARN("Mixer: command queue full, device stopped?");
+    return false;
+}
+
+AudioMixer::Voice* AudioMixer::find(VoiceId id) const {
+    for (const auto& v : voices_) {
+        if (v->id == id) return v.get();
+    }
+    return nullptr;
+}
+
+bool AudioMixer::sameFormat(const Voice& v, const ImplAudioSource& src) const {
+    return src.decoder_.outputFormat == v.format
+        && src.decoder_.outputChannels == v.channels
+        && src.decoder_.outputSampleRate == v.sampleRate;
+}
+
+//--------------------- 音频回调 ---------------------
+
+void AudioMixer::mix(void* output, ma_uint32 frameCount) {
+    applyCommands();
+
+    // 就一路还不用动它：和没有混音一样直接拷
+    if (activeCount_ == 1 && passthrough(*active_[0])) {
+        active_[0]->worker->pull(output, frameCount);
+        retireFinished();
+        return;
+    }
+
+    auto* out = static_cast<uint8_t*>(output);
+    while (frameCount > 0) {
+        const ma_uint32 frames = (std::min)(frameCount, ChunkFrames);
+        const size_t samples = static_cast<size_t>(frames) * channels_;
+        std::fill_n(mixBuf_.data(), samples, 0.f);
+        for (size_t i = 0; i < activeCount_; ++i) {
+            mixVoice(*active_[i], frames);
+        }
+
+        switch (format_) {
+        case ma_format_f32:
+            std::memcpy(out, mixBuf_.data(), samples * sizeof(float));
+            break;
+        case ma_format_s16:
+            MixKernels::f32ToS16(reinterpret_cast<int16_t*>(out), mixBuf_.data(), samples);
+            break;
+        default:
+            ma_pcm_convert(out, format_, mixBuf_.data(), ma_format_f32, samples, ma_dither_mode_none);
+            break;
+        }
+        out += static_cast<size_t>(frames) * frameBytes_;
+        frameCount -= frames;
+    }
+    retireFinished();
+}
+
+void AudioMixer::applyCommands() {
+    Command cmd;
+    while (commands_.read(&cmd, 1) == 1) {
+        if (cmd.op == Command::Op::Add) {
+            Voice* v = cmd.voice;
+            // 路数控制线程那边卡过了，这里一定放得下
+            active_[activeCount_++] = v;
+            v->gain = cmd.frames ? 0.f : cmd.gain;
+            rampTo(*v, cmd.gain, cmd.frames);
+            continue;
+        }
+
+        Voice* v = nullptr;
+        for (size_t i = 0; i < activeCount_; ++i) {
+            if (active_[i]->id == cmd.id) v = active_[i];
+        }
+        if (!v) continue;   // 已经自己放完退掉了
+        if (cmd.op == Command::Op::Gain) {
+            rampTo(*v, cmd.gain, cmd.frames);
+        }
+        else {
+            rampTo(*v, 0.f, cmd.frames);
+            v->retireAfterRamp = true;
+        }
+    }
+}
+
+void AudioMixer::rampTo(Voice& v, float gain, ma_uint32 frames) {
+    v.target = gain;
+    v.rampLeft = frames;
+    if (frames == 0) {
+        v.gain = gain;
+        v.step = 0.f;
+    }
+    else {
+        v.step = (gain - v.gain) / static_cast<float>(frames);
+    }
+}
+
+bool AudioMixer::passthrough(const Voice& v) const {
+    return !v.convert && v.format == format_ && v.rampLeft == 0 && v.gain == 1.f && !v.retireAfterRamp;
+}
+
+void AudioMixer::mixVoice(Voice& v, ma_uint32 frames) {
+    const size_t samples = static_cast<size_t>(frames) * channels_;
+    float* buf = v.buf.data();
+
+    // 先把这一路转成 f32、设备的声道数和采样率；不够的 pull 里已经补了静音
+    if (v.convert) {
+        ma_uint64 in = 0;
+        ma_data_converter_get_required_input_frame_count(&v.converter, frames, &in);
+        const size_t rawFrames = v.raw.size() / ma_get_bytes_per_frame(v.format, v.channels);
+        in = (std::min)(in, static_cast<ma_uint64>(rawFrames));
+        v.worker->pull(v.raw.data(), static_cast<ma_uint32>(in));
+        ma_uint64 outFrames = frames;
+        ma_data_converter_process_pcm_frames(&v.converter, v.raw.data(), &in, buf, &outFrames);
+        if (outFrames < frames) {
+            std::fill(buf + outFrames * channels_, buf + samples, 0.f);
+        }
+    }
+    else if (v.format == ma_format_f32) {
+        v.worker->pull(buf, frames);
+    }
+    else {
+        v.worker->pull(v.raw.data(), frames);
+        if (v.format == ma_format_s16) {
+            MixKernels::s16ToF32(buf, reinterpret_cast<const int16_t*>(v.raw.data()), samples);
+        }
+        else {
+            ma_pcm_convert(buf, ma_format_f32, v.raw.data(), v.format, samples, ma_dither_mode_none);
+        }
+    }
+
+    // 再按增益叠上去：渐变中的那段逐帧算，之后的用固定增益
+    ma_uint32 done = 0;
+    if (v.rampLeft > 0) {
+        done = (std::min)(v.rampLeft, frames);
+        v.gain = MixKernels::mixAddRamp(mixBuf_.data(), buf, done, channels_, v.gain, v.step);
+        v.rampLeft -= done;
+        if (v.rampLeft == 0) {
+            v.gain = v.target;
+        }
+    }
+    if (done < frames && v.gain != 0.f) {
+        const size_t offset = static_cast<size_t>(done) * channels_;
+        MixKernels::mixAdd(mixBuf_.data() + offset, buf + offset, samples - offset, v.gain);
+    }
+}
+
+void AudioMixer::retireFinished() {
+    for (size_t i = 0; i < activeCount_;) {
+        Voice* v = active_[i];
+        const bool faded = v->retireAfterRamp && v->rampLeft == 0;
+        const bool done = v->autoRemove && v->worker->finished();
+        if (!faded && !done) {
+            ++i;
+            continue;
+        }
+        // 声部总数不超过 MaxVoices，retired_ 一定放得下
+        retired_.write(&v, 1);
+        active_[i] = active_[--activeCount_];
+    }
+}
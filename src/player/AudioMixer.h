@@ -0,0 +1,121 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "miniaudio.h"
+#include "source/ImplAudioSource.h"
+#include "utils/SpscRingBuffer.h"
+#include "DecodeWorker.h"
+
+// 混音：几路源各自一个解码线程，回调里按各自的增益叠到一起再交给设备
+// 交叉淡入淡出、插播时把主音轨压低、边放边试听都靠它
+// - 格式和设备不一样的路（采样率、声道数）在回调里用 ma_data_converter 转过来，混音统一用 f32
+// - 增益变化都是按帧线性渐变，不会咔哒一声
+// - 控制线程和回调之间只走两个无锁队列：命令进去，放完的声部出来，回调里不等锁不分配内存
+// - 只有一路、格式一样、增益是 1 的时候直接从解码线程的环里拷，和没有混音一样
+class AudioMixer {
+public:
+    using VoiceId = uint32_t;
+    static constexpr VoiceId InvalidVoice = 0;
+    static constexpr size_t MaxVoices = 8;
+
+    // 设备的输出格式；混音本身按 f32 做，输出 s16 的话最后转一下
+    AudioMixer(ma_format format, ma_uint32 channels, ma_uint32 sampleRate);
+    // 设备必须已经停了，回调不会再进来
+    ~AudioMixer();
+
+    AudioMixer(const AudioMixer&) = delete;
+    AudioMixer& operator=(const AudioMixer&) = delete;
+
+    //--------------------- 控制线程 ---------------------
+    // 加一路，fadeMs 内从 0 渐到 gain；autoRemove 的放完自己退出（插播、试听），否则放完停在那等 remove
+    // 路数满了、源不能用返回 InvalidVoice，源随之析构
+    VoiceId add(std::unique_ptr<ImplAudioSource> src, float gain = 1.f, ma_uint32 fadeMs = 0, bool autoRemove = false);
+    bool setGain(VoiceId id, float gain, ma_uint32 rampMs);
+    // fadeMs 内渐到 0 再退出，之后 collect 才真正析构
+    bool remove(VoiceId id, ma_uint32 fadeMs);
+    // 回收回调已经不用的声部（解码线程、源、转换器），返回还剩几路
+    size_t collect();
+    // remove 了还没回收的路数，淡出期间的下载器还不能还
+    size_t retiring() const;
+
+    // 下面这些是给主音轨用的：在同一路里换源、排下一首（无缝），格式要和这一路一样，不一样返回 false 源原样不动
+    bool replaceSource(VoiceId id, std::unique_ptr<ImplAudioSource>& src);
+    bool queueNext(VoiceId id, std::unique_ptr<ImplAudioSource>& next);
+    // 回调放过了换歌的位置就把排队的源换上来，返回 true
+    bool advance(VoiceId id);
+    bool finished(VoiceId id) const;    // 放完了，或者这一路已经没了
+    DecodeWorker* worker(VoiceId id) const;
+    ImplAudioSource* source(VoiceId id) const;
+
+    //--------------------- 音频回调 ---------------------
+    void mix(void* output, ma_uint32 frameCount);
+
+private:
+    static constexpr ma_uint32 ChunkFrames = 1024;     // 回调一次要的多了就分几段混
+    static constexpr size_t CommandCapacity = 64;
+
+    struct Voice {
+        ~Voice();
+
+        VoiceId id = InvalidVoice;
+        std::unique_ptr<ImplAudioSource> source;
+        std::unique_ptr<ImplAudioSource> queued;    // 排队等无缝接上的下一首
+        std::unique_ptr<DecodeWorker> worker;       // 放在源后面，先于它们析构
+        ma_format format = ma_format_unknown;
+        ma_uint32 channels = 0;
+        ma_uint32 sampleRate = 0;
+        bool autoRemove = false;
+
+        // 控制线程这边
+        bool removing = false;
+        size_t handledChanges = 0;
+
+        // 回调这边
+        bool convert = false;           // 声道数或采样率和设备不一样
+        ma_data_converter converter{};
+        std::vector<uint8_t> raw;       // 从解码线程拉出来的原始格式
+        std::vector<float> buf;         // 转成 f32、设备声道数之后
+        float gain = 0.f;
+        float target = 0.f;
+        float step = 0.f;
+        ma_uint32 rampLeft = 0;
+        bool retireAfterRamp = false;
+    };
+
+    struct Command {
+        enum class Op : uint8_t { Add, Gain, Remove } op;
+        Voice* voice;       // 只有 Add 用；别的按 id 找，声部可能已经被回调退掉了
+        VoiceId id;
+        float gain;
+        ma_uint32 frames;
+    };
+
+    bool push(const Command& cmd);
+    Voice* find(VoiceId id) const;
+    bool sameFormat(const Voice& v, const ImplAudioSource& src) const;
+    ma_uint32 msToFrames(ma_uint32 ms) const { return static_cast<ma_uint32>(static_cast<uint64_t>(ms) * sampleRate_ / 1000); }
+
+    // 回调里用
+    void applyCommands();
+    void rampTo(Voice& v, float gain, ma_uint32 frames);
+    void mixVoice(Voice& v, ma_uint32 frames);
+    void retireFinished();
+    bool passthrough(const Voice& v) const;
+
+    const ma_format format_;
+    const ma_uint32 channels_;
+    const ma_uint32 sampleRate_;
+    const ma_uint32 frameBytes_;
+
+    // 控制线程持有所有声部，回调只拿指针；回调退掉的从 retired_ 还回来才析构
+    std::vector<std::unique_ptr<Voice>> voices_;
+    VoiceId nextId_ = 1;
+    SpscRingBuffer<Command> commands_;
+    SpscRingBuffer<Voice*> retired_;
+
+    // 回调这边
+    Voice* active_[MaxVoices] = {};
+    size_t activeCount_ = 0;
+    std::vector<float> mixBuf_;
+};
@@ -1,6 +1,10 @@
 #include "AudioPlayer.h"
 #include "utils/Logger.h"
 bool AudioPlayer::setSource(std::unique_ptr<ImplAudioSource> src) {
+    // 格式一样：设备接着跑，解码线程丢掉旧数据换源，切歌不用等设备重开
+    if (deviceInit_ && mixer_ && mixer_->replaceSource(mainVoice_, src)) {
+        return true;
+    }
 
     // 停止当前设备
     if (ma_device_is_started(&device_)) {
@@ -12,13 +16,14 @@ bool AudioPlayer::setSource(std::unique_ptr<ImplAudioSource> src) {
         deviceInit_ = false;
     }
 
-    // 设置新的音频源
-    source_ = std::move(src);
+    // 旧的解码线程还拿着旧源，连同淡出、插播的一起停掉
+    mixer_.reset();
+    mainVoice_ = AudioMixer::InvalidVoice;
 
     // 配置播放设备
-    ma_format  format_ = source_->decoder_.outputFormat;
-    ma_uint32  channels_ = source_->decoder_.outputChannels;
-    ma_uint32  sampleRate_ = source_->decoder_.outputSampleRate;
+    ma_format  format_ = src->decoder_.outputFormat;
+    ma_uint32  channels_ = src->decoder_.outputChannels;
+    ma_uint32  sampleRate_ = src->decoder_.outputSampleRate;
 
     ma_device_config deviceConfig = ma_device_config_init(ma_device_type_playback);
     deviceConfig.playback.format = format_;
@@ -35,9 +40,45 @@ bool AudioPlayer::setSource(std::unique_ptr<ImplAudioSource> src) {
 
     // 一定要在这里标记，以防万一前面出错然后错误标记
     deviceInit_ = true;
+    deviceSampleRate_ = sampleRate_;
+
+    // 解码放到单独的线程，先解一段垫着，回调里只拷贝；只有一路的时候混音器直接透传
+    mixer_ = std::make_unique<AudioMixer>(format_, channels_, sampleRate_);
+    mainVoice_ = mixer_->add(std::move(src));
+    return mainVoice_ != AudioMixer::InvalidVoice;
+}
+
+bool AudioPlayer::queueNext(std::unique_ptr<ImplAudioSource>& next) {
+    return mixer_ && mixer_->queueNext(mainVoice_, next);
+}
+
+bool AudioPlayer::advance() {
+    if (!mixer_) return false;
+    mixer_->collect();
+    // 解码线程早就在解新源了，旧源没人用
+    return mixer_->advance(mainVoice_);
+}
+
+bool AudioPlayer::crossfadeTo(std::unique_ptr<ImplAudioSource> src, ma_uint32 fadeMs) {
+    if (!deviceInit_ || !mixer_) {
+        return setSource(std::move(src));
+    }
+    const AudioMixer::VoiceId id = mixer_->add(std::move(src), 1.f, fadeMs);
+    if (id == AudioMixer::InvalidVoice) return false;
+    // 旧的连同排着的下一首一起淡出，淡完回调把它还回来，advance 里回收
+    mixer_->remove(mainVoice_, fadeMs);
+    mainVoice_ = id;
     return true;
 }
 
+AudioMixer::VoiceId AudioPlayer::overlay(std::unique_ptr<ImplAudioSource> src, float gain, ma_uint32 fadeMs) {
+    if (!deviceInit_ || !mixer_) {
+        LOG_WARN("overlay: device not initialized");
+        return AudioMixer::InvalidVoice;
+    }
+    return mixer_->add(std::move(src), gain, fadeMs, true);
+}
+
 void AudioPlayer::play() {
     // 检查设备和解码器是否已初始化
     if (!deviceInit_) {
@@ -83,36 +124,24 @@ void AudioPlayer::stop() {
         ma_device_stop(&device_);
     }
 
-    // 解码器和资源校验
-    if (source_) {
-        source_->seek(0);
+    // 解码器和资源校验，seek 交给解码线程做
+    if (DecodeWorker* worker = mainWorker()) {
+        worker->seek(0);
     }
     else {
         LOG_WARN("警告：解码器或资源未初始化");
     }
 
-    currentFrame_ = 0;
     LOG_INFO("已停止");
 }
 
 void AudioPlayer::data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
     // 从传进去的this指针里取出来
     auto* player = reinterpret_cast<AudioPlayer*>(pDevice->pUserData);
-    if (player->source_) {
-        // 加锁确保线程安全（如果在别处修改 source_）
-        //std::lock_guard<std::mutex> lock(player->mutex_);
-
-        if (player->source_) {                              // 神人私有成员竟然能被访问
-            auto framesRead = player->source_->read(pOutput, nullptr, frameCount);
-            // 跳转的话这个得改
-            player->currentFrame_ += framesRead;
-  
-            //// 若读取不足，补 0（避免杂音）
-            //if (framesRead < frameCount) {
-            //    uint8_t* outputBytes = reinterpret_cast<uint8_t*>(pOutput);
-            //    std::memset(outputBytes + framesRead * ma_get_bytes_per_frame(player->format_, player->channels_),
-            //        0,(frameCount - framesRead) * ma_get_bytes_per_frame(player->format_, player->channels_));
-            //}
-        }
+
+    // 实时线程：只从解码线程准备好的 PCM 里拷，不够的 pull 里补静音，不等锁也不打日志
+    // setSource 要重建 mixer_ 之前会先停设备，别的改动都走混音器的命令队列，这里不用加锁
+    if (player->mixer_) {
+        player->mixer_->mix(pOutput, frameCount);
     }
 }
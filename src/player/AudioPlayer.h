@@ -1,36 +1,57 @@
 #pragma once
 #include <memory>
 #include <mutex>
+#include <atomic>
 #include "miniaudio.h"
 #include "source/ImplAudioSource.h"
+#include "AudioMixer.h"
 
 class AudioPlayer {
 public:
     AudioPlayer() { ma_context_init(NULL, 0, NULL, &context_); }
     ~AudioPlayer() { ma_device_uninit(&device_); ma_context_uninit(&context_); }
+    // 格式和当前设备一样就不重开设备，只让解码线程换源
     bool setSource(std::unique_ptr<ImplAudioSource> src);
+    // 当前这首放完无缝接上 next；格式和设备不一样（要重开设备）或者已经排了一首就返回 false，src 原样不动
+    bool queueNext(std::unique_ptr<ImplAudioSource>& next);
+    // 控制线程定时调：回调放过了换歌的位置就把排队的源换成当前源，返回 true；顺便回收淡出完的声部
+    bool advance();
+    // 当前这首 fadeMs 内淡出，src 同时淡入成为新的当前源；格式不一样的在回调里重采样
+    bool crossfadeTo(std::unique_ptr<ImplAudioSource> src, ma_uint32 fadeMs);
+    // 叠一路在当前这首上面（插播、试听），放完自己退出；设备还没开返回 InvalidVoice
+    AudioMixer::VoiceId overlay(std::unique_ptr<ImplAudioSource> src, float gain = 1.f, ma_uint32 fadeMs = 0);
+    void removeOverlay(AudioMixer::VoiceId id, ma_uint32 fadeMs) { if (mixer_) mixer_->remove(id, fadeMs); }
+    // 把当前这首压到 gain（插播的时候），rampMs 内渐变过去；放完插播再 duck(1, ...) 回来
+    void duck(float gain, ma_uint32 rampMs) { if (mixer_) mixer_->setGain(mainVoice_, gain, rampMs); }
+    // 还有淡出没结束的，它们的下载器还不能还
+    bool fading() const { return mixer_ && mixer_->retiring() > 0; }
     void play();    
     void pause();  
     void stop();    //  put frame=0 安全校验
 
     //  t * samplerates不太准，percent*totalFrames好一点
-    void seek(float percent) { if (source_)source_->seek(percent); }
-    double getCurrentTime() const { return static_cast<double>(currentFrame_); }
-    AudioSourceType SourceType() const { return source_->SourceType(); }
+    void seek(float percent) { if (DecodeWorker* w = mainWorker()) w->seek(percent); }
+    double getCurrentTime() const { const DecodeWorker* w = mainWorker(); return w ? static_cast<double>(w->playedFrames()) : 0.0; }
+    double playedSeconds() const { return deviceSampleRate_ ? getCurrentTime() / deviceSampleRate_ : 0.0; }
+    AudioSourceType SourceType() const { return mixer_->source(mainVoice_)->SourceType(); }
+    bool isPlaying() { return deviceInit_ && ma_device_is_started(&device_); }
+    bool finished() const { return mixer_ && mixer_->finished(mainVoice_); }     // 放完了也没有排下一首
 
 private:
     static void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+    DecodeWorker* mainWorker() const { return mixer_ ? mixer_->worker(mainVoice_) : nullptr; }
 
 private:
     //  唯一设备成员
     ma_context context_;
     ma_device device_{};
 
-    // 持有资源
-    std::unique_ptr<ImplAudioSource> source_;
+    // 所有的源都挂在混音器上，当前这首是 mainVoice_；回调只从混音器拿数据
+    std::unique_ptr<AudioMixer> mixer_;
+    AudioMixer::VoiceId mainVoice_ = AudioMixer::InvalidVoice;
     std::mutex mutex_;
 
     // 变量的track，便于内部调用
     bool deviceInit_ = false;
-    ma_uint64 currentFrame_{};
+    ma_uint32 deviceSampleRate_ = 0;    // 设备的采样率，换算播放时间用
 };
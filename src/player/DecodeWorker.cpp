@@ -0,0 +1,230 @@
+#include "DecodeWorker.h"
+#include <cstring>
+#include <algorithm>
+#include "source/ImplAudioSource.h"
+#include "utils/Logger.h"
+
+DecodeWorker::DecodeWorker(ImplAudioSource& source, ma_format format, ma_uint32 channels, ma_uint32 sampleRate,
+    ma_uint32 bufferMs)
+    : source_(&source),
+    frameBytes_(ma_get_bytes_per_frame(format, channels)),
+    pollInterval_((std::max)(bufferMs / 4, 5u)),
+    ring_(static_cast<size_t>(sampleRate) * bufferMs / 1000 * frameBytes_),
+    scratch_(static_cast<size_t>(ChunkFrames) * frameBytes_) {
+    playedFrames_ = startFrameOf(source);
+    thread_ = std::thread(&DecodeWorker::run, this);
+}
+
+DecodeWorker::~DecodeWorker() {
+    {
+        std::lock_guard lock(mutex_);
+        running_ = false;
+    }
+    wakeup_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (size_t n = underruns_.load()) {
+        LOG_INFO("Decode worker stopped, %zu underruns", n);
+    }
+}
+
+ma_uint32 DecodeWorker::pull(void* output, ma_uint32 frameCount) {
+    auto* out = static_cast<uint8_t*>(output);
+    const size_t want = static_cast<size_t>(frameCount) * frameBytes_;
+
+    // seek 还没生效，旧位置的数据不能再放了
+    if (seekRequested_.load(std::memory_order_acquire) != seekApplied_.load(std::memory_order_acquire)) {
+        std::memset(out, 0, want);
+        return 0;
+    }
+
+    // seek 生效了：丢掉旧数据，位置换成新的
+    const size_t generation = flushGeneration_.load(std::memory_order_acquire);
+    if (generation != seenGeneration_) {
+        const size_t flushIndex = flushIndex_.load(std::memory_order_relaxed);
+        const size_t tail = ring_.readIndex();
+        ma_uint64 frame = flushFrame_.load(std::memory_order_relaxed);
+        if (flushIndex > tail) {
+            ring_.commitRead(ring_.readRegions(flushIndex - tail).size());
+        }
+        else {
+            // 上一次回调已经读过界了，读过去的那部分算新位置的
+            frame += (tail - flushIndex) / frameBytes_;
+        }
+        playedFrames_.store(frame, std::memory_order_relaxed);
+        // 还没放到的换歌位置跟着旧数据一起丢了，算已经换过去
+        trackChanges_.store(sourceSwitches_.load(std::memory_order_acquire), std::memory_order_release);
+        seenGeneration_ = generation;
+    }
+
+    const size_t tail = ring_.readIndex();
+    const size_t got = ring_.read(out, want);
+    if (got < want) {
+        std::memset(out + got, 0, want - got);
+        if (!sourceEnded_.load(std::memory_order_relaxed) && !finished_.load(std::memory_order_relaxed)) {
+            underruns_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    const auto frames = static_cast<ma_uint32>(got / frameBytes_);
+
+    // 这一段跨过了换歌的位置：位置换成下一首的帧号
+    const size_t switches = sourceSwitches_.load(std::memory_order_acquire);
+    const size_t boundary = boundaryIndex_.load(std::memory_order_relaxed);
+    if (switches != trackChanges_.load(std::memory_order_relaxed) && tail + got >= boundary) {
+        playedFrames_.store(boundaryFrame_.load(std::memory_order_relaxed) + (tail + got - boundary) / frameBytes_,
+            std::memory_order_relaxed);
+        trackChanges_.store(switches, std::memory_order_release);
+    }
+    else {
+        playedFrames_.store(playedFrames_.load(std::memory_order_relaxed) + frames, std::memory_order_relaxed);
+    }
+    return frames;
+}
+
+void DecodeWorker::seek(float percent) {
+    seekTarget_.store(percent, std::memory_order_relaxed);
+    {
+        std::lock_guard lock(mutex_);
+        seekWanted_ = true;
+        seekRequested_.fetch_add(1, std::memory_order_release);
+    }
+    wakeup_.notify_one();
+}
+
+void DecodeWorker::replaceSource(ImplAudioSource& source) {
+    std::unique_lock lock(mutex_);
+    pendingSource_ = &source;
+    seekWanted_ = false;
+    next_ = nullptr;
+    const size_t request = seekRequested_.fetch_add(1, std::memory_order_release) + 1;
+    wakeup_.notify_one();
+
+    // 解码线程可能正卡在旧源的 read 里（等网络），等它出来换掉
+    applied_.wait(lock, [&] {
+        return seekApplied_.load(std::memory_order_acquire) >= request || !running_.load(std::memory_order_relaxed);
+        });
+}
+
+bool DecodeWorker::queueNext(ImplAudioSource& next) {
+    {
+        std::lock_guard lock(mutex_);
+        if (next_) return false;
+        next_ = &next;
+    }
+    wakeup_.notify_one();
+    return true;
+}
+
+ma_uint64 DecodeWorker::startFrameOf(const ImplAudioSource& source) const {
+    return (std::max)(source.currentFrame_, source.playRange().start);
+}
+
+void DecodeWorker::applySeek() {
+    const size_t requested = seekRequested_.load(std::memory_order_acquire);
+    if (requested == seekApplied_.load(std::memory_order_relaxed)) return;
+
+    bool wanted = false;
+    {
+        std::lock_guard lock(mutex_);
+        if (pendingSource_) {
+            source_ = pendingSource_;
+            pendingSource_ = nullptr;
+        }
+        wanted = seekWanted_;
+        seekWanted_ = false;
+    }
+    if (wanted) {
+        source_->seek(seekTarget_.load(std::memory_order_relaxed));
+    }
+    sourceEnded_ = false;
+    finished_ = false;
+
+    // 先发布新位置再宣布生效，回调看到生效时一定也能看到 flush
+    flushIndex_.store(ring_.writeIndex(), std::memory_order_relaxed);
+    flushFrame_.store(startFrameOf(*source_), std::memory_order_relaxed);
+    flushGeneration_.fetch_add(1, std::memory_order_release);
+    {
+        std::lock_guard lock(mutex_);
+        seekApplied_.store(requested, std::memory_order_release);
+    }
+    applied_.notify_all();
+}
+
+bool DecodeWorker::advanceToNext() {
+    // 上一次换歌回调还没放到，先别换，不然两个位置记不下
+    if (sourceSwitches_.load(std::memory_order_relaxed) != trackChanges_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    ImplAudioSource* next = nullptr;
+    {
+        std::lock_guard lock(mutex_);
+        next = next_;
+        next_ = nullptr;
+    }
+    if (!next) return false;
+
+    // 先写位置再加计数，回调 acquire 到计数就能看到位置
+    boundaryIndex_.store(ring_.writeIndex(), std::memory_order_relaxed);
+    boundaryFrame_.store(startFrameOf(*next), std::memory_order_relaxed);
+    source_ = next;
+    sourceSwitches_.fetch_add(1, std::memory_order_release);
+    sourceEnded_ = false;
+    finished_ = false;
+    return true;
+}
+
+void DecodeWorker::decodeChunk() {
+    // 这里可能会等网络数据，等多久都只是这个线程
+    const ma_uint64 pos = source_->currentFrame_;
+    const ma_uint64 frames = source_->read(scratch_.data(), nullptr, ChunkFrames);
+    const ImplAudioSource::PlayRange range = source_->playRange();
+
+    // 只留 [start, end) 里的：开头的编码器延迟和结尾的补齐不进环，前后两首才接得严丝合缝
+    ma_uint64 first = pos;
+    ma_uint64 last = pos + frames;
+    if (first < range.start) first = (std::min)(range.start, last);
+    if (range.end != 0 && last > range.end) last = (std::max)(range.end, first);
+    if (last > first) {
+        ring_.write(scratch_.data() + static_cast<size_t>(first - pos) * frameBytes_,
+            static_cast<size_t>(last - first) * frameBytes_);
+    }
+
+    const bool atEnd = (frames == 0 && source_->ended_) || (range.end != 0 && pos + frames >= range.end);
+    if (atEnd) {
+        if (!advanceToNext()) {
+            finished_ = true;
+        }
+        return;
+    }
+    sourceEnded_ = frames == 0;
+}
+
+void DecodeWorker::run() {
+    while (running_.load(std::memory_order_acquire)) {
+        applySeek();
+        // 放完了之后才排上的下一首，也接着解
+        if (finished_.load(std::memory_order_relaxed) && advanceToNext()) {
+            continue;
+        }
+
+        // 缓冲区快满了就歇一会；源读完了也一样，隔一会再试（网络源可能只是断了又续上）
+        const bool full = ring_.writeAvailable() < scratch_.size();
+        const bool idle = sourceEnded_.load(std::memory_order_relaxed) || finished_.load(std::memory_order_relaxed);
+        if (full || idle) {
+            auto interrupted = [&] {
+                return !running_.load(std::memory_order_relaxed)
+                    || seekRequested_.load(std::memory_order_relaxed) != seekApplied_.load(std::memory_order_relaxed)
+                    || (finished_.load(std::memory_order_relaxed) && next_ != nullptr)
+                    || (full && ring_.writeAvailable() >= scratch_.size());
+                };
+            std::unique_lock lock(mutex_);
+            wakeup_.wait_for(lock, pollInterval_, interrupted);
+            if (full || interrupted() || finished_.load(std::memory_order_relaxed)) continue;
+        }
+
+        decodeChunk();
+    }
+    // 析构时可能有 replaceSource 在等
+    applied_.notify_all();
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <condition_variable>
+#include "miniaudio.h"
+#include "utils/SpscRingBuffer.h"
+
+class ImplAudioSource;
+
+// 解码线程：提前把 PCM 解进无锁环形缓冲区，音频回调只管拷贝
+// 等网络数据、seek 重建解码器这些会阻塞的事都留在这个线程里，回调里不等锁、不打日志
+// 无缝播放：排好下一首的话，当前这首解到真正的结尾帧（去掉编码器补齐）就直接接着解下一首，环里前后两首是连着的
+class DecodeWorker {
+public:
+    static constexpr ma_uint32 DefaultBufferMs = 500;
+
+    // 输出格式要和设备一致；bufferMs 是解码领先播放的最大时长
+    DecodeWorker(ImplAudioSource& source, ma_format format, ma_uint32 channels, ma_uint32 sampleRate,
+        ma_uint32 bufferMs = DefaultBufferMs);
+    ~DecodeWorker();
+
+    DecodeWorker(const DecodeWorker&) = delete;
+    DecodeWorker& operator=(const DecodeWorker&) = delete;
+
+    // 音频回调里调：有多少拷多少，不够的补静音，返回真正拷出去的帧数
+    ma_uint32 pull(void* output, ma_uint32 frameCount);
+    // 控制线程调：交给解码线程去跳，生效之前回调只出静音
+    void seek(float percent);
+    // 控制线程调：马上换成另一个源，环里旧的数据丢掉；返回时解码线程已经不碰旧源了，可以析构
+    void replaceSource(ImplAudioSource& source);
+    // 控制线程调：当前源放完之后无缝接上 next；已经排了一个还没接上的话返回 false
+    bool queueNext(ImplAudioSource& next);
+    // 消费者腾出地方之后叫一下解码线程，不用等 pollInterval_；音频回调别调（要进内核），离线渲染这种不赶时间的才用
+    void wake() { wakeup_.notify_one(); }
+
+    ma_uint64 playedFrames() const { return playedFrames_.load(std::memory_order_relaxed); }  // 已经送进设备的位置（源里的帧号）
+    size_t underruns() const { return underruns_.load(std::memory_order_relaxed); }
+    size_t bufferedFrames() const { return ring_.readAvailable() / frameBytes_; }   // 回调那边近似看一眼
+    // 回调放过了几次换歌的位置，控制线程看它变了就知道现在放的是排队的那首了，之前那个源可以析构
+    size_t trackChanges() const { return trackChanges_.load(std::memory_order_acquire); }
+    // 源放完了、没有排下一首、环里也放空了
+    bool finished() const { return finished_.load(std::memory_order_acquire) && ring_.readAvailable() == 0; }
+    // 源解完了也没有排下一首，环里可能还有没放的
+    bool sourceDone() const { return finished_.load(std::memory_order_acquire); }
+
+private:
+    static constexpr ma_uint32 ChunkFrames = 1024;      // 解码线程一次解这么多帧
+
+    void run();
+    void applySeek();
+    void decodeChunk();
+    bool advanceToNext();       // 当前源放完了，换到排队的那个上，记下换歌的位置
+    ma_uint64 startFrameOf(const ImplAudioSource& source) const;   // 源当前位置，编码器延迟那段不算
+
+    ImplAudioSource* source_;           // 只有解码线程换它
+    const ma_uint32 frameBytes_;
+    const std::chrono::milliseconds pollInterval_;      // 缓冲满了之后隔多久再看一眼，回调不负责叫醒
+    SpscRingBuffer<uint8_t> ring_;
+    std::vector<uint8_t> scratch_;      // 解码线程自己用
+
+    std::thread thread_;
+    std::mutex mutex_;                  // 只在控制线程和解码线程之间用，回调不碰
+    std::condition_variable wakeup_;
+    std::condition_variable applied_;   // replaceSource 等解码线程换完
+    std::atomic<bool> running_{ true };
+
+    // seek 的交接：和 NetworkDownloader 一样用请求/生效两个计数，连着 seek 几次只做最后一次
+    // 换源也走这一套，换源之后就不再 seek 了（目标是给旧源的）
+    std::atomic<float> seekTarget_{ 0.f };
+    std::atomic<size_t> seekRequested_{ 0 };
+    std::atomic<size_t> seekApplied_{ 0 };
+    bool seekWanted_ = false;                   // mutex_ 护着
+    ImplAudioSource* pendingSource_ = nullptr;  // mutex_ 护着，replaceSource 要换成的源
+    ImplAudioSource* next_ = nullptr;           // mutex_ 护着，排队等无缝接上的源
+
+    // seek 生效时的写下标，环里在它之前的都是旧位置的数据，回调看到新的 generation 就跳过去
+    std::atomic<size_t> flushIndex_{ 0 };
+    std::atomic<ma_uint64> flushFrame_{ 0 };        // flushIndex_ 处对应的源帧号
+    std::atomic<size_t> flushGeneration_{ 0 };
+    std::atomic<bool> sourceEnded_{ false };        // 这次没读到数据，可能只是网络还没来
+    std::atomic<bool> finished_{ false };           // 真放完了，等排队的源
+
+    // 无缝换歌的位置：环里 boundaryIndex_ 开始是下一首，对应它的 boundaryFrame_ 帧
+    // 一次只挂一个，回调放过去（trackChanges_ 追上 sourceSwitches_）之前不再换
+    std::atomic<size_t> boundaryIndex_{ 0 };
+    std::atomic<ma_uint64> boundaryFrame_{ 0 };
+    std::atomic<size_t> sourceSwitches_{ 0 };
+
+    // 回调这边的状态
+    size_t seenGeneration_ = 0;
+    std::atomic<ma_uint64> playedFrames_{ 0 };
+    std::atomic<size_t> underruns_{ 0 };
+    std::atomic<size_t> trackChanges_{ 0 };
+};
@@ -0,0 +1,97 @@
+#include "OfflineRenderer.h"
+#include <thread>
+#include <algorithm>
+#include "AudioMixer.h"
+#include "utils/Logger.h"
+
+WavSink::WavSink(const std::string& path, ma_format format, ma_uint32 channels, ma_uint32 sampleRate) {
+    ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, format, channels, sampleRate);
+    ma_result result = ma_encoder_init_file(path.c_str(), &config, &encoder_);
+    init_ = result == MA_SUCCESS;
+    if (!init_) {
+        LOG_ERROR("WAV encoder init failed! Path: %s, Result: %d", path.c_str(), result);
+    }
+}
+
+WavSink::~WavSink() {
+    if (init_)
+        ma_encoder_uninit(&encoder_);
+}
+
+bool WavSink::write(const void* frames, ma_uint64 frameCount) {
+    if (!init_) return false;
+    ma_uint64 written = 0;
+    return ma_encoder_write_pcm_frames(&encoder_, frames, frameCount, &written) == MA_SUCCESS && written == frameCount;
+}
+
+OfflineRenderer::Stats OfflineRenderer::render(ImplAudioSource& src, RenderSink& sink, ma_uint64 maxFrames) {
+    Stats stats;
+    if (!src.decoderInit_) return stats;
+    stats.sampleRate = src.decoder_.outputSampleRate;
+    buffer_.resize(static_cast<size_t>(bufferFrames_) * ma_get_bytes_per_frame(src.decoder_.outputFormat, src.decoder_.outputChannels));
+
+    const auto start = Clock::now();
+    while (maxFrames == 0 || stats.frames < maxFrames) {
+        const auto want = static_cast<ma_uint32>(maxFrames ? (std::min<ma_uint64>)(bufferFrames_, maxFrames - stats.frames) : bufferFrames_);
+        const ma_uint64 got = src.read(buffer_.data(), nullptr, want);
+        if (got == 0) {
+            if (src.ended_) break;
+            // 网络源数据还没到，或者 seek 占着解码器
+            ++stats.stalls;
+            std::this_thread::sleep_for(StallWait);
+            continue;
+        }
+        if (!sink.write(buffer_.data(), got)) {
+            LOG_ERROR("Render sink write failed");
+            break;
+        }
+        stats.frames += got;
+    }
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return stats;
+}
+
+OfflineRenderer::Stats OfflineRenderer::renderPipeline(std::unique_ptr<ImplAudioSource> src, RenderSink& sink, ma_uint64 maxFrames) {
+    Stats stats;
+    if (!src || !src->decoderInit_) return stats;
+    const ma_format format = src->decoder_.outputFormat;
+    const ma_uint32 channels = src->decoder_.outputChannels;
+    stats.sampleRate = src->decoder_.outputSampleRate;
+    buffer_.resize(static_cast<size_t>(bufferFrames_) * ma_get_bytes_per_frame(format, channels));
+
+    // 混音器按源的格式开，只有一路、增益 1 的时候走的是和播放时一样的透传
+    const auto start = Clock::now();
+    AudioMixer mixer(format, channels, stats.sampleRate);
+    const AudioMixer::VoiceId id = mixer.add(std::move(src));
+    DecodeWorker* worker = mixer.worker(id);
+    if (!worker) return stats;
+    // 解码线程的环装不下一整块的话永远等不够，最多等半个环
+    const size_t chunk = (std::min<size_t>)(bufferFrames_, static_cast<size_t>(stats.sampleRate) * DecodeWorker::DefaultBufferMs / 1000 / 2);
+
+    while (maxFrames == 0 || stats.frames < maxFrames) {
+        // 回调是按时间要数据的，这里不是：环里攒够一块再混，不然 pull 会补静音
+        // 先看解完没有再看环里有多少，解完之后写进去的都能看到
+        const bool done = worker->sourceDone();
+        const size_t buffered = worker->bufferedFrames();
+        if (buffered < chunk && !done) {
+            ++stats.stalls;
+            worker->wake();
+            std::this_thread::sleep_for(StallWait);
+            continue;
+        }
+        if (buffered == 0) break;
+
+        ma_uint32 frames = static_cast<ma_uint32>((std::min)(buffered, chunk));
+        if (maxFrames) frames = static_cast<ma_uint32>((std::min<ma_uint64>)(frames, maxFrames - stats.frames));
+        mixer.mix(buffer_.data(), frames);
+        // 腾出地方了，别让解码线程睡满一个轮询周期
+        worker->wake();
+        if (!sink.write(buffer_.data(), frames)) {
+            LOG_ERROR("Render sink write failed");
+            break;
+        }
+        stats.frames += frames;
+    }
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return stats;
+}
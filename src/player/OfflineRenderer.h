@@ -0,0 +1,73 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "miniaudio.h"
+#include "source/ImplAudioSource.h"
+
+// 离线渲染的去处：不开声卡，解出来的 PCM 交给它
+class RenderSink {
+public:
+    virtual ~RenderSink() = default;
+    virtual bool write(const void* frames, ma_uint64 frameCount) = 0;
+};
+
+// 什么都不做，只数帧，测吞吐用
+class NullSink : public RenderSink {
+public:
+    bool write(const void*, ma_uint64 frameCount) override { frames_ += frameCount; return true; }
+    ma_uint64 frames() const { return frames_; }
+
+private:
+    ma_uint64 frames_ = 0;
+};
+
+// 写成 WAV 文件，对比输出用；格式跟着源走
+class WavSink : public RenderSink {
+public:
+    WavSink(const std::string& path, ma_format format, ma_uint32 channels, ma_uint32 sampleRate);
+    ~WavSink() override;
+    bool write(const void* frames, ma_uint64 frameCount) override;
+    bool ok() const { return init_; }
+
+private:
+    ma_encoder encoder_{};
+    bool init_ = false;
+};
+
+// 不经过 ma_device，把源尽快拉到 sink 里：没有声卡的 CI 上测解码和管线有没有变慢
+// - Direct：在调用线程上直接 read，只有解码本身
+// - Pipeline：走 AudioMixer + DecodeWorker，和播放时一样的线程交接和格式转换，只是不按实时节奏
+class OfflineRenderer {
+public:
+    enum class Mode { Direct, Pipeline };
+
+    struct Stats {
+        ma_uint64 frames = 0;
+        ma_uint32 sampleRate = 0;
+        double seconds = 0;         // 墙钟时间
+        size_t stalls = 0;          // 等数据的次数（网络没来、解码线程没跟上）
+
+        double framesPerSecond() const { return seconds > 0 ? frames / seconds : 0; }
+        // 音频时长 / 花的时间，1 就是刚好跟得上实时
+        double realtimeFactor() const { return seconds > 0 && sampleRate ? frames / static_cast<double>(sampleRate) / seconds : 0; }
+    };
+
+    static constexpr ma_uint32 DefaultBufferFrames = 1024;
+
+    // bufferFrames 是每次拉多少帧，相当于设备的周期大小
+    explicit OfflineRenderer(ma_uint32 bufferFrames = DefaultBufferFrames) : bufferFrames_(bufferFrames) {}
+
+    // 渲染到源读完为止；maxFrames 不为 0 的话最多渲染这么多帧
+    // Pipeline 模式要接管源（交给混音器），Direct 模式用完还给调用方可以接着用
+    Stats render(ImplAudioSource& src, RenderSink& sink, ma_uint64 maxFrames = 0);
+    Stats renderPipeline(std::unique_ptr<ImplAudioSource> src, RenderSink& sink, ma_uint64 maxFrames = 0);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr auto StallWait = std::chrono::microseconds(200);
+
+    ma_uint32 bufferFrames_;
+    std::vector<uint8_t> buffer_;
+};
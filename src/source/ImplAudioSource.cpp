@@ -1,6 +1,18 @@
 #include "ImplAudioSource.h"
+#include <cstring>
+#include <fstream>
 #include "utils/Logger.h"
 
+ImplAudioSource::PlayRange ImplAudioSource::rangeFromIndex(const SeekIndex& index) const {
+    const auto gapless = index.gapless();
+    if (!gapless || index.sampleRate() == 0) return {};
+    if (sampleRate_ == 0 || sampleRate_ == index.sampleRate()) {
+        return { gapless->startFrame, gapless->endFrame };
+    }
+    auto scale = [&](uint64_t frame) { return frame * sampleRate_ / index.sampleRate(); };
+    return { scale(gapless->startFrame), gapless->endFrame ? scale(gapless->endFrame) : 0 };
+}
+
 LocalFileSource::LocalFileSource(const std::string& filePath)
     :filePath_(filePath){
     ma_result result = ma_decoder_init_file(filePath_.c_str(), nullptr, &decoder_);
@@ -10,7 +22,17 @@ LocalFileSource::LocalFileSource(const std::string& filePath)
     if (result != MA_SUCCESS) {
         LOG_ERROR("Decoder init failed! Path: %s, Result: %d", filePath_.c_str(), result);
         // 可以进一步抛出异常或标记资源无效
+        return;
     }
+    format_ = decoder_.outputFormat;
+    channels_ = decoder_.outputChannels;
+    sampleRate_ = decoder_.outputSampleRate;
+
+    // 编码器延迟和补齐写在文件开头，读一段给索引看
+    std::ifstream file(filePath_, std::ios::binary);
+    std::vector<uint8_t> head(HeadScanBytes_);
+    file.read(reinterpret_cast<char*>(head.data()), head.size());
+    seekIndex_.observe(0, head.data(), static_cast<size_t>(file.gcount()));
 }
 
 LocalFileSource::~LocalFileSource() {
@@ -25,11 +47,13 @@ ma_uint64 LocalFileSource::read(void* pOutput, const void* pInput, ma_uint32 fra
     //LOG_INFO("[Decoder] Cursor before read: %llu", cursor);
 
     ma_uint64 framesRead = 0;  
-    ma_decoder_read_pcm_frames(
+    ma_result result = ma_decoder_read_pcm_frames(
         &decoder_,      // 解码器实例
         pOutput,        // 输出缓冲区（存储解码后的PCM数据）
         frameCount,     // 请求读取帧数
         &framesRead);   // 实际读取帧数，返回的
+    currentFrame_ += framesRead;
+    ended_ = framesRead == 0 && result == MA_AT_END;
 
     return framesRead;
 }
@@ -38,6 +62,10 @@ ma_result LocalFileSource::seek(float percent) {
     ma_uint64 frameIndex = static_cast<ma_uint64>(percent * totalFrames_);
 
     ma_result result = ma_decoder_seek_to_pcm_frame(&decoder_, frameIndex);
+    if (result == MA_SUCCESS) {
+        currentFrame_ = frameIndex;
+        ended_ = false;
+    }
 
     if (result != MA_SUCCESS) {
         LOG_WARN("Seek failed! Path: %s, Frame: %llu, Result: %d",
@@ -51,64 +79,33 @@ ma_result LocalFileSource::seek(float percent) {
 NetworkStreamSource::NetworkStreamSource(std::shared_ptr<NetworkDownloader> downloader) 
     : downloader_(std::move(downloader)) {
 
-    //readProc回调函数，MiniAudio 会通过它读取音频数据
-    auto readProc = [](ma_decoder* pDecoder, void* pBufferOut, size_t bytesToRead, ma_uint64* pBytesRead) -> ma_result {
-        auto* self = static_cast<NetworkStreamSource*>(pDecoder->pUserData);
-
-        //// 这个和readBuffer里的cv看情况保留的
-        //{
-        //    std::unique_lock lock(self->downloader_->pauseMutex_);
-        //    self->downloader_->pauseCV_.wait(lock, [&] { return !self->downloader_->isPaused_.load(); });  // 等待恢复
-        //}
-
-        // 实际的字节数，返回给上一层       从缓冲区读取,带wait的      // 期望的字节数
-        *pBytesRead = self->downloader_->readBuffer(pBufferOut, bytesToRead);
-        LOG_INFO("CallBack--readProc size: %llu", *pBytesRead);  // 输出读取的字节数
-
-        if(pBytesRead==nullptr){
-            LOG_INFO("pBytesRead nullptr!!!");
-        }
-        if (*pBytesRead == 0) {
-            if (self->downloader_->isEndOfStream()) {
-                LOG_ERROR("readProc：返回0字节，流结束了或网络错误");
-                return MA_AT_END; // 或 MA_FAILED，看怎么处理
-            }
-            // 缓冲区还不够，但后续会有数据
-            LOG_DEBUG("readProc：返回0字节，正在准备");
-            return MA_BUSY;
-        }
-        return MA_SUCCESS;
-        };
-
-    //待改进，应该是根据数据源格式获得length长度然后range方式申请网络音频资源流
-    auto seekProc = [](ma_decoder*, ma_int64, ma_seek_origin) -> ma_result {
-        return MA_NOT_IMPLEMENTED;
-        };
-
-    // 初始化解码器（使用回调模式）
-    ma_decoder_config config = ma_decoder_config_init_default();
-
     // 这个的话要在decoderinit之前调用，因为初始化的时候直接是要数据的
-    downloader_->waitUntilBuffered(256 * 1024);
+    // 只等够认格式的量，后面不够的 readProc 自己会等；预取过的歌这里直接就过了
+    downloader_->waitUntilBuffered(StartupBytes_);
+
+    // 之前播过这首歌的话跳转索引还在，一上来就能精确跳
+    if (downloader_->diskCache_) {
+        seekIndexPath_ = downloader_->diskCache_->sidecarPath(".seek");
+        seekIndex_.load(seekIndexPath_);
+    }
 
-    auto funcptr = readProc;
-    auto funcptr2 = seekProc;
-    
     /*意思就是miniaudio的回调用是通过decoder来的，
    decoder存储了所有信息，我把我的this指针传到了decoder的pUserData里
    ，然后读取的时候调用readProc函数，这个函数调用了我的this里的逻辑*/
-    ma_result result = ma_decoder_init(funcptr, funcptr2, this, &config, &decoder_);
+    ma_result result = initDecoder(ma_encoding_format_unknown);
 
     // 获取总字节 
     totalLengths_ = downloader_->totalLength();
-    //ma_uint64 totalFrames_{};
-    //ma_decoder_get_length_in_pcm_frames(&decoder_, &totalFrames_);
+
+    // 知道总时长就能算出平均码率，下载器按它决定预读多少
+    const uint64_t frames = seekIndex_.totalFrames(totalLengths_);
+    if (frames != 0 && seekIndex_.sampleRate() != 0) {
+        downloader_->setTrackBitrate(static_cast<double>(totalLengths_) * seekIndex_.sampleRate() / frames);
+    }
 
     if (result != MA_SUCCESS) {
         LOG_ERROR("解码器初始化失败: %s", ma_result_description(result));
     }
-    decoderInit_ = true;
-    //return MA_SUCCESS;
 }
 
 NetworkStreamSource::~NetworkStreamSource(){ 
@@ -118,28 +115,239 @@ NetworkStreamSource::~NetworkStreamSource(){
     // 这里构造的时候抛出错误，直接就构造失败，也不会调用析构函数了
     if (decoderInit_)
         ma_decoder_uninit(&decoder_);
+
+    if (!seekIndexPath_.empty() && seekIndex_.dirty()) {
+        seekIndex_.save(seekIndexPath_);
+    }
+}
+
+//readProc回调函数，MiniAudio 会通过它读取音频数据
+ma_result NetworkStreamSource::readProc(ma_decoder* pDecoder, void* pBufferOut, size_t bytesToRead, size_t* pBytesRead) {
+    auto* self = static_cast<NetworkStreamSource*>(pDecoder->pUserData);
+    auto* out = static_cast<uint8_t*>(pBufferOut);
+
+    //// 这个和readBuffer里的cv看情况保留的
+    //{
+    //    std::unique_lock lock(self->downloader_->pauseMutex_);
+    //    self->downloader_->pauseCV_.wait(lock, [&] { return !self->downloader_->isPaused_.load(); });  // 等待恢复
+    //}
+
+    // 重建解码器时垫的流头先给出去
+    size_t fromPreamble = 0;
+    if (self->preamblePos_ < self->preamble_.size()) {
+        fromPreamble = (std::min)(bytesToRead, self->preamble_.size() - self->preamblePos_);
+        std::memcpy(out, self->preamble_.data() + self->preamblePos_, fromPreamble);
+        self->preamblePos_ += fromPreamble;
+        if (fromPreamble == bytesToRead) {
+            *pBytesRead = fromPreamble;
+            return MA_SUCCESS;
+        }
+    }
+
+    // 实际的字节数，返回给上一层       从缓冲区读取,带wait的      // 期望的字节数
+    const size_t n = self->downloader_->readBuffer(out + fromPreamble, bytesToRead - fromPreamble);
+    self->seekIndex_.observe(self->cursor_, out + fromPreamble, n);
+    self->cursor_ += n;
+    *pBytesRead = fromPreamble + n;
+
+    if (*pBytesRead == 0) {
+        if (self->downloader_->isEndOfStream()) {
+            LOG_ERROR("readProc：返回0字节，流结束了或网络错误");
+            return MA_AT_END; // 或 MA_FAILED，看怎么处理
+        }
+        // 缓冲区还不够，但后续会有数据
+        LOG_DEBUG("readProc：返回0字节，正在准备");
+        return MA_BUSY;
+    }
+    return MA_SUCCESS;
+}
+
+// 字节级 seek：初始化探测格式、解码器自己跳转都走这里
+ma_result NetworkStreamSource::seekProc(ma_decoder* pDecoder, ma_int64 byteOffset, ma_seek_origin origin) {
+    auto* self = static_cast<NetworkStreamSource*>(pDecoder->pUserData);
+    return self->seekBytes(byteOffset, origin);
+}
+
+ma_result NetworkStreamSource::initDecoder(ma_encoding_format encoding) {
+    // 初始化解码器（使用回调模式）
+    ma_decoder_config config = ma_decoder_config_init_default();
+    // 重建的时候输出格式要和第一次一样，设备是按那个开的
+    if (channels_ != 0) {
+        config.format = format_;
+        config.channels = channels_;
+        config.sampleRate = sampleRate_;
+    }
+    // 格式已知就别再挨个探测了
+    config.encodingFormat = encoding;
+
+    ma_result result = ma_decoder_init(readProc, seekProc, this, &config, &decoder_);
+    decoderInit_ = result == MA_SUCCESS;
+    if (decoderInit_ && channels_ == 0) {
+        format_ = decoder_.outputFormat;
+        channels_ = decoder_.outputChannels;
+        sampleRate_ = decoder_.outputSampleRate;
+    }
+    return result;
 }
 
 ma_uint64 NetworkStreamSource::read(void* pOutput, const void* pInput, ma_uint32 frameCount) {
+    // 正在 seek（可能在重建解码器）就先返回 0，别在这卡着
+    std::unique_lock lock(decoderMutex_, std::try_to_lock);
+    if (!lock.owns_lock() || !decoderInit_) {
+        return 0;
+    }
 
     // 这个是实际读的 frameCount是期待读的
     ma_uint64 framesRead = 0;
-    ma_decoder_read_pcm_frames(
+    ma_result result = ma_decoder_read_pcm_frames(
         &decoder_,      // 解码器实例
         pOutput,        // 输出缓冲区（存储解码后的PCM数据）
         frameCount,     // 请求读取帧数
         &framesRead);   // 实际读取帧数，返回的
-
-    if(framesRead==0)
-        LOG_INFO("Frame read: %llu", framesRead);
+    currentFrame_ += framesRead;
+    // 网络没数据时解码器也会说读到头了，下载器也结束了才算数
+    ended_ = framesRead == 0 && result == MA_AT_END && downloader_->isEndOfStream();
 
     return framesRead;
 }
 
 ma_result NetworkStreamSource::seek(float percent) {
-    size_t pos = static_cast<size_t>(percent * totalLengths_);
+    std::lock_guard lock(decoderMutex_);
+    ended_ = false;
+    const size_t total = totalLengths_ ? totalLengths_ : downloader_->totalLength();
+
+    // 索引认得这个格式就按帧跳，VBR 也准
+    if (const ma_uint64 frames = seekIndex_.totalFrames(total)) {
+        const auto target = static_cast<ma_uint64>(percent * frames);
+        if (seekToFrame(target, total) == MA_SUCCESS) {
+            return MA_SUCCESS;
+        }
+    }
+
+    // 不认识的格式只能按字节比例估，解码器自己找同步
+    size_t pos = static_cast<size_t>(percent * total);
+    preamblePos_ = preamble_.size();
+    return seekFile(pos);
+}
+
+ma_result NetworkStreamSource::seekToFrame(ma_uint64 targetFrame, size_t total) {
+    const auto point = seekIndex_.locate(targetFrame, total);
+    if (!point) {
+        return MA_NOT_IMPLEMENTED;
+    }
+    const bool flac = seekIndex_.format() == SeekIndex::Format::Flac;
+
+    // dr_mp3/dr_flac 的内部状态从外面够不着，干脆从落点重建解码器：
+    // MP3 直接从帧头开始喂；FLAC 先垫一个只有 STREAMINFO 的流头，解码器以为是从头开始的
+    if (decoderInit_) {
+        ma_decoder_uninit(&decoder_);
+        decoderInit_ = false;
+    }
+    preamble_ = flac ? seekIndex_.flacPreamble() : std::vector<uint8_t>{};
+    preamblePos_ = 0;
+    streamBase_ = point->byteOffset;
+    seekFile(point->byteOffset);
+    seekIndex_.resync(point->byteOffset, point->exact ? std::optional<uint64_t>(point->pcmFrame) : std::nullopt);
+
+    ma_result result = initDecoder(flac ? ma_encoding_format_flac : ma_encoding_format_mp3);
+    if (result != MA_SUCCESS) {
+        // 退回从文件开头播，至少还能响
+        LOG_WARN("Seek to frame %llu failed (%s), restart from beginning", targetFrame, ma_result_description(result));
+        preamble_.clear();
+        preamblePos_ = 0;
+        streamBase_ = 0;
+        seekFile(0);
+        if (initDecoder(ma_encoding_format_unknown) == MA_SUCCESS) {
+            currentFrame_ = 0;
+        }
+        return result;
+    }
+
+    // 从落点解到目标帧，多出来的丢掉；FLAC 估的落点等解出第一帧，用帧头里的采样号校正
+    const ma_uint32 frameBytes = ma_get_bytes_per_frame(decoder_.outputFormat, decoder_.outputChannels);
+    scratch_.resize(DiscardChunkFrames_ * frameBytes);
+    ma_uint64 position = point->pcmFrame;
+    bool corrected = point->exact || !flac;
+    while (position < targetFrame || !corrected) {
+        const ma_uint64 chunk = corrected ? (std::min)(targetFrame - position, DiscardChunkFrames_) : 1;
+        ma_uint64 got = 0;
+        ma_decoder_read_pcm_frames(&decoder_, scratch_.data(), chunk, &got);
+        if (got == 0) break;
+        if (!corrected) {
+            if (auto first = seekIndex_.frameAfterResync()) {
+                position = *first;
+            }
+            corrected = true;
+        }
+        position += got;
+    }
+
+    LOG_DEBUG("Seek to frame %llu: start at byte %zu (%s), landed on %llu",
+        targetFrame, point->byteOffset, point->exact ? "exact" : "estimated", position);
+    currentFrame_ = position;
+    return MA_SUCCESS;
+}
+
+ma_result NetworkStreamSource::seekBytes(ma_int64 offset, ma_seek_origin origin) {
+    // 初始化的时候可能还没拿到总长度
+    const size_t total = totalLengths_ ? totalLengths_ : downloader_->totalLength();
+
+    // 换算到 decoder 看到的流上：前面是 preamble_，后面接文件 [streamBase_, total)
+    const size_t preamble = preamble_.size();
+    const size_t virtualPos = preamblePos_ < preamble ? preamblePos_ : preamble + (cursor_ - streamBase_);
+    ma_int64 target = offset;
+    if (origin == ma_seek_origin_current) {
+        target += static_cast<ma_int64>(virtualPos);
+    }
+    else if (origin == ma_seek_origin_end) {
+        if (total == 0) {
+            return MA_NOT_IMPLEMENTED;  // 不知道文件多长，没法从末尾算
+        }
+        target += static_cast<ma_int64>(preamble + total - streamBase_);
+    }
+    if (target < 0) {
+        return MA_INVALID_ARGS;
+    }
+
+    const size_t pos = static_cast<size_t>(target);
+    if (pos < preamble) {
+        preamblePos_ = pos;
+        return seekFile(streamBase_);
+    }
+    preamblePos_ = preamble;
+    return seekFile(streamBase_ + (pos - preamble));
+}
 
-    downloader_->seek(pos);
+ma_result NetworkStreamSource::seekFile(size_t pos) {
+    const size_t total = totalLengths_ ? totalLengths_ : downloader_->totalLength();
+    if (total != 0) {
+        pos = (std::min)(pos, total);
+    }
+    if (pos == cursor_) {
+        return MA_SUCCESS;
+    }
 
+    // 往前跳一点点：数据多半已经在路上了，读掉比重新请求快
+    if (pos > cursor_ && pos - cursor_ <= ShortSeekBytes_) {
+        skipBytes(pos - cursor_);
+        return MA_SUCCESS;
+    }
+
+    // 缓冲区里有的（包括刚读过的）只挪读指针，不然 downloader 清掉旧数据从 pos 重新供
+    const bool buffered = downloader_->seek(pos);
+    LOG_DEBUG("Network seek %zu -> %zu (%s)", cursor_, pos, buffered ? "buffered" : "refill");
+    cursor_ = pos;
     return MA_SUCCESS;
 }
+
+void NetworkStreamSource::skipBytes(size_t count) {
+    uint8_t scratch[4096];
+    while (count > 0) {
+        const size_t n = downloader_->readBuffer(scratch, (std::min)(count, sizeof(scratch)));
+        if (n == 0) break;  // 到结尾了
+        // 跳过的字节也让索引看一眼，扫描不断
+        seekIndex_.observe(cursor_, scratch, n);
+        count -= n;
+        cursor_ += n;
+    }
+}
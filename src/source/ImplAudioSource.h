@@ -1,5 +1,9 @@
 #pragma once
+#include <mutex>
+#include <vector>
+#include <filesystem>
 #include "AudioSourceType.h"
+#include "SeekIndex.h"
 #include "miniaudio.h"
 #include "network/Network.h"
 
@@ -11,6 +15,17 @@ public:
     virtual ma_result seek(float percent) = 0;      // 返回值表示请求是否成功
     virtual AudioSourceType SourceType() const = 0;
 
+    // 无缝播放用：输出帧号 [start, end) 之外的是编码器延迟和补齐，不该放出来；end 为 0 表示放到读完
+    struct PlayRange {
+        ma_uint64 start = 0;
+        ma_uint64 end = 0;
+    };
+    virtual PlayRange playRange() const { return {}; }
+
+protected:
+    // 索引里的范围是按原始采样率算的，解码器输出重采样过的话要换算
+    PlayRange rangeFromIndex(const SeekIndex& index) const;
+
 public:
     ma_decoder decoder_{};
     ma_uint64 currentFrame_{};
@@ -18,6 +33,7 @@ public:
     ma_uint32 channels_{};
     ma_uint32 sampleRate_{};
     bool decoderInit_ = false;
+    bool ended_ = false;    // 解码器真的读到头了，不是网络暂时没数据
 };
 
 // 本地数据源
@@ -28,10 +44,14 @@ public:
     ma_uint64 read(void* pOutput, const void* pInput, ma_uint32 frameCount) override;
     ma_result seek(float percent) override;
     AudioSourceType SourceType() const override { return AudioSourceType::LocalFile; }
+    PlayRange playRange() const override { return rangeFromIndex(seekIndex_); }
 
 private:
+    static constexpr size_t HeadScanBytes_ = 512 * 1024;   // 开头读这么多给索引认 LAME 头/iTunSMPB
+
     std::string filePath_;
     ma_uint64 totalFrames_{};
+    SeekIndex seekIndex_;   // 本地文件 seek 用不着它，只拿无缝信息
 };
 
 // 网络流数据源
@@ -42,8 +62,35 @@ public:
     ma_uint64 read(void* pOutput, const void* pInput, ma_uint32 frameCount) override;
     ma_result seek(float percent) override;
     AudioSourceType SourceType() const override { return AudioSourceType::NetworkStream; }
+    PlayRange playRange() const override { return rangeFromIndex(seekIndex_); }
 
 private:
+    // miniaudio 的读/seek 回调，重建解码器的时候也要用
+    static ma_result readProc(ma_decoder* pDecoder, void* pBufferOut, size_t bytesToRead, size_t* pBytesRead);
+    static ma_result seekProc(ma_decoder* pDecoder, ma_int64 byteOffset, ma_seek_origin origin);
+    ma_result initDecoder(ma_encoding_format encoding);
+
+    // decoder 的字节级 seek：decoder 看到的流是 preamble_ 再接上文件 [streamBase_, 结尾)
+    ma_result seekBytes(ma_int64 offset, ma_seek_origin origin);
+    // 把文件读位置挪到 pos：近距离往前跳直接读掉，否则交给 downloader
+    ma_result seekFile(size_t pos);
+    void skipBytes(size_t count);
+    // 按跳转索引跳到某一帧：从索引给的位置重建解码器，多解出来的丢掉
+    ma_result seekToFrame(ma_uint64 targetFrame, size_t total);
+
+    static constexpr size_t ShortSeekBytes_ = 64 * 1024;    // 往前跳这么近就读掉，不值得重新发 Range 请求
+    static constexpr size_t StartupBytes_ = 16 * 1024;      // 构造时先等这么多再初始化解码器
+    static constexpr ma_uint64 DiscardChunkFrames_ = 4096;  // 精确跳转时一次解码丢掉的帧数
+
     std::shared_ptr<NetworkDownloader> downloader_;
     size_t totalLengths_{};
+    size_t cursor_{};       // decoder 读到的文件偏移
+
+    SeekIndex seekIndex_;                   // 边播边建，seek 靠它换算成精确的字节位置
+    std::filesystem::path seekIndexPath_;   // 开了磁盘缓存才有，跟缓存数据放在一起
+    std::vector<uint8_t> preamble_;         // 半路重建解码器时垫在文件数据前面的字节（FLAC 的流头）
+    size_t preamblePos_{};
+    size_t streamBase_{};                   // preamble_ 之后接的是文件的这个偏移
+    std::vector<uint8_t> scratch_;          // 丢弃解码结果用
+    std::mutex decoderMutex_;               // 读和 seek 不在同一个线程时护住解码器，seek 可能要重建它
 };
@@ -0,0 +1,711 @@
+#include "SeekIndex.h"
+#include <fstream>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include "utils/Logger.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char IndexMagic[8] = { 'M', 'T', 'P', 'S', 'I', '0', '0', '1' };
+
+uint64_t fnv1a(const uint8_t* data, size_t len) {
+    uint64_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+template <typename T>
+void put(std::vector<uint8_t>& out, T value) {
+    const auto* p = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+bool get(const std::vector<uint8_t>& in, size_t& pos, T& value) {
+    if (pos + sizeof(T) > in.size()) return false;
+    std::memcpy(&value, in.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+uint32_t be16(const uint8_t* p) { return (uint32_t(p[0]) << 8) | p[1]; }
+uint32_t be24(const uint8_t* p) { return (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2]; }
+uint32_t be32(const uint8_t* p) { return (be16(p) << 16) | be16(p + 2); }
+uint64_t be64(const uint8_t* p) { return (uint64_t(be32(p)) << 32) | be32(p + 4); }
+
+struct Mp3Header {
+    uint32_t frameBytes = 0;
+    uint32_t samples = 0;
+    uint32_t sampleRate = 0;
+    uint32_t sideInfoBytes = 0;     // Xing 头就在 side info 后面
+};
+
+bool parseMp3Header(const uint8_t* p, Mp3Header& h) {
+    if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) return false;
+    const int version = (p[1] >> 3) & 3;    // 0 = MPEG2.5，2 = MPEG2，3 = MPEG1
+    const int layer = (p[1] >> 1) & 3;      // 1 = III，2 = II，3 = I
+    const int bitrateIndex = p[2] >> 4;
+    const int rateIndex = (p[2] >> 2) & 3;
+    // free format 算不出帧长，一起当坏帧
+    if (version == 1 || layer == 0 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3) return false;
+
+    static const uint16_t Bitrates[2][3][15] = {
+        {   // MPEG1
+            { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+            { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+        },
+        {   // MPEG2 / 2.5
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+            { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+            { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+        },
+    };
+    static const uint32_t Rates[3] = { 44100, 48000, 32000 };
+
+    const bool mpeg1 = version == 3;
+    const int layerIdx = 3 - layer;         // 0 = I，1 = II，2 = III
+    const uint32_t bitrate = Bitrates[mpeg1 ? 0 : 1][layerIdx][bitrateIndex] * 1000u;
+    const uint32_t padding = (p[2] >> 1) & 1;
+    const bool mono = (p[3] >> 6) == 3;
+
+    h.sampleRate = Rates[rateIndex] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+    if (layerIdx == 0) {
+        h.samples = 384;
+        h.frameBytes = (12 * bitrate / h.sampleRate + padding) * 4;
+    }
+    else {
+        h.samples = (layerIdx == 2 && !mpeg1) ? 576 : 1152;
+        h.frameBytes = h.samples / 8 * bitrate / h.sampleRate + padding;
+    }
+    h.sideInfoBytes = mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+    return h.frameBytes > 4;
+}
+
+// 帧头里每一帧都不会变的位：版本、层、采样率
+uint16_t mp3Signature(const uint8_t* p) {
+    return static_cast<uint16_t>(((p[1] & 0xFE) << 8) | (p[2] & 0x0C));
+}
+
+uint8_t crc8(const uint8_t* p, size_t n) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < n; ++i) {
+        crc ^= p[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+struct FlacFrameHeader {
+    size_t headerBytes = 0;
+    uint64_t number = 0;        // 变长分块是采样号，定长分块是帧号
+    uint32_t blockSize = 0;
+    bool variable = false;
+};
+
+// p 至少要有 16 字节（帧头最长就这么多）
+bool parseFlacHeader(const uint8_t* p, FlacFrameHeader& h) {
+    if (p[0] != 0xFF || (p[1] & 0xFE) != 0xF8) return false;
+    const int blockCode = p[2] >> 4;
+    const int rateCode = p[2] & 0x0F;
+    if (blockCode == 0 || rateCode == 0x0F) return false;
+    if ((p[3] >> 4) >= 11 || ((p[3] >> 1) & 7) == 3 || (p[3] & 1)) return false;
+    h.variable = p[1] & 1;
+
+    // 帧号/采样号用的是 UTF-8 那样的变长编码
+    size_t pos = 4;
+    const uint8_t lead = p[pos++];
+    int extra = 0;
+    uint64_t value = 0;
+    if (!(lead & 0x80)) { value = lead; }
+    else if ((lead & 0xE0) == 0xC0) { value = lead & 0x1F; extra = 1; }
+    else if ((lead & 0xF0) == 0xE0) { value = lead & 0x0F; extra = 2; }
+    else if ((lead & 0xF8) == 0xF0) { value = lead & 0x07; extra = 3; }
+    else if ((lead & 0xFC) == 0xF8) { value = lead & 0x03; extra = 4; }
+    else if ((lead & 0xFE) == 0xFC) { value = lead & 0x01; extra = 5; }
+    else if (lead == 0xFE && h.variable) { extra = 6; }
+    else return false;
+    for (int i = 0; i < extra; ++i) {
+        const uint8_t c = p[pos++];
+        if ((c & 0xC0) != 0x80) return false;
+        value = (value << 6) | (c & 0x3F);
+    }
+
+    if (blockCode == 1) h.blockSize = 192;
+    else if (blockCode <= 5) h.blockSize = 576u << (blockCode - 2);
+    else if (blockCode == 6) h.blockSize = p[pos++] + 1u;
+    else if (blockCode == 7) { h.blockSize = be16(p + pos) + 1; pos += 2; }
+    else h.blockSize = 256u << (blockCode - 8);
+
+    if (rateCode == 12) pos += 1;
+    else if (rateCode == 13 || rateCode == 14) pos += 2;
+
+    // 0xFFF8 在压缩数据里也会碰巧出现，靠 CRC-8 筛掉
+    if (crc8(p, pos) != p[pos]) return false;
+    h.headerBytes = pos + 1;
+    h.number = value;
+    return true;
+}
+
+}
+
+void SeekIndex::observe(size_t offset, const uint8_t* data, size_t len) {
+    if (offset != streamPos_) {
+        resync(offset, std::nullopt);
+    }
+    streamPos_ = offset + len;
+
+    size_t pos = offset;
+    const uint8_t* end = data + len;
+    while (data < end && stage_ != Stage::Lost) {
+        // nextParse_ 前面的字节（帧的数据部分）用不上
+        if (head_.empty() && nextParse_ > pos) {
+            const size_t skip = (std::min)(nextParse_ - pos, static_cast<size_t>(end - data));
+            data += skip;
+            pos += skip;
+            continue;
+        }
+        // 找 FLAC 同步码先在输入里找 0xFF，不用一个字节一个字节地攒
+        if (head_.empty() && stage_ == Stage::FlacFrame) {
+            const auto* ff = static_cast<const uint8_t*>(std::memchr(data, 0xFF, end - data));
+            if (!ff) {
+                nextParse_ = streamPos_;
+                break;
+            }
+            pos += ff - data;
+            data = ff;
+            nextParse_ = pos;
+        }
+
+        // 换阶段之后 head_ 可能已经比要的多了
+        const size_t want = needBytes_ > head_.size() ? needBytes_ - head_.size() : 0;
+        const size_t take = (std::min)(want, static_cast<size_t>(end - data));
+        head_.insert(head_.end(), data, data + take);
+        data += take;
+        pos += take;
+        if (head_.size() < needBytes_) break;
+
+        const size_t before = nextParse_;
+        step();
+        // head_ 始终从 nextParse_ 开始
+        const size_t consumed = nextParse_ - before;
+        if (consumed >= head_.size()) {
+            head_.clear();
+        }
+        else if (consumed > 0) {
+            head_.erase(head_.begin(), head_.begin() + consumed);
+        }
+    }
+}
+
+void SeekIndex::resync(size_t byteOffset, std::optional<uint64_t> pcmFrame) {
+    head_.clear();
+    streamPos_ = byteOffset;
+    frameAfterResync_.reset();
+
+    // 往回读（解码器初始化时反复从头探测）不影响扫描进度，反正前面都看过了
+    if (!pcmFrame && stage_ != Stage::Lost && byteOffset <= nextParse_) return;
+
+    if (byteOffset == 0) {
+        stage_ = Stage::Detect;
+        nextParse_ = 0;
+        needBytes_ = 10;
+        return;
+    }
+
+    stage_ = Stage::Lost;
+    if (format_ == Format::Mp3) {
+        // MP3 帧头里没有帧号，只有跳到已知的帧上才能接着数
+        if (!pcmFrame) {
+            for (const auto& [frame, offset] : exact_) {
+                if (offset == byteOffset) pcmFrame = frame;
+                if (offset >= byteOffset) break;
+            }
+        }
+        if (pcmFrame) {
+            stage_ = Stage::Mp3Frame;
+            verifying_ = false;
+            scanFrame_ = *pcmFrame;
+            nextParse_ = byteOffset;
+            needBytes_ = 4;
+        }
+    }
+    else if (format_ == Format::Flac && byteOffset >= audioStart_) {
+        // FLAC 帧头自带采样号，从哪开始都能接上
+        stage_ = Stage::FlacFrame;
+        nextParse_ = byteOffset;
+        needBytes_ = 16;
+        expectedSample_ = pcmFrame;
+        tentative_.reset();
+    }
+}
+
+void SeekIndex::step() {
+    switch (stage_) {
+    case Stage::Detect:    stepDetect(); break;
+    case Stage::Mp3Frame:  stepMp3Frame(); break;
+    case Stage::FlacMeta:  stepFlacMeta(); break;
+    case Stage::FlacFrame: stepFlacFrame(); break;
+    case Stage::Lost:      break;
+    }
+}
+
+void SeekIndex::stepDetect() {
+    const uint8_t* p = head_.data();
+
+    // ID3v2 标签整个跳过，后面可能是 MP3 也可能是 FLAC
+    if (std::memcmp(p, "ID3", 3) == 0) {
+        const size_t size = (size_t(p[6] & 0x7F) << 21) | (size_t(p[7] & 0x7F) << 14)
+            | (size_t(p[8] & 0x7F) << 7) | (p[9] & 0x7F);
+        // 不大的标签攒齐了找一下 iTunes 写的无缝信息
+        if (size <= MaxTagScan) {
+            if (head_.size() < 10 + size) {
+                needBytes_ = 10 + size;
+                return;
+            }
+            parseITunSmpb(p + 10, size);
+        }
+        nextParse_ += 10 + size + ((p[5] & 0x10) ? 10 : 0);
+        needBytes_ = 10;
+        return;
+    }
+    if (std::memcmp(p, "fLaC", 4) == 0) {
+        stage_ = Stage::FlacMeta;
+        nextParse_ += 4;
+        needBytes_ = 4;
+        flacSeekTable_.clear();
+        return;
+    }
+    Mp3Header h;
+    if (parseMp3Header(p, h)) {
+        stage_ = Stage::Mp3Frame;
+        verifying_ = true;
+        scanFrame_ = 0;
+        needBytes_ = 4;
+        return;
+    }
+
+    // 开头有垃圾数据的文件也不少，往后挪一个字节接着找
+    if (++nextParse_ > DetectLimit) {
+        LOG_DEBUG("SeekIndex: unknown format, give up scanning");
+        stage_ = Stage::Lost;
+    }
+}
+
+void SeekIndex::stepMp3Frame() {
+    const uint8_t* p = head_.data();
+    Mp3Header h;
+    const bool valid = parseMp3Header(p, h);
+
+    if (verifying_) {
+        // 第一帧：后面紧跟着的也得是同样的帧头才算数
+        if (valid && head_.size() < h.frameBytes + 4) {
+            needBytes_ = h.frameBytes + 4;
+            return;
+        }
+        Mp3Header next;
+        if (!valid || !parseMp3Header(p + h.frameBytes, next) || mp3Signature(p + h.frameBytes) != mp3Signature(p)) {
+            stage_ = Stage::Detect;
+            needBytes_ = 10;
+            ++nextParse_;
+            return;
+        }
+        verifying_ = false;
+        format_ = Format::Mp3;
+        sampleRate_ = h.sampleRate;
+        samplesPerFrame_ = h.samples;
+        mp3Signature_ = mp3Signature(p);
+        audioStart_ = nextParse_;
+        gapless_.reset();
+        parseVbrHeader(p, h.frameBytes, h.sideInfoBytes);
+        // iTunSMPB 比 LAME 头优先，它直接给了原始长度
+        if (smpb_) {
+            const uint64_t xingFrame = declaredFrames_ ? h.samples : 0;
+            gapless_ = Gapless{ xingFrame + smpb_->first, xingFrame + smpb_->first + smpb_->second };
+        }
+        dirty_ = true;
+    }
+    else if (!valid || mp3Signature(p) != mp3Signature_) {
+        // 到了结尾的 ID3v1/APE 标签或者坏数据，后面的交给估算
+        stage_ = Stage::Lost;
+        return;
+    }
+
+    recordPoint(scanFrame_, nextParse_);
+    scanFrame_ += h.samples;
+    nextParse_ += h.frameBytes;
+    needBytes_ = 4;
+}
+
+void SeekIndex::parseVbrHeader(const uint8_t* frame, size_t frameBytes, size_t sideInfoBytes) {
+    const uint64_t spf = samplesPerFrame_;
+
+    // Xing/Info：帧数、字节数、100 项的百分比目录
+    const size_t x = 4 + sideInfoBytes;
+    if (x + 8 <= frameBytes && (std::memcmp(frame + x, "Xing", 4) == 0 || std::memcmp(frame + x, "Info", 4) == 0)) {
+        const uint32_t flags = be32(frame + x + 4);
+        size_t q = x + 8;
+        uint32_t frames = 0;
+        uint32_t bytes = 0;
+        if ((flags & 1) && q + 4 <= frameBytes) { frames = be32(frame + q); q += 4; }
+        if ((flags & 2) && q + 4 <= frameBytes) { bytes = be32(frame + q); q += 4; }
+        // 解码器会把 Xing 这一帧也当静音帧解出来，所以多算一帧
+        if (frames) declaredFrames_ = (uint64_t(frames) + 1) * spf;
+        if ((flags & 4) && frames && bytes && q + 100 <= frameBytes) {
+            for (int i = 1; i < 100; ++i) {
+                approx_[spf + uint64_t(frames) * spf * i / 100] = audioStart_ + size_t(frame[q + i]) * bytes / 256;
+            }
+        }
+        if (flags & 4) q += 100;
+        if (flags & 8) q += 4;
+
+        // LAME 扩展：9 字节编码器名之后，第 21 字节起的 3 字节是延迟和补齐各 12 位（ffmpeg 写的 Lavc/Lavf 也一样）
+        if (frames && q + 24 <= frameBytes && (std::memcmp(frame + q, "LAME", 4) == 0
+            || std::memcmp(frame + q, "Lavc", 4) == 0 || std::memcmp(frame + q, "Lavf", 4) == 0)) {
+            const uint32_t v = be24(frame + q + 21);
+            const uint64_t delay = v >> 12;
+            const uint64_t padding = v & 0xFFF;
+            const uint64_t total = uint64_t(frames) * spf;
+            // 输出整体晚了解码器延迟那么多，长度还是 总帧数 - 延迟 - 补齐
+            if (delay + padding < total) {
+                const uint64_t start = spf + delay + Mp3DecoderDelay;
+                gapless_ = Gapless{ start, (std::min)(start + total - delay - padding, declaredFrames_) };
+            }
+        }
+        return;
+    }
+
+    // VBRI（Fraunhofer）：固定在 side info 32 字节之后，目录每项是一段的字节数
+    const size_t v = 4 + 32;
+    if (v + 26 <= frameBytes && std::memcmp(frame + v, "VBRI", 4) == 0) {
+        const uint32_t frames = be32(frame + v + 14);
+        const uint32_t entries = be16(frame + v + 18);
+        const uint32_t scale = be16(frame + v + 20);
+        const uint32_t entrySize = be16(frame + v + 22);
+        const uint32_t framesPerEntry = be16(frame + v + 24);
+        if (frames) declaredFrames_ = (uint64_t(frames) + 1) * spf;
+        if (entrySize == 0 || entrySize > 4) return;
+
+        size_t q = v + 26;
+        size_t offset = audioStart_;
+        for (uint32_t i = 0; i < entries && q + entrySize <= frameBytes; ++i, q += entrySize) {
+            uint32_t size = 0;
+            for (uint32_t b = 0; b < entrySize; ++b) {
+                size = (size << 8) | frame[q + b];
+            }
+            offset += size_t(size) * scale;
+            approx_[uint64_t(i + 1) * framesPerEntry * spf] = offset;
+        }
+    }
+}
+
+void SeekIndex::parseITunSmpb(const uint8_t* tag, size_t len) {
+    // COMM 帧：描述是 iTunSMPB，正文是空格隔开的十六进制：0 延迟 补齐 原始采样数 ...
+    static constexpr char Key[] = "iTunSMPB";
+    const uint8_t* end = tag + len;
+    const uint8_t* it = std::search(tag, end, Key, Key + sizeof(Key) - 1);
+    if (it == end) return;
+    it = std::find(it, end, 0);     // 描述以 0 结尾，后面是正文（UTF-16 的就不管了）
+
+    uint64_t values[4] = {};
+    int count = 0;
+    while (it != end && count < 4) {
+        while (it != end && !std::isxdigit(*it)) {
+            if (*it != 0 && *it != ' ') return;
+            ++it;
+        }
+        if (it == end) break;
+        uint64_t value = 0;
+        for (; it != end && std::isxdigit(*it); ++it) {
+            const int c = *it;
+            value = (value << 4) | static_cast<uint64_t>(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+        }
+        values[count++] = value;
+    }
+    if (count == 4 && values[3] != 0) {
+        smpb_ = std::make_pair(values[1], values[3]);
+    }
+}
+
+void SeekIndex::stepFlacMeta() {
+    const uint8_t* p = head_.data();
+    const bool last = p[0] & 0x80;
+    const int type = p[0] & 0x7F;
+    const size_t len = be24(p + 1);
+    if (type == 127) {
+        stage_ = Stage::Lost;
+        return;
+    }
+
+    // 只关心 STREAMINFO 和 SEEKTABLE，其他块（封面之类）直接跳过
+    if ((type == 0 || type == 3) && len <= MaxMetadataBlock) {
+        if (head_.size() < 4 + len) {
+            needBytes_ = 4 + len;
+            return;
+        }
+        if (type == 0 && len >= streamInfo_.size()) {
+            std::memcpy(streamInfo_.data(), p + 4, streamInfo_.size());
+            parseStreamInfo();
+        }
+        else if (type == 3) {
+            for (size_t q = 4; q + 18 <= 4 + len; q += 18) {
+                const uint64_t sample = be64(p + q);
+                if (sample == ~0ull) continue;     // 占位点
+                flacSeekTable_.emplace_back(sample, be64(p + q + 8));
+            }
+        }
+    }
+    nextParse_ += 4 + len;
+    needBytes_ = 4;
+    if (!last) return;
+
+    if (!hasStreamInfo_) {
+        stage_ = Stage::Lost;
+        return;
+    }
+    format_ = Format::Flac;
+    audioStart_ = nextParse_;
+    // SEEKTABLE 里的点本来就对齐帧头
+    for (const auto& [sample, offset] : flacSeekTable_) {
+        exact_[sample] = audioStart_ + static_cast<size_t>(offset);
+    }
+    flacSeekTable_.clear();
+    stage_ = Stage::FlacFrame;
+    needBytes_ = 16;
+    expectedSample_ = 0;
+    dirty_ = true;
+}
+
+void SeekIndex::parseStreamInfo() {
+    const uint8_t* si = streamInfo_.data();
+    const uint32_t minBlock = be16(si);
+    const uint32_t maxBlock = be16(si + 2);
+    flacFixedBlock_ = minBlock == maxBlock ? minBlock : 0;
+    flacMaxFrameBytes_ = be24(si + 7);
+    sampleRate_ = (uint32_t(si[10]) << 12) | (uint32_t(si[11]) << 4) | (si[12] >> 4);
+    flacTotal_ = (uint64_t(si[13] & 0x0F) << 32) | be32(si + 14);
+    hasStreamInfo_ = true;
+}
+
+void SeekIndex::stepFlacFrame() {
+    FlacFrameHeader h;
+    if (!parseFlacHeader(head_.data(), h)) {
+        skipToNextSync(1);
+        return;
+    }
+    const uint64_t block = flacFixedBlock_ ? flacFixedBlock_ : h.blockSize;
+    const uint64_t sample = h.variable ? h.number : h.number * block;
+    if (flacTotal_ && sample >= flacTotal_) {
+        skipToNextSync(1);
+        return;
+    }
+
+    if (expectedSample_ && tentative_ && sample == *expectedSample_) {
+        // 跳转后的第一个帧头被下一帧确认了
+        recordPoint(tentative_->first, tentative_->second);
+        tentative_.reset();
+    }
+    if (expectedSample_ && !tentative_) {
+        // 连续扫描中，采样号对不上的是数据里碰巧长得像帧头的
+        if (sample != *expectedSample_) {
+            skipToNextSync(1);
+            return;
+        }
+        recordPoint(sample, nextParse_);
+    }
+    else {
+        // 还没确认过：先记下来，下一帧对上了再进索引；对不上就换成这一个
+        tentative_.emplace(sample, nextParse_);
+        frameAfterResync_ = sample;
+    }
+    expectedSample_ = sample + h.blockSize;
+    skipToNextSync(h.headerBytes);
+}
+
+void SeekIndex::skipToNextSync(size_t from) {
+    // head_ 从 nextParse_ 开始，前 from 个字节已经看过了；跳到后面下一个 0xFF，没有就整段丢掉
+    size_t i = from;
+    while (i < head_.size() && head_[i] != 0xFF) {
+        ++i;
+    }
+    nextParse_ += i;
+}
+
+uint64_t SeekIndex::pointSpacing() const {
+    // 半秒一个点，跳转时最多多解半秒
+    return sampleRate_ ? sampleRate_ / 2 : 22050;
+}
+
+void SeekIndex::recordPoint(uint64_t pcmFrame, size_t byteOffset) {
+    const uint64_t spacing = pointSpacing();
+    auto it = exact_.upper_bound(pcmFrame);
+    if (it != exact_.end() && it->first - pcmFrame < spacing) return;
+    if (it != exact_.begin() && pcmFrame - std::prev(it)->first < spacing) return;
+    exact_.emplace_hint(it, pcmFrame, byteOffset);
+    dirty_ = true;
+}
+
+uint64_t SeekIndex::totalFrames(size_t fileLength) const {
+    if (format_ == Format::Flac && flacTotal_) return flacTotal_;
+    if (format_ == Format::Mp3 && declaredFrames_) return declaredFrames_;
+    if (format_ == Format::Unknown || exact_.empty() || fileLength <= audioStart_) return 0;
+
+    // 按已经扫过部分的平均每字节帧数往后推
+    const auto& [frame, offset] = *exact_.rbegin();
+    if (frame == 0 || offset <= audioStart_) return 0;
+    return uint64_t(fileLength - audioStart_) * frame / (offset - audioStart_);
+}
+
+std::optional<SeekIndex::SeekPoint> SeekIndex::locate(uint64_t targetFrame, size_t fileLength) const {
+    if (format_ == Format::Unknown) return std::nullopt;
+
+    // 下界：精确点和目录点里不超过目标的最大那个，一样近优先精确点
+    std::optional<SeekPoint> lo;
+    auto exactIt = exact_.upper_bound(targetFrame);
+    if (exactIt != exact_.begin()) {
+        const auto& [frame, offset] = *std::prev(exactIt);
+        lo = SeekPoint{ offset, frame, true };
+    }
+    auto approxIt = approx_.upper_bound(targetFrame);
+    if (approxIt != approx_.begin()) {
+        const auto& [frame, offset] = *std::prev(approxIt);
+        if (!lo || frame > lo->pcmFrame) lo = SeekPoint{ offset, frame, false };
+    }
+    if (!lo) {
+        lo = SeekPoint{ audioStart_, 0, true };
+    }
+    // 离精确点够近：从那里解码丢掉一小段就行
+    if (lo->exact && targetFrame - lo->pcmFrame <= 2 * pointSpacing()) {
+        return lo;
+    }
+
+    // 上界：目标之后最近的点，都没有就用文件末尾
+    std::optional<SeekPoint> hi;
+    if (exactIt != exact_.end()) {
+        hi = SeekPoint{ exactIt->second, exactIt->first, true };
+    }
+    if (approxIt != approx_.end() && (!hi || approxIt->first < hi->pcmFrame)) {
+        hi = SeekPoint{ approxIt->second, approxIt->first, false };
+    }
+    const uint64_t total = totalFrames(fileLength);
+    if (!hi && total > targetFrame && fileLength > lo->byteOffset) {
+        hi = SeekPoint{ fileLength, total, false };
+    }
+    if (!hi || hi->pcmFrame <= lo->pcmFrame || hi->byteOffset <= lo->byteOffset) {
+        return lo;
+    }
+
+    // 两点之间按字节线性插值，落点不在帧头上解码器自己会找同步
+    const double ratio = double(targetFrame - lo->pcmFrame) / double(hi->pcmFrame - lo->pcmFrame);
+    size_t byte = lo->byteOffset + static_cast<size_t>(ratio * double(hi->byteOffset - lo->byteOffset));
+    if (format_ == Format::Flac) {
+        // 往前让一个最大帧长，尽量落在目标之前，之后靠帧头里的采样号把多出来的丢掉
+        const size_t backoff = flacMaxFrameBytes_ ? flacMaxFrameBytes_ : 16 * 1024;
+        byte = byte > lo->byteOffset + backoff ? byte - backoff : lo->byteOffset;
+    }
+    return SeekPoint{ byte, targetFrame, false };
+}
+
+std::vector<uint8_t> SeekIndex::flacPreamble() const {
+    std::vector<uint8_t> out = { 'f', 'L', 'a', 'C', 0x80, 0x00, 0x00, static_cast<uint8_t>(streamInfo_.size()) };
+    out.insert(out.end(), streamInfo_.begin(), streamInfo_.end());
+
+    // 总采样数和 MD5 都填 0（未知），从半路开始解这两个都对不上
+    uint8_t* si = out.data() + 8;
+    si[13] &= 0xF0;
+    std::memset(si + 14, 0, 4 + 16);
+    return out;
+}
+
+bool SeekIndex::load(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (bytes.size() < sizeof(IndexMagic) + sizeof(uint64_t)) return false;
+
+    uint64_t checksum = 0;
+    std::memcpy(&checksum, bytes.data() + bytes.size() - sizeof(uint64_t), sizeof(uint64_t));
+    bytes.resize(bytes.size() - sizeof(uint64_t));
+    if (checksum != fnv1a(bytes.data(), bytes.size())
+        || std::memcmp(bytes.data(), IndexMagic, sizeof(IndexMagic)) != 0) {
+        return false;
+    }
+
+    size_t pos = sizeof(IndexMagic);
+    uint8_t format = 0;
+    uint64_t audioStart = 0;
+    uint32_t count = 0;
+    if (!get(bytes, pos, format) || !get(bytes, pos, sampleRate_) || !get(bytes, pos, samplesPerFrame_)
+        || !get(bytes, pos, mp3Signature_) || !get(bytes, pos, audioStart) || !get(bytes, pos, declaredFrames_)
+        || pos + streamInfo_.size() > bytes.size()) {
+        return false;
+    }
+    std::memcpy(streamInfo_.data(), bytes.data() + pos, streamInfo_.size());
+    pos += streamInfo_.size();
+
+    for (auto* points : { &exact_, &approx_ }) {
+        if (!get(bytes, pos, count)) return false;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint64_t frame = 0, offset = 0;
+            if (!get(bytes, pos, frame) || !get(bytes, pos, offset)) return false;
+            (*points)[frame] = static_cast<size_t>(offset);
+        }
+    }
+
+    format_ = static_cast<Format>(format);
+    audioStart_ = static_cast<size_t>(audioStart);
+    if (format_ == Format::Flac) {
+        parseStreamInfo();
+    }
+    dirty_ = false;
+    return true;
+}
+
+bool SeekIndex::save(const fs::path& path) {
+    if (format_ == Format::Unknown) return false;
+
+    std::vector<uint8_t> bytes(IndexMagic, IndexMagic + sizeof(IndexMagic));
+    put<uint8_t>(bytes, static_cast<uint8_t>(format_));
+    put<uint32_t>(bytes, sampleRate_);
+    put<uint32_t>(bytes, samplesPerFrame_);
+    put<uint16_t>(bytes, mp3Signature_);
+    put<uint64_t>(bytes, audioStart_);
+    put<uint64_t>(bytes, declaredFrames_);
+    bytes.insert(bytes.end(), streamInfo_.begin(), streamInfo_.end());
+    for (const auto* points : { &exact_, &approx_ }) {
+        put<uint32_t>(bytes, static_cast<uint32_t>(points->size()));
+        for (const auto& [frame, offset] : *points) {
+            put<uint64_t>(bytes, frame);
+            put<uint64_t>(bytes, offset);
+        }
+    }
+    put<uint64_t>(bytes, fnv1a(bytes.data(), bytes.size()));
+
+    // 和磁盘缓存的索引一样先写临时文件再换过去
+    fs::path tmpPath = path;
+    tmpPath += ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        if (!out) {
+            LOG_WARN("Seek index write failed: %s", tmpPath.string().c_str());
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    if (ec) {
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+    dirty_ = false;
+    return true;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <map>
+#include <array>
+#include <vector>
+#include <optional>
+#include <filesystem>
+#include <cstdint>
+#include <cstddef>
+
+// 边下边建的跳转索引：解码器读到的原始字节顺手过一遍，记下帧在文件里的位置
+// MP3 记帧头偏移，再加上 Xing/VBRI 里的目录；FLAC 用 SEEKTABLE 加帧头扫描（FLAC 帧头里带绝对采样号）
+// 有了它 seek 就能换成一个确切的字节位置，VBR 不会再按字节比例算歪
+class SeekIndex {
+public:
+    enum class Format : uint8_t { Unknown, Mp3, Flac };
+
+    struct SeekPoint {
+        size_t byteOffset = 0;      // 从这里开始喂给解码器
+        uint64_t pcmFrame = 0;      // 这里对应的 PCM 帧序号
+        bool exact = false;         // false 表示按目录或插值估的，字节不一定落在帧头上，帧号也是估的
+    };
+
+    // 解码出来的 PCM 里真正属于这首歌的范围，前面是编码器/解码器延迟（还有 Xing 那一帧），后面是补齐
+    struct Gapless {
+        uint64_t startFrame = 0;
+        uint64_t endFrame = 0;      // 0 表示不知道在哪结束，放到解码器读完
+    };
+
+    // 喂一段解码器读到的字节，offset 是它的文件偏移；和上一段接不上就当作跳转了
+    void observe(size_t offset, const uint8_t* data, size_t len);
+    // 接下来从 byteOffset 开始读；知道那里是第几帧（精确跳转）就带上，MP3 才能接着往下记
+    void resync(size_t byteOffset, std::optional<uint64_t> pcmFrame);
+    // 最近一次跳转之后扫到的第一个 FLAC 帧头的采样号，估出来的落点靠它校正
+    std::optional<uint64_t> frameAfterResync() const { return frameAfterResync_; }
+
+    // 跳到 targetFrame 该从哪读：附近有精确点就用，不然在已知点之间插值
+    std::optional<SeekPoint> locate(uint64_t targetFrame, size_t fileLength) const;
+    // 总帧数：FLAC 看 STREAMINFO，MP3 看 Xing/VBRI，都没有就按已扫过部分的平均帧长估；不知道返回 0
+    uint64_t totalFrames(size_t fileLength) const;
+
+    // MP3 的 LAME 头或 iTunSMPB 里写了延迟和补齐才有；FLAC 本身就是无缝的，不用裁
+    std::optional<Gapless> gapless() const { return gapless_; }
+
+    Format format() const { return format_; }
+    uint32_t sampleRate() const { return sampleRate_; }
+    // FLAC 从半路重开解码器时垫在最前面的头：fLaC + 只剩一个 STREAMINFO 的元数据
+    std::vector<uint8_t> flacPreamble() const;
+
+    // 和磁盘缓存放在一起，下次打开同一首歌直接能精确跳
+    bool load(const std::filesystem::path& path);
+    bool save(const std::filesystem::path& path);
+    bool dirty() const { return dirty_; }
+
+private:
+    enum class Stage : uint8_t {
+        Detect,     // 文件开头：跳过 ID3v2，认格式
+        Mp3Frame,   // 一帧一帧往后数
+        FlacMeta,   // FLAC 元数据块
+        FlacFrame,  // 找 FLAC 帧头
+        Lost        // 对不上了，等下一次带帧号的 resync
+    };
+
+    static constexpr size_t DetectLimit = 64 * 1024;        // 开头这么多字节里还认不出格式就不扫了
+    static constexpr size_t MaxMetadataBlock = 1024 * 1024; // 再大的 SEEKTABLE 就不解析了，直接跳过
+    static constexpr size_t MaxTagScan = 256 * 1024;        // ID3v2 标签不超过这么大才攒下来找 iTunSMPB（大的多半是封面）
+    static constexpr uint32_t Mp3DecoderDelay = 529;        // MP3 解码器固有的延迟，LAME 头里的延迟不含这部分
+
+    void step();        // 解析 head_ 里攒好的字节，推进 nextParse_
+    void stepDetect();
+    void stepMp3Frame();
+    void stepFlacMeta();
+    void stepFlacFrame();
+    void parseVbrHeader(const uint8_t* frame, size_t frameBytes, size_t sideInfoBytes);
+    void parseITunSmpb(const uint8_t* tag, size_t len);
+    void parseStreamInfo();
+    void skipToNextSync(size_t from);   // FLAC：从 head_[from] 起找下一个可能的帧头
+    void recordPoint(uint64_t pcmFrame, size_t byteOffset);
+    uint64_t pointSpacing() const;
+
+    // 扫描状态
+    Stage stage_ = Stage::Detect;
+    size_t nextParse_ = 0;          // 下一个要解析的文件偏移
+    size_t needBytes_ = 10;         // 解析当前位置至少要攒这么多字节
+    std::vector<uint8_t> head_;     // 从 nextParse_ 开始攒下的字节
+    size_t streamPos_ = 0;          // 上一段 observe 的末尾，用来发现不连续
+    bool verifying_ = false;        // MP3 第一帧要连下一帧一起确认，防止把垃圾数据当帧头
+    uint64_t scanFrame_ = 0;        // MP3：nextParse_ 处那一帧的 PCM 帧序号
+    std::optional<uint64_t> expectedSample_;    // FLAC：下一个帧头应该带的采样号
+    std::optional<std::pair<uint64_t, size_t>> tentative_;     // FLAC：跳转后第一个帧头，等下一帧确认了再记
+    std::optional<uint64_t> frameAfterResync_;
+
+    // 索引本身
+    Format format_ = Format::Unknown;
+    uint32_t sampleRate_ = 0;
+    size_t audioStart_ = 0;         // 第一帧的文件偏移，格式认出来之后才有效
+    uint32_t samplesPerFrame_ = 0;  // MP3
+    uint16_t mp3Signature_ = 0;     // MP3 帧头里每帧都一样的那几位（版本、层、采样率）
+    uint64_t declaredFrames_ = 0;   // MP3：Xing/VBRI 里写的总长度，换算成 PCM 帧
+    std::optional<std::pair<uint64_t, uint64_t>> smpb_;     // MP3：ID3 里 iTunSMPB 的延迟和原始采样数
+    std::optional<Gapless> gapless_;
+    std::array<uint8_t, 34> streamInfo_{};  // FLAC：STREAMINFO 原样存着，重开解码器要用
+    bool hasStreamInfo_ = false;
+    uint64_t flacTotal_ = 0;
+    uint32_t flacFixedBlock_ = 0;   // 定长分块时每帧的采样数，帧头里存的是帧号
+    uint32_t flacMaxFrameBytes_ = 0;
+    std::vector<std::pair<uint64_t, uint64_t>> flacSeekTable_;  // 采样号 -> 相对第一帧的偏移，元数据读完才知道第一帧在哪
+    std::map<uint64_t, size_t> exact_;      // PCM 帧 -> 帧头的文件偏移
+    std::map<uint64_t, size_t> approx_;     // 目录里估出来的点，不一定落在帧头上
+    bool dirty_ = false;
+};
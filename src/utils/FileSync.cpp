@@ -0,0 +1,54 @@
+#include "FileSync.h"
+#include "Logger.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace FileSync {
+
+bool syncFile(const std::filesystem::path& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        LOG_WARN("Sync open failed: %s, error %lu", path.string().c_str(), GetLastError());
+        return false;
+    }
+    const bool ok = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_WARN("Sync open failed: %s", path.string().c_str());
+        return false;
+    }
+    const bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+#endif
+    if (!ok) {
+        LOG_WARN("Sync failed: %s", path.string().c_str());
+    }
+    return ok;
+}
+
+bool syncDirectory(const std::filesystem::path& dir) {
+#ifdef _WIN32
+    (void)dir;
+    return true;
+#else
+    const int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+    const bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+} // namespace FileSync
@@ -0,0 +1,13 @@
+#pragma once
+#include <filesystem>
+
+// 把文件真正落到盘上（fsync / FlushFileBuffers），flush() 只是交给了系统，断电还是会丢
+// 先写临时文件再 rename 的套路要这样用：syncFile(tmp) -> rename -> syncDirectory(所在目录)
+// 同步的是整个文件，和哪个句柄写的无关，fstream 写的也可以另外拿路径来同步
+namespace FileSync {
+
+bool syncFile(const std::filesystem::path& path);
+// rename 本身记在目录里；Windows 上目录不用单独同步，直接返回 true
+bool syncDirectory(const std::filesystem::path& dir);
+
+} // namespace FileSync
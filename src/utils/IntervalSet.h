@@ -0,0 +1,87 @@
+#pragma once
+#include <map>
+#include <cstddef>
+#include <algorithm>
+
+// 不相交区间的集合，区间都是左闭右开 [start, end)，相邻或重叠的会自动合并
+// 用来记一个文件里哪些字节已经有了（磁盘缓存、内存里驻留的范围）
+class IntervalSet {
+public:
+    using Map = std::map<size_t, size_t>;   // start -> end
+
+    void add(size_t start, size_t end) {
+        if (start >= end) return;
+
+        // 往左找第一个可能接上的区间
+        auto it = intervals_.upper_bound(start);
+        if (it != intervals_.begin()) {
+            auto prev = std::prev(it);
+            if (prev->second >= start) {
+                it = prev;
+            }
+        }
+        // 把接上的全部吞掉
+        while (it != intervals_.end() && it->first <= end) {
+            start = (std::min)(start, it->first);
+            end = (std::max)(end, it->second);
+            bytes_ -= it->second - it->first;
+            it = intervals_.erase(it);
+        }
+        intervals_.emplace(start, end);
+        bytes_ += end - start;
+    }
+
+    void erase(size_t start, size_t end) {
+        if (start >= end) return;
+
+        auto it = intervals_.upper_bound(start);
+        if (it != intervals_.begin()) {
+            --it;
+        }
+        while (it != intervals_.end() && it->first < end) {
+            const size_t s = it->first;
+            const size_t e = it->second;
+            if (e <= start) {
+                ++it;
+                continue;
+            }
+            bytes_ -= e - s;
+            it = intervals_.erase(it);
+            // 两头没被删到的部分放回去
+            if (s < start) {
+                intervals_.emplace(s, start);
+                bytes_ += start - s;
+            }
+            if (e > end) {
+                intervals_.emplace(end, e);
+                bytes_ += e - end;
+                break;
+            }
+        }
+    }
+
+    // pos 所在区间的终点：[pos, 返回值) 全都在集合里，pos 不在集合里就返回 pos
+    size_t contiguousEnd(size_t pos) const {
+        auto it = intervals_.upper_bound(pos);
+        if (it == intervals_.begin()) return pos;
+        --it;
+        return it->second > pos ? it->second : pos;
+    }
+
+    bool contains(size_t start, size_t end) const {
+        return start >= end || contiguousEnd(start) >= end;
+    }
+
+    size_t totalBytes() const { return bytes_; }
+    bool empty() const { return intervals_.empty(); }
+    const Map& intervals() const { return intervals_; }
+
+    void clear() {
+        intervals_.clear();
+        bytes_ = 0;
+    }
+
+private:
+    Map intervals_;
+    size_t bytes_ = 0;
+};
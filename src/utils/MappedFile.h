@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// 只读地把整个文件映射进内存，Windows 走 CreateFileMapping，其他走 mmap
+// 映射好了文件句柄就关掉，只留映射；页是按需读进来的，打开多大的文件都是常数时间
+// 映射着的文件在 Windows 上不能被 rename 覆盖，要换文件先 close
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // 空文件也算失败
+    bool open(const std::filesystem::path& path);
+    void close();
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool isOpen() const { return data_ != nullptr; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
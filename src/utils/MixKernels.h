@@ -0,0 +1,135 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+// 混音用的几个内层循环，音频回调里每个周期都要跑，x64 上走 SSE2、ARM 上走 NEON，别的平台退回标量
+// 都是交错排列（LRLR...）的 PCM，n 是样本数不是帧数
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIX_KERNELS_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MIX_KERNELS_NEON 1
+#endif
+
+namespace MixKernels {
+
+constexpr float S16ToF32Scale = 1.0f / 32768.0f;
+constexpr float F32ToS16Scale = 32767.0f;
+
+// dst += src * gain
+inline void mixAdd(float* dst, const float* src, size_t n, float gain) {
+    size_t i = 0;
+#if defined(MIX_KERNELS_SSE2)
+    const __m128 g = _mm_set1_ps(gain);
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+        _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_loadu_ps(dst + i + 4), _mm_mul_ps(_mm_loadu_ps(src + i + 4), g)));
+    }
+#elif defined(MIX_KERNELS_NEON)
+    for (; i + 8 <= n; i += 8) {
+        vst1q_f32(dst + i, vmlaq_n_f32(vld1q_f32(dst + i), vld1q_f32(src + i), gain));
+        vst1q_f32(dst + i + 4, vmlaq_n_f32(vld1q_f32(dst + i + 4), vld1q_f32(src + i + 4), gain));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] += src[i] * gain;
+    }
+}
+
+// dst += src * 渐变的增益：第 k 帧的增益是 gain + k * step，同一帧的各个声道一样
+// 一个向量正好装下整数帧（1/2/4 声道）才走 SIMD；返回渐变结束时的增益
+inline float mixAddRamp(float* dst, const float* src, size_t frames, uint32_t channels, float gain, float step) {
+    size_t frame = 0;
+#if defined(MIX_KERNELS_SSE2) || defined(MIX_KERNELS_NEON)
+    if (channels != 0 && 4 % channels == 0) {
+        const size_t perVec = 4 / channels;
+        float lanes[4];
+        for (uint32_t k = 0; k < 4; ++k) {
+            lanes[k] = gain + step * static_cast<float>(k / channels);
+        }
+        const float inc = step * static_cast<float>(perVec);
+        const size_t n = frames * channels;
+        size_t i = 0;
+#if defined(MIX_KERNELS_SSE2)
+        __m128 g = _mm_loadu_ps(lanes);
+        const __m128 d = _mm_set1_ps(inc);
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+            g = _mm_add_ps(g, d);
+        }
+#else
+        float32x4_t g = vld1q_f32(lanes);
+        const float32x4_t d = vdupq_n_f32(inc);
+        for (; i + 4 <= n; i += 4) {
+            vst1q_f32(dst + i, vmlaq_f32(vld1q_f32(dst + i), vld1q_f32(src + i), g));
+            g = vaddq_f32(g, d);
+        }
+#endif
+        frame = i / channels;
+    }
+#endif
+    // 剩下的和声道数对不上的按帧来，增益按帧号直接算，不累加误差
+    for (; frame < frames; ++frame) {
+        const float g = gain + step * static_cast<float>(frame);
+        for (uint32_t c = 0; c < channels; ++c) {
+            dst[frame * channels + c] += src[frame * channels + c] * g;
+        }
+    }
+    return gain + step * static_cast<float>(frames);
+}
+
+// s16 -> f32，[-32768, 32767] 映射到 [-1, 1)
+inline void s16ToF32(float* dst, const int16_t* src, size_t n) {
+    size_t i = 0;
+#if defined(MIX_KERNELS_SSE2)
+    const __m128 scale = _mm_set1_ps(S16ToF32Scale);
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        // 高 16 位放符号扩展：先搬到高半边再算术右移
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+#elif defined(MIX_KERNELS_NEON)
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t v = vld1q_s16(src + i);
+        vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), S16ToF32Scale));
+        vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), S16ToF32Scale));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = src[i] * S16ToF32Scale;
+    }
+}
+
+// f32 -> s16，超出 [-1, 1] 的削掉（几路叠在一起很容易超）
+inline void f32ToS16(int16_t* dst, const float* src, size_t n) {
+    size_t i = 0;
+#if defined(MIX_KERNELS_SSE2)
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(F32ToS16Scale);
+    for (; i + 8 <= n; i += 8) {
+        const __m128 a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo), hi), scale);
+        const __m128 b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), lo), hi), scale);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+#elif defined(MIX_KERNELS_NEON)
+    const float32x4_t lo = vdupq_n_f32(-1.0f);
+    const float32x4_t hi = vdupq_n_f32(1.0f);
+    for (; i + 8 <= n; i += 8) {
+        const float32x4_t a = vmulq_n_f32(vminq_f32(vmaxq_f32(vld1q_f32(src + i), lo), hi), F32ToS16Scale);
+        const float32x4_t b = vmulq_n_f32(vminq_f32(vmaxq_f32(vld1q_f32(src + i + 4), lo), hi), F32ToS16Scale);
+        vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b))));
+    }
+#endif
+    for (; i < n; ++i) {
+        const float x = (std::min)((std::max)(src[i], -1.0f), 1.0f) * F32ToS16Scale;
+        dst[i] = static_cast<int16_t>(x >= 0 ? x + 0.5f : x - 0.5f);
+    }
+}
+
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+// 单生产者单消费者无锁环形缓冲区（下载线程 -> 解码，解码线程 -> 音频回调 都用这个）
+// 读写下标单调递增，取模靠 mask_，所以容量会向上取整到 2 的幂，整个容量都能用
+// 生产者只写 head_，消费者只写 tail_，各自缓存对方的下标，减少跨核读
+// history > 0 时生产者少写这么多，读过的最后 history 个元素不会被覆盖，消费者可以 rewindRead 退回去重读
+template <typename T>
+class SpscRingBuffer {
+    static_assert(std::is_trivially_copyable_v<T>, "SpscRingBuffer 只放可以 memcpy 的类型");
+
+public:
+    // 一段连续内存，环绕的时候会分成两段
+    struct Span {
+        T* data = nullptr;
+        size_t size = 0;
+    };
+    struct Regions {
+        Span first;
+        Span second;
+        size_t size() const { return first.size + second.size; }
+    };
+
+    explicit SpscRingBuffer(size_t capacity, size_t history = 0)
+        : capacity_(roundUpPow2(capacity)),
+        mask_(capacity_ - 1),
+        history_((std::min)(history, capacity_ / 2)),
+        limit_(capacity_ - history_),
+        buffer_(std::make_unique<T[]>(capacity_)) {}
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    size_t capacity() const { return capacity_; }
+
+    //--------------------- 生产者 ---------------------
+    // 还能写多少
+    size_t writeAvailable() const {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        return freeSpace(head - tail_.load(std::memory_order_acquire));
+    }
+
+    // 可写区域，最多 n 个元素；写完必须 commitWrite
+    Regions writeRegions(size_t n) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (freeSpace(head - cachedTail_) < n) {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+        }
+        n = (std::min)(n, freeSpace(head - cachedTail_));
+        return regionsAt(head, n);
+    }
+
+    void commitWrite(size_t n) {
+        head_.store(head_.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    // 拷贝写入，返回实际写入数
+    size_t write(const T* src, size_t n) {
+        Regions r = writeRegions(n);
+        std::memcpy(r.first.data, src, r.first.size * sizeof(T));
+        std::memcpy(r.second.data, src + r.first.size, r.second.size * sizeof(T));
+        commitWrite(r.size());
+        return r.size();
+    }
+
+    //--------------------- 消费者 ---------------------
+    // 还能读多少
+    size_t readAvailable() const {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        return head_.load(std::memory_order_acquire) - tail;
+    }
+
+    // 可读区域，最多 n 个元素；读完必须 commitRead
+    Regions readRegions(size_t n) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (cachedHead_ - tail < n) {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+        }
+        n = (std::min)(n, cachedHead_ - tail);
+        return regionsAt(tail, n);
+    }
+
+    void commitRead(size_t n) {
+        const size_t tail = tail_.load(std::memory_order_relaxed) + n;
+        maxTail_ = (std::max)(maxTail_, tail);
+        tail_.store(tail, std::memory_order_release);
+    }
+
+    // 最多能退回去重读多少
+    // 以读到过的最远位置为准往回算 history：生产者手里的 tail 再旧也不会早于它，覆盖不到退回去的这段
+    size_t rewindAvailable() const {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t floor = maxTail_ > history_ ? maxTail_ - history_ : 0;
+        return tail > floor ? tail - floor : 0;
+    }
+
+    // 读指针往回退 n 个，n 不能超过 rewindAvailable()
+    void rewindRead(size_t n) {
+        tail_.store(tail_.load(std::memory_order_relaxed) - n, std::memory_order_release);
+    }
+
+    // 拷贝读出，返回实际读出数
+    size_t read(T* dest, size_t n) {
+        Regions r = readRegions(n);
+        std::memcpy(dest, r.first.data, r.first.size * sizeof(T));
+        std::memcpy(dest + r.first.size, r.second.data, r.second.size * sizeof(T));
+        commitRead(r.size());
+        return r.size();
+    }
+
+    // 单调下标，配合外部的偏移量做映射用
+    size_t writeIndex() const { return head_.load(std::memory_order_acquire); }
+    size_t readIndex() const { return tail_.load(std::memory_order_acquire); }
+
+    // 清空，只能在两端都停下来的时候调
+    void reset() {
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+        cachedHead_ = 0;
+        cachedTail_ = 0;
+        maxTail_ = 0;
+    }
+
+private:
+    static constexpr size_t CacheLine = 64;
+
+    static size_t roundUpPow2(size_t n) {
+        size_t p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    // 已经占用 used 个时还能写多少；退回重读之后 used 可能暂时超过 limit_
+    size_t freeSpace(size_t used) const {
+        return used < limit_ ? limit_ - used : 0;
+    }
+
+    Regions regionsAt(size_t index, size_t n) const {
+        const size_t pos = index & mask_;
+        const size_t first = (std::min)(n, capacity_ - pos);
+        return { { buffer_.get() + pos, first }, { buffer_.get(), n - first } };
+    }
+
+    const size_t capacity_;
+    const size_t mask_;
+    const size_t history_;      // 给 rewindRead 留的已读数据
+    const size_t limit_;        // 生产者最多领先消费者这么多
+    std::unique_ptr<T[]> buffer_;
+
+    // 生产者的一行：自己的写下标 + 缓存的读下标
+    alignas(CacheLine) std::atomic<size_t> head_{ 0 };
+    size_t cachedTail_ = 0;
+
+    // 消费者的一行：自己的读下标 + 缓存的写下标
+    alignas(CacheLine) std::atomic<size_t> tail_{ 0 };
+    size_t cachedHead_ = 0;
+    size_t maxTail_ = 0;        // 读到过的最远位置，只有消费者用
+};
@@ -0,0 +1,106 @@
+#include "StringInterner.h"
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+#include "Logger.h"
+
+StringInterner::StringInterner()
+    : segments_(new std::atomic<Entry*>[MaxSegments]) {
+    for (size_t i = 0; i < MaxSegments; ++i) {
+        segments_[i].store(nullptr, std::memory_order_relaxed);
+    }
+    // 0 号是空串，第一段先开好
+    segments_[0].store(new Entry[SegmentSize], std::memory_order_release);
+}
+
+StringInterner::~StringInterner() {
+    for (size_t i = 0; i < MaxSegments; ++i) {
+        delete[] segments_[i].load(std::memory_order_relaxed);
+    }
+}
+
+std::string_view StringInterner::Shard::store(std::string_view s) {
+    // 放不下就开新块；特别长的单独一块
+    if (blockUsed + s.size() > ArenaBlock) {
+        const size_t size = (std::max)(ArenaBlock, s.size());
+        blocks.emplace_back(new char[size]);
+        bytes += size;
+        blockUsed = 0;
+        if (size > ArenaBlock) {
+            blockUsed = ArenaBlock;   // 独占块，下次别往里塞
+            std::memcpy(blocks.back().get(), s.data(), s.size());
+            return { blocks.back().get(), s.size() };
+        }
+    }
+    char* dst = blocks.back().get() + blockUsed;
+    std::memcpy(dst, s.data(), s.size());
+    blockUsed += s.size();
+    return { dst, s.size() };
+}
+
+StringInterner::Id StringInterner::intern(std::string_view s) {
+    if (s.empty()) return Empty;
+    Shard& shard = shardFor(s);
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.ids.find(s);
+    if (it != shard.ids.end()) return it->second;
+
+    const std::string_view stored = shard.store(s);
+    const Id id = allocate(stored);
+    if (id != Empty) {
+        shard.ids.emplace(stored, id);
+    }
+    return id;
+}
+
+StringInterner::Id StringInterner::find(std::string_view s) const {
+    if (s.empty()) return Empty;
+    Shard& shard = shardFor(s);
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.ids.find(s);
+    return it == shard.ids.end() ? Empty : it->second;
+}
+
+StringInterner::Id StringInterner::allocate(std::string_view stored) {
+    std::lock_guard lock(allocMutex_);
+    const size_t id = count_.load(std::memory_order_relaxed);
+    if (id >= MaxSegments * SegmentSize) {
+        LOG_ERROR("StringInterner full");
+        return Empty;
+    }
+    Entry* segment = segments_[id >> SegmentBits].load(std::memory_order_relaxed);
+    if (!segment) {
+        segment = new Entry[SegmentSize];
+        segments_[id >> SegmentBits].store(segment, std::memory_order_release);
+    }
+    segment[id & SegmentMask] = { stored.data(), static_cast<uint32_t>(stored.size()) };
+    count_.store(id + 1, std::memory_order_release);
+    return static_cast<Id>(id);
+}
+
+std::shared_ptr<const std::vector<uint32_t>> StringInterner::ranks() const {
+    std::lock_guard lock(ranksMutex_);
+    const size_t n = size();
+    if (ranks_ && ranks_->size() == n) return ranks_;
+
+    // 字符串比较只在这里做一次 n log n，之后排序分组都比整数
+    std::vector<Id> order(n);
+    std::iota(order.begin(), order.end(), Id{ 0 });
+    std::sort(order.begin(), order.end(), [this](Id a, Id b) { return view(a) < view(b); });
+    auto ranks = std::make_shared<std::vector<uint32_t>>(n);
+    for (size_t r = 0; r < n; ++r) {
+        (*ranks)[order[r]] = static_cast<uint32_t>(r);
+    }
+    ranks_ = std::move(ranks);
+    return ranks_;
+}
+
+size_t StringInterner::memoryBytes() const {
+    size_t bytes = MaxSegments * sizeof(std::atomic<Entry*>);
+    bytes += ((size() + SegmentSize - 1) / SegmentSize) * SegmentSize * sizeof(Entry);
+    for (const Shard& shard : shards_) {
+        std::lock_guard lock(shard.mutex);
+        bytes += shard.bytes + shard.ids.size() * (sizeof(std::string_view) + sizeof(Id) + 2 * sizeof(void*));
+    }
+    return bytes;
+}
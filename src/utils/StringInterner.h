@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+// 全局字符串驻留池：歌手、专辑、封面这种在库里重复成千上万次的字符串只存一份，拿 32 位编号代替
+// - 编号稠密、从 1 开始，0 是空串；比较、哈希、分组都变成整数操作
+// - 文本追加到分块的 arena 里，块不挪，view() 拿到的 string_view 一直有效
+// - intern 按哈希分片加锁，view 不加锁（编号 -> 文本的目录只追加，发布用 release/acquire）
+// 排序要字典序的话用 ranks()：一次把所有编号排好，之后比 rank 就行
+class StringInterner {
+public:
+    using Id = uint32_t;
+    static constexpr Id Empty = 0;
+
+    static StringInterner& global() {
+        static StringInterner instance;
+        return instance;
+    }
+
+    StringInterner();
+    ~StringInterner();
+    StringInterner(const StringInterner&) = delete;
+    StringInterner& operator=(const StringInterner&) = delete;
+
+    Id intern(std::string_view s);
+    // 只查不加，没有返回 Empty（空串也是 Empty）
+    Id find(std::string_view s) const;
+    // 编号必须是这个池发出去的
+    std::string_view view(Id id) const {
+        const Entry& e = segments_[id >> SegmentBits].load(std::memory_order_acquire)[id & SegmentMask];
+        return { e.data, e.length };
+    }
+    // 已经发出去的编号数（含 0 号），编号都小于它
+    size_t size() const { return count_.load(std::memory_order_acquire); }
+
+    // 按字典序的名次，下标是编号：ranks[a] < ranks[b] 等价于 view(a) < view(b)
+    // 快照，之后新加的编号不在里面（下标越界），调用方拿 size() 比一下就知道要不要重取
+    std::shared_ptr<const std::vector<uint32_t>> ranks() const;
+
+    // arena 和目录占的内存
+    size_t memoryBytes() const;
+
+private:
+    static constexpr unsigned SegmentBits = 14;
+    static constexpr size_t SegmentSize = size_t{ 1 } << SegmentBits;
+    static constexpr uint32_t SegmentMask = SegmentSize - 1;
+    static constexpr size_t MaxSegments = 1 << 16;          // 最多 2^30 个编号，够了
+    static constexpr size_t ShardCount = 16;
+    static constexpr size_t ArenaBlock = 64 * 1024;
+
+    struct Entry {
+        const char* data = "";
+        uint32_t length = 0;
+    };
+
+    // 每个分片自己的哈希表和 arena，键指向 arena 里的文本
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string_view, Id> ids;
+        std::vector<std::unique_ptr<char[]>> blocks;
+        size_t blockUsed = ArenaBlock;      // 当前块用了多少，一开始没有块
+        size_t bytes = 0;
+
+        std::string_view store(std::string_view s);
+    };
+
+    Id allocate(std::string_view stored);
+    Shard& shardFor(std::string_view s) const {
+        return shards_[std::hash<std::string_view>{}(s) % ShardCount];
+    }
+
+    std::unique_ptr<std::atomic<Entry*>[]> segments_;
+    std::mutex allocMutex_;             // 发新编号、开新段的时候用，编号按顺序发布
+    std::atomic<size_t> count_{ 1 };    // 已经发出去的编号数
+    mutable Shard shards_[ShardCount];
+
+    mutable std::mutex ranksMutex_;
+    mutable std::shared_ptr<const std::vector<uint32_t>> ranks_;
+};
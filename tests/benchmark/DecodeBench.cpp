@@ -0,0 +1,207 @@
+#define MINIAUDIO_IMPLEMENTATION
+#include "miniaudio.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <filesystem>
+#include "source/AudioSourceFactory.h"
+#include "player/OfflineRenderer.h"
+#include "network/Network.h"
+#include "utils/Logger.h"
+
+// 解码吞吐基准：不开声卡，把每个输入按不同的块大小、Direct/Pipeline 两种方式各渲染一遍，报帧率和实时倍数
+// 用法：DecodeBench [--buffers 256,1024,4096] [--modes direct,pipeline] [--frames N] [--wav dir] [文件或 URL ...]
+// 不给输入的话自己生成几段 WAV 来测，CI 上没有素材也能跑
+
+namespace {
+
+struct Options {
+    std::vector<ma_uint32> buffers{ 256, 1024, 4096 };
+    std::vector<OfflineRenderer::Mode> modes{ OfflineRenderer::Mode::Direct, OfflineRenderer::Mode::Pipeline };
+    ma_uint64 maxFrames = 0;
+    std::string wavDir;         // 不空就把输出写成 WAV，方便对比
+    std::vector<std::string> inputs;
+};
+
+std::vector<std::string> split(const std::string& s) {
+    std::vector<std::string> parts;
+    std::stringstream ss(s);
+    std::string part;
+    while (std::getline(ss, part, ',')) {
+        if (!part.empty()) parts.push_back(part);
+    }
+    return parts;
+}
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--buffers" && hasValue) {
+            opt.buffers.clear();
+            for (const auto& b : split(argv[++i])) opt.buffers.push_back(static_cast<ma_uint32>(std::stoul(b)));
+        }
+        else if (arg == "--modes" && hasValue) {
+            opt.modes.clear();
+            for (const auto& m : split(argv[++i])) {
+                if (m == "direct") opt.modes.push_back(OfflineRenderer::Mode::Direct);
+                else if (m == "pipeline") opt.modes.push_back(OfflineRenderer::Mode::Pipeline);
+                else return false;
+            }
+        }
+        else if (arg == "--frames" && hasValue) {
+            opt.maxFrames = std::stoull(argv[++i]);
+        }
+        else if (arg == "--wav" && hasValue) {
+            opt.wavDir = argv[++i];
+        }
+        else if (arg.rfind("--", 0) == 0) {
+            return false;
+        }
+        else {
+            opt.inputs.push_back(arg);
+        }
+    }
+    return !opt.buffers.empty() && !opt.modes.empty();
+}
+
+bool isUrl(const std::string& s) {
+    return s.rfind("http://", 0) == 0 || s.rfind("https://", 0) == 0;
+}
+
+// 格式按扩展名报，生成的 WAV 名字里带了采样格式
+std::string formatLabel(const std::string& input) {
+    std::string path = input.substr(0, input.find('?'));
+    std::string ext = std::filesystem::path(path).extension().string();
+    if (!ext.empty()) ext.erase(0, 1);
+    for (auto& c : ext) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    return ext.empty() ? "?" : ext;
+}
+
+const char* pcmLabel(ma_format format) {
+    switch (format) {
+    case ma_format_u8:  return "u8";
+    case ma_format_s16: return "s16";
+    case ma_format_s24: return "s24";
+    case ma_format_s32: return "s32";
+    case ma_format_f32: return "f32";
+    default:            return "?";
+    }
+}
+
+// 生成 seconds 秒的正弦波 WAV
+bool generateWav(const std::string& path, ma_format format, ma_uint32 channels, ma_uint32 sampleRate, double seconds) {
+    WavSink sink(path, format, channels, sampleRate);
+    if (!sink.ok()) return false;
+    ma_waveform_config config = ma_waveform_config_init(format, channels, sampleRate, ma_waveform_type_sine, 0.2, 440);
+    ma_waveform wave;
+    if (ma_waveform_init(&config, &wave) != MA_SUCCESS) return false;
+
+    std::vector<uint8_t> buf(4096 * ma_get_bytes_per_frame(format, channels));
+    auto left = static_cast<ma_uint64>(seconds * sampleRate);
+    bool ok = true;
+    while (left > 0 && ok) {
+        const ma_uint64 n = (std::min<ma_uint64>)(left, 4096);
+        ma_waveform_read_pcm_frames(&wave, buf.data(), n, nullptr);
+        ok = sink.write(buf.data(), n);
+        left -= n;
+    }
+    ma_waveform_uninit(&wave);
+    return ok;
+}
+
+// 每次都重新开源，上一轮的解码器状态和缓存不带过来（网络源的磁盘缓存除外）
+struct Opened {
+    std::unique_ptr<ImplAudioSource> source;
+    std::shared_ptr<NetworkDownloader> downloader;
+
+    ~Opened() {
+        source.reset();
+        if (downloader) NetworkDownloadMgr::getInstance().releaseDownloader(downloader);
+    }
+};
+
+void open(const std::string& input, Opened& out) {
+    if (isUrl(input)) {
+        out.downloader = NetworkDownloadMgr::getInstance().getDownloader(input);
+        out.downloader->start();
+        out.source = AudioSourceFactory::fromMemory(out.downloader);
+    }
+    else {
+        out.source = AudioSourceFactory::fromFile(input);
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--buffers 256,1024,4096] [--modes direct,pipeline] [--frames N] [--wav dir] [inputs...]\n", argv[0]);
+        return 2;
+    }
+
+    if (opt.inputs.empty()) {
+        const auto dir = std::filesystem::temp_directory_path() / "decode_bench";
+        std::filesystem::create_directories(dir);
+        const struct { const char* name; ma_format format; } gen[] = {
+            { "sine_s16.wav", ma_format_s16 },
+            { "sine_f32.wav", ma_format_f32 },
+        };
+        for (const auto& g : gen) {
+            const std::string path = (dir / g.name).string();
+            if (!generateWav(path, g.format, 2, 44100, 60.0)) {
+                LOG_ERROR("Generate %s failed", path.c_str());
+                return 1;
+            }
+            opt.inputs.push_back(path);
+        }
+    }
+
+    std::printf("%-8s %-7s %-4s %-9s %6s %10s %9s %12s %8s %7s\n",
+        "source", "format", "pcm", "mode", "buffer", "frames", "seconds", "frames/s", "xRT", "stalls");
+
+    int failures = 0;
+    for (const auto& input : opt.inputs) {
+        for (const auto mode : opt.modes) {
+            for (const ma_uint32 buffer : opt.buffers) {
+                Opened opened;
+                open(input, opened);
+                if (!opened.source || !opened.source->decoderInit_) {
+                    LOG_ERROR("Open failed: %s", input.c_str());
+                    ++failures;
+                    break;
+                }
+                const ma_format format = opened.source->decoder_.outputFormat;
+                const ma_uint32 channels = opened.source->decoder_.outputChannels;
+                const ma_uint32 sampleRate = opened.source->decoder_.outputSampleRate;
+                const char* type = opened.source->SourceType() == AudioSourceType::NetworkStream ? "network" : "file";
+                const char* modeName = mode == OfflineRenderer::Mode::Direct ? "direct" : "pipeline";
+
+                std::unique_ptr<RenderSink> sink;
+                if (!opt.wavDir.empty()) {
+                    const auto name = std::filesystem::path(input.substr(0, input.find('?'))).stem().string()
+                        + "_" + modeName + "_" + std::to_string(buffer) + ".wav";
+                    sink = std::make_unique<WavSink>((std::filesystem::path(opt.wavDir) / name).string(), format, channels, sampleRate);
+                }
+                else {
+                    sink = std::make_unique<NullSink>();
+                }
+
+                OfflineRenderer renderer(buffer);
+                const OfflineRenderer::Stats stats = mode == OfflineRenderer::Mode::Direct
+                    ? renderer.render(*opened.source, *sink, opt.maxFrames)
+                    : renderer.renderPipeline(std::move(opened.source), *sink, opt.maxFrames);
+
+                std::printf("%-8s %-7s %-4s %-9s %6u %10llu %9.3f %12.0f %8.1f %7zu\n",
+                    type, formatLabel(input).c_str(), pcmLabel(format), modeName, buffer,
+                    static_cast<unsigned long long>(stats.frames), stats.seconds, stats.framesPerSecond(),
+                    stats.realtimeFactor(), stats.stalls);
+                if (stats.frames == 0) ++failures;
+            }
+        }
+    }
+    return failures ? 1 : 0;
+}